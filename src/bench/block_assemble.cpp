@@ -3,22 +3,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
 #include <test/util/mining.h>
 #include <test/util/script.h>
 #include <test/util/setup_common.h>
 #include <test/util/wallet.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 
 #include <vector>
 
-static void AssembleBlock(benchmark::Bench& bench)
+static void FillMempool(const TestingSetup& test_setup)
 {
-    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
-
     CScriptWitness witness;
     witness.stack.push_back(WITNESS_STACK_ELEM_OP_TRUE);
 
@@ -27,7 +28,7 @@ static void AssembleBlock(benchmark::Bench& bench)
     std::array<CTransactionRef, NUM_BLOCKS - COINBASE_MATURITY + 1> txs;
     for (size_t b{0}; b < NUM_BLOCKS; ++b) {
         CMutableTransaction tx;
-        tx.vin.push_back(MineBlock(test_setup->m_node, P2WSH_OP_TRUE));
+        tx.vin.push_back(MineBlock(test_setup.m_node, P2WSH_OP_TRUE));
         tx.vin.back().scriptWitness = witness;
         tx.vout.emplace_back(1337, P2WSH_OP_TRUE);
         if (NUM_BLOCKS - b >= COINBASE_MATURITY)
@@ -37,14 +38,55 @@ static void AssembleBlock(benchmark::Bench& bench)
         LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
 
         for (const auto& txr : txs) {
-            const MempoolAcceptResult res = ::AcceptToMemoryPool(test_setup->m_node.chainman->ActiveChainstate(), *test_setup->m_node.mempool, txr, false /* bypass_limits */);
+            const MempoolAcceptResult res = ::AcceptToMemoryPool(test_setup.m_node.chainman->ActiveChainstate(), *test_setup.m_node.mempool, txr, false /* bypass_limits */);
             assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
         }
     }
+}
+
+static void AssembleBlock(benchmark::Bench& bench)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    FillMempool(*test_setup);
 
     bench.run([&] {
         PrepareBlock(test_setup->m_node, P2WSH_OP_TRUE);
     });
 }
 
+static void AssembleBlockSnapshot(benchmark::Bench& bench)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    FillMempool(*test_setup);
+
+    BlockAssembler::Options options;
+    options.selection_threads = MAX_BLOCK_SELECTION_CANDIDATES;
+    bench.run([&] {
+        BlockAssembler{test_setup->m_node.chainman->ActiveChainstate(), *test_setup->m_node.mempool, Params(), options}.CreateNewBlock(P2WSH_OP_TRUE);
+    });
+}
+
+static void AssembleBlockCached(benchmark::Bench& bench)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    FillMempool(*test_setup);
+
+    BlockTemplateCache cache{*test_setup->m_node.mempool, Params(), P2WSH_OP_TRUE};
+    RegisterValidationInterface(&cache);
+    // Don't let notifications for the blocks mined above drop the template.
+    SyncWithValidationInterfaceQueue();
+    CChainState& chainstate = test_setup->m_node.chainman->ActiveChainstate();
+    const CBlockIndex* tip = WITH_LOCK(::cs_main, return chainstate.m_chain.Tip());
+    assert(WITH_LOCK(::cs_main, return cache.CreateNewBlock(chainstate)));
+
+    // The mempool is unchanged, so every call returns the cached template.
+    bench.run([&] {
+        assert(cache.GetBlockTemplate(tip));
+    });
+
+    UnregisterValidationInterface(&cache);
+}
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockSnapshot);
+BENCHMARK(AssembleBlockCached);
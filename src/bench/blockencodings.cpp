@@ -0,0 +1,69 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <consensus/merkle.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const size_t RECONSTRUCT_BLOCK_TXS = 3000;
+
+// Time for a compact block to be reconstructed from the mempool: a block of
+// RECONSTRUCT_BLOCK_TXS txs, all but a few of which are among num_mempool_txs
+// mempool txs.
+static void ReconstructBlock(benchmark::Bench& bench, size_t num_mempool_txs)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    FastRandomContext det_rand{true};
+
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_TRUE;
+    tx.vin[0].scriptWitness.stack.push_back({1});
+    tx.vout.resize(2);
+    block.vtx.push_back(MakeTransactionRef(tx)); // coinbase
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < num_mempool_txs; ++i) {
+            tx.vin[0].prevout = COutPoint(det_rand.rand256(), 0);
+            const CTransactionRef ptx = MakeTransactionRef(tx);
+            pool.addUnchecked(entry.FromTx(ptx));
+            if (det_rand.randrange(num_mempool_txs) < RECONSTRUCT_BLOCK_TXS) block.vtx.push_back(ptx);
+        }
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        tx.vin[0].prevout = COutPoint(det_rand.rand256(), 0);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.nBits = 0x207fffff;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    const CBlockHeaderAndShortTxIDs cmpctblock{block, true};
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    bench.unit("block").run([&] {
+        PartiallyDownloadedBlock partial_block(&pool);
+        const ReadStatus status = partial_block.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+    });
+}
+
+static void BlockEncodingsReconstruct20k(benchmark::Bench& bench)
+{
+    ReconstructBlock(bench, 20000);
+}
+
+static void BlockEncodingsReconstruct200k(benchmark::Bench& bench)
+{
+    ReconstructBlock(bench, 200000);
+}
+
+BENCHMARK(BlockEncodingsReconstruct20k);
+BENCHMARK(BlockEncodingsReconstruct200k);
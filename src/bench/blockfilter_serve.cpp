@@ -0,0 +1,74 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <index/blockfilterindex.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+#include <version.h>
+
+#include <functional>
+
+//! Size of a maximal getcfilters request
+static constexpr int SERVE_RANGE_BLOCKS = 1000;
+
+// Build a chain of SERVE_RANGE_BLOCKS blocks past the 100 block test chain,
+// index its basic filters, and time serving the last SERVE_RANGE_BLOCKS
+// filters as cfilter messages.
+static void ServeFilterRange(benchmark::Bench& bench, const std::function<void(BlockFilterIndex&, int, const CBlockIndex*)>& serve)
+{
+    const auto test_setup = std::make_unique<TestChain100Setup>();
+    for (int i = 0; i < SERVE_RANGE_BLOCKS; ++i) {
+        test_setup->CreateAndProcessBlock({}, CScript() << i << OP_DROP << OP_TRUE);
+    }
+    CChainState& chainstate = test_setup->m_node.chainman->ActiveChainstate();
+
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, /* f_memory */ true);
+    assert(filter_index.Start(chainstate));
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+    const int start_height = tip->nHeight - SERVE_RANGE_BLOCKS + 1;
+    bench.batch(SERVE_RANGE_BLOCKS).unit("filter").run([&] {
+        serve(filter_index, start_height, tip);
+    });
+
+    filter_index.Stop();
+}
+
+/** Read the filters from disk and serialize a message for each, as for every request before the cache. */
+static void BlockFilterServeRange(benchmark::Bench& bench)
+{
+    ServeFilterRange(bench, [](BlockFilterIndex& filter_index, int start_height, const CBlockIndex* stop_index) {
+        std::vector<BlockFilter> filters;
+        assert(filter_index.LookupFilterRange(start_height, stop_index, filters));
+        for (const auto& filter : filters) {
+            CSerializedNetMsg msg = CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::CFILTER, filter);
+            ankerl::nanobench::doNotOptimizeAway(msg);
+        }
+    });
+}
+
+/** Serve the range from the serialized filter cache, as for repeated requests of a recent range. */
+static void BlockFilterServeRangeCached(benchmark::Bench& bench)
+{
+    ServeFilterRange(bench, [](BlockFilterIndex& filter_index, int start_height, const CBlockIndex* stop_index) {
+        std::vector<BlockFilterIndex::SerializedFilter> filters;
+        assert(filter_index.LookupSerializedFilterRange(start_height, stop_index, filters));
+        for (const auto& filter : filters) {
+            CSerializedNetMsg msg;
+            msg.m_type = NetMsgType::CFILTER;
+            msg.data.assign(filter->begin(), filter->end());
+            ankerl::nanobench::doNotOptimizeAway(msg);
+        }
+    });
+}
+
+BENCHMARK(BlockFilterServeRange);
+BENCHMARK(BlockFilterServeRangeCached);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
 
@@ -52,3 +53,32 @@ static void CCoinsCaching(benchmark::Bench& bench)
 }
 
 BENCHMARK(CCoinsCaching);
+
+// Microbenchmark for CCoinsViewCache::BatchWrite, as done when flushing a
+// cache with many dirty entries into its parent cache.
+static void CCoinsCachingBatchWrite(benchmark::Bench& bench)
+{
+    static constexpr size_t NUM_COINS{10000};
+
+    FastRandomContext rand(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(NUM_COINS);
+    for (size_t i = 0; i < NUM_COINS; ++i) {
+        outpoints.emplace_back(rand.rand256(), rand.randrange(4));
+    }
+    const CTxOut txout(COIN, CScript() << OP_TRUE);
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache parent(&coinsDummy);
+    parent.SetBestBlock(rand.rand256());
+    bench.batch(NUM_COINS).unit("coin").run([&] {
+        CCoinsViewCache child(&parent);
+        for (const COutPoint& outpoint : outpoints) {
+            child.AddCoin(outpoint, Coin(txout, 1, false), true);
+        }
+        bool flushed = child.Flush();
+        assert(flushed);
+    });
+}
+
+BENCHMARK(CCoinsCachingBatchWrite);
@@ -20,10 +20,11 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
+// threads_num counts the master thread, which also processes checks.
+static void CCheckQueueSpeedPrevectorJobThreads(benchmark::Bench& bench, int threads_num)
 {
-    // We shouldn't ever be running with the checkqueue on a single core machine.
-    if (GetNumCores() <= 1) return;
+    // Oversubscribed cores would only measure the scheduler.
+    if (threads_num > GetNumCores()) return;
 
     const ECCVerifyHandle verify_handle;
     ECC_Start();
@@ -42,9 +43,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
         void swap(PrevectorJob& x){p.swap(x.p);};
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
-    // The main thread should be counted to prevent thread oversubscription, and
-    // to decrease the variance of benchmark results.
-    queue.StartWorkerThreads(GetNumCores() - 1);
+    queue.StartWorkerThreads(threads_num - 1);
 
     // create all the data once, then submit copies in the benchmark.
     FastRandomContext insecure_rand(true);
@@ -68,4 +67,30 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     queue.StopWorkerThreads();
     ECC_Stop();
 }
+static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
+{
+    // We shouldn't ever be running with the checkqueue on a single core machine.
+    if (GetNumCores() <= 1) return;
+
+    // The main thread should be counted to prevent thread oversubscription, and
+    // to decrease the variance of benchmark results.
+    CCheckQueueSpeedPrevectorJobThreads(bench, GetNumCores());
+}
+
+// Scaling curve of the same workload over a fixed number of threads.
+static void CCheckQueueSpeedPrevectorJob1Thread(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 1); }
+static void CCheckQueueSpeedPrevectorJob2Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 2); }
+static void CCheckQueueSpeedPrevectorJob4Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 4); }
+static void CCheckQueueSpeedPrevectorJob8Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 8); }
+static void CCheckQueueSpeedPrevectorJob16Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 16); }
+static void CCheckQueueSpeedPrevectorJob32Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 32); }
+static void CCheckQueueSpeedPrevectorJob64Threads(benchmark::Bench& bench) { CCheckQueueSpeedPrevectorJobThreads(bench, 64); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueSpeedPrevectorJob1Thread);
+BENCHMARK(CCheckQueueSpeedPrevectorJob2Threads);
+BENCHMARK(CCheckQueueSpeedPrevectorJob4Threads);
+BENCHMARK(CCheckQueueSpeedPrevectorJob8Threads);
+BENCHMARK(CCheckQueueSpeedPrevectorJob16Threads);
+BENCHMARK(CCheckQueueSpeedPrevectorJob32Threads);
+BENCHMARK(CCheckQueueSpeedPrevectorJob64Threads);
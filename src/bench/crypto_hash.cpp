@@ -90,6 +90,34 @@ static void SipHash_32b(benchmark::Bench& bench)
     });
 }
 
+static void SipHash_32b_Batch(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> vals(BUFFER_SIZE / 32);
+    for (uint256& val : vals) val = rng.rand256();
+    std::vector<uint64_t> out(vals.size());
+    uint64_t k1 = 0;
+    bench.batch(vals.size()).unit("hash").run([&] {
+        SipHashUint256Batch(0, ++k1, vals.data(), out.data(), vals.size());
+    });
+}
+
+static void SipHash_32b_Extra_Batch(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> vals(BUFFER_SIZE / 32);
+    std::vector<uint32_t> extras(vals.size());
+    for (size_t i = 0; i < vals.size(); ++i) {
+        vals[i] = rng.rand256();
+        extras[i] = rng.rand32();
+    }
+    std::vector<uint64_t> out(vals.size());
+    uint64_t k1 = 0;
+    bench.batch(vals.size()).unit("hash").run([&] {
+        SipHashUint256ExtraBatch(0, ++k1, vals.data(), extras.data(), out.data(), vals.size());
+    });
+}
+
 static void FastRandom_32bit(benchmark::Bench& bench)
 {
     FastRandomContext rng(true);
@@ -162,6 +190,8 @@ BENCHMARK(SHA3_256_1M);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(SipHash_32b_Batch);
+BENCHMARK(SipHash_32b_Extra_Batch);
 BENCHMARK(SHA256D64_1024);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
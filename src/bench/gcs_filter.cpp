@@ -4,6 +4,21 @@
 
 #include <bench/bench.h>
 #include <blockfilter.h>
+#include <random.h>
+
+//! Number of outputs and spent scripts in a typical mainnet block filter
+static constexpr int BLOCK_FILTER_ELEMENTS = 5000;
+
+// Generate n distinct random scripts with the lengths of common output types.
+static GCSFilter::ElementSet RandomScripts(FastRandomContext& rng, int n)
+{
+    static constexpr size_t SCRIPT_SIZES[] = {22, 23, 25, 34};
+    GCSFilter::ElementSet elements;
+    while (elements.size() < static_cast<size_t>(n)) {
+        elements.insert(rng.randbytes(SCRIPT_SIZES[rng.randrange(std::size(SCRIPT_SIZES))]));
+    }
+    return elements;
+}
 
 static void ConstructGCSFilter(benchmark::Bench& bench)
 {
@@ -39,5 +54,46 @@ static void MatchGCSFilter(benchmark::Bench& bench)
     });
 }
 
+/** Build a filter with the parameters and element sizes of a basic block filter. */
+static void ConstructBasicGCSFilter(benchmark::Bench& bench)
+{
+    FastRandomContext rng(/* fDeterministic */ true);
+    const GCSFilter::ElementSet elements = RandomScripts(rng, BLOCK_FILTER_ELEMENTS);
+
+    uint64_t siphash_k0 = 0;
+    bench.batch(elements.size()).unit("elem").run([&] {
+        GCSFilter filter({siphash_k0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, elements);
+
+        siphash_k0++;
+    });
+}
+
+/** Reconstruct a basic block filter from its encoding, as when it is read from disk. */
+static void DecodeBasicGCSFilter(benchmark::Bench& bench)
+{
+    FastRandomContext rng(/* fDeterministic */ true);
+    const GCSFilter filter({0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, RandomScripts(rng, BLOCK_FILTER_ELEMENTS));
+
+    bench.batch(filter.GetN()).unit("elem").run([&] {
+        GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+        ankerl::nanobench::doNotOptimizeAway(decoded);
+    });
+}
+
+/** Check a wallet's scripts against a basic block filter they don't match, as in a rescan. */
+static void MatchAnyBasicGCSFilter(benchmark::Bench& bench)
+{
+    FastRandomContext rng(/* fDeterministic */ true);
+    const GCSFilter filter({0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, RandomScripts(rng, BLOCK_FILTER_ELEMENTS));
+    const GCSFilter::ElementSet wallet_scripts = RandomScripts(rng, 1000);
+
+    bench.batch(filter.GetN()).unit("elem").run([&] {
+        ankerl::nanobench::doNotOptimizeAway(filter.MatchAny(wallet_scripts));
+    });
+}
+
 BENCHMARK(ConstructGCSFilter);
 BENCHMARK(MatchGCSFilter);
+BENCHMARK(ConstructBasicGCSFilter);
+BENCHMARK(DecodeBasicGCSFilter);
+BENCHMARK(MatchAnyBasicGCSFilter);
@@ -0,0 +1,104 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <index/blockfilterindex.h>
+#include <index/txindex.h>
+#include <script/standard.h>
+#include <test/util/script.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <functional>
+#include <vector>
+
+static constexpr int INDEX_SYNC_BLOCKS = 20;
+static constexpr int INDEX_SYNC_TXS_PER_BLOCK = 20;
+static constexpr int INDEX_SYNC_OUTPUTS_PER_TX = 25;
+
+// Extend the 100 block test chain with blocks full of transactions, each of
+// which spends the change of the previous one and fans out to many outputs.
+static std::unique_ptr<TestChain100Setup> MakeIndexSyncChain()
+{
+    auto test_setup = std::make_unique<TestChain100Setup>();
+    const CScript coinbase_script{GetScriptForDestination(PKHash(test_setup->coinbaseKey.GetPubKey()))};
+    CMutableTransaction prev{test_setup->CreateValidMempoolTransaction(test_setup->m_coinbase_txns[0], 0, 1, test_setup->coinbaseKey, P2WSH_OP_TRUE, 49 * COIN, /* submit */ false)};
+    std::vector<CMutableTransaction> txs{prev};
+    CScriptWitness witness;
+    witness.stack.push_back(WITNESS_STACK_ELEM_OP_TRUE);
+    for (int b = 0; b < INDEX_SYNC_BLOCKS; ++b) {
+        for (int t = 0; t < INDEX_SYNC_TXS_PER_BLOCK; ++t) {
+            CMutableTransaction tx;
+            tx.vin.emplace_back(prev.GetHash(), 0);
+            tx.vin.back().scriptWitness = witness;
+            const CAmount change{prev.vout[0].nValue - INDEX_SYNC_OUTPUTS_PER_TX * 1000 - 10000};
+            tx.vout.emplace_back(change, P2WSH_OP_TRUE);
+            for (int o = 0; o < INDEX_SYNC_OUTPUTS_PER_TX; ++o) {
+                tx.vout.emplace_back(1000, P2WSH_OP_TRUE);
+            }
+            txs.push_back(tx);
+            prev = tx;
+        }
+        test_setup->CreateAndProcessBlock(txs, coinbase_script);
+        txs.clear();
+    }
+    return test_setup;
+}
+
+template <typename Index>
+static void SyncIndex(benchmark::Bench& bench, int sync_threads, const std::function<std::unique_ptr<Index>()>& make_index)
+{
+    const auto test_setup = MakeIndexSyncChain();
+    CChainState& chainstate = test_setup->m_node.chainman->ActiveChainstate();
+    bench.run([&] {
+        auto index = make_index();
+        assert(index->Start(chainstate, sync_threads));
+        while (!index->GetSummary().synced) {
+            UninterruptibleSleep(std::chrono::milliseconds{1});
+        }
+        index->Stop();
+    });
+}
+
+static int ParallelSyncThreads()
+{
+    return std::clamp(GetNumCores(), 2, MAX_INDEX_THREADS);
+}
+
+static std::unique_ptr<BlockFilterIndex> MakeBlockFilterIndex()
+{
+    return std::make_unique<BlockFilterIndex>(BlockFilterType::BASIC, 1 << 20, /* f_memory */ true);
+}
+
+static std::unique_ptr<TxIndex> MakeTxIndex()
+{
+    return std::make_unique<TxIndex>(1 << 20, /* f_memory */ true);
+}
+
+static void BlockFilterIndexSync(benchmark::Bench& bench)
+{
+    SyncIndex<BlockFilterIndex>(bench, 1, MakeBlockFilterIndex);
+}
+
+static void BlockFilterIndexSyncParallel(benchmark::Bench& bench)
+{
+    SyncIndex<BlockFilterIndex>(bench, ParallelSyncThreads(), MakeBlockFilterIndex);
+}
+
+static void TxIndexSync(benchmark::Bench& bench)
+{
+    SyncIndex<TxIndex>(bench, 1, MakeTxIndex);
+}
+
+static void TxIndexSyncParallel(benchmark::Bench& bench)
+{
+    SyncIndex<TxIndex>(bench, ParallelSyncThreads(), MakeTxIndex);
+}
+
+BENCHMARK(BlockFilterIndexSync);
+BENCHMARK(BlockFilterIndexSyncParallel);
+BENCHMARK(TxIndexSync);
+BENCHMARK(TxIndexSyncParallel);
@@ -132,4 +132,64 @@ static void MempoolEviction(benchmark::Bench& bench)
     });
 }
 
+// Sustained spam against a full mempool: every new package outbids the
+// lowest-feerate package, which TrimToSize then evicts.
+static void MempoolEvictionSpam(benchmark::Bench& bench)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+
+    // Packages of a parent and three descendants, in the shapes of a chain
+    // and of a parent with three children. Twice as many packages as the
+    // mempool holds, so that each package is re-added long after its eviction.
+    // The parents of the latter spend a high-feerate transaction which stays
+    // in the mempool, so that their eviction updates an ancestor.
+    constexpr size_t NUM_PACKAGES{2000};
+    constexpr size_t PACKAGE_SIZE{4};
+    CMutableTransaction hub;
+    hub.vin.resize(1);
+    hub.vout.assign(2 * NUM_PACKAGES, CTxOut(COIN, CScript() << OP_1));
+    const CTransactionRef hub_r{MakeTransactionRef(hub)};
+    std::vector<std::vector<CTransactionRef>> packages;
+    for (size_t p = 0; p < 2 * NUM_PACKAGES; ++p) {
+        const bool chain = p % 2 == 0;
+        std::vector<CTransactionRef> package;
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        if (chain) {
+            parent.vin[0].scriptSig = CScript() << p;
+        } else {
+            parent.vin[0].prevout = COutPoint(hub_r->GetHash(), p);
+        }
+        parent.vout.assign(PACKAGE_SIZE - 1, CTxOut(COIN, CScript() << OP_1));
+        package.push_back(MakeTransactionRef(parent));
+        for (size_t c = 1; c < PACKAGE_SIZE; ++c) {
+            CMutableTransaction child;
+            child.vin.emplace_back(package[chain ? c - 1 : 0]->GetHash(), chain ? 0 : c - 1);
+            child.vout.assign(PACKAGE_SIZE - 1, CTxOut(COIN, CScript() << OP_1));
+            package.push_back(MakeTransactionRef(child));
+        }
+        packages.push_back(std::move(package));
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    AddTx(hub_r, COIN, pool);
+    CAmount fee{1000};
+    for (size_t p = 0; p < NUM_PACKAGES; ++p) {
+        for (const CTransactionRef& tx : packages[p]) AddTx(tx, ++fee, pool);
+    }
+    const size_t limit{pool.DynamicMemoryUsage()};
+
+    size_t next{NUM_PACKAGES};
+    std::vector<COutPoint> no_spends_remaining;
+    bench.minEpochIterations(1000).batch(PACKAGE_SIZE).unit("tx").run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (const CTransactionRef& tx : packages[next]) AddTx(tx, ++fee, pool);
+        // As done by LimitMempoolSize on every accepted transaction
+        no_spends_remaining.clear();
+        pool.TrimToSize(limit, &no_spends_remaining);
+        next = (next + 1) % packages.size();
+    });
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionSpam);
@@ -0,0 +1,101 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <vector>
+
+static const uint32_t PERSIST_CHILDREN_PER_PARENT = 20;
+static const CAmount PERSIST_FEE = 10000;
+
+static CTransactionRef SignSpend(const CKey& key, const CScript& script_pubkey, const COutPoint& prevout, CAmount value, uint32_t num_outputs)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.assign(num_outputs, CTxOut((value - PERSIST_FEE) / num_outputs, script_pubkey));
+    const uint256 hash = SignatureHash(script_pubkey, tx, 0, SIGHASH_ALL, value, SigVersion::BASE);
+    std::vector<unsigned char> sig;
+    bool ret = key.Sign(hash, sig);
+    assert(ret);
+    sig.push_back(SIGHASH_ALL);
+    tx.vin[0].scriptSig = CScript() << sig;
+    return MakeTransactionRef(tx);
+}
+
+// Fill the mempool with signed transactions: for each mature coinbase, a
+// parent and PERSIST_CHILDREN_PER_PARENT children spending it.
+static void FillMempoolSigned(const TestingSetup& test_setup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script_pubkey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    constexpr size_t NUM_BLOCKS{140};
+    std::vector<COutPoint> coinbases;
+    for (size_t b{0}; b < NUM_BLOCKS; ++b) {
+        const COutPoint coinbase = MineBlock(test_setup.m_node, script_pubkey).prevout;
+        if (NUM_BLOCKS - b >= COINBASE_MATURITY) coinbases.push_back(coinbase);
+    }
+
+    LOCK(::cs_main);
+    CChainState& chainstate = test_setup.m_node.chainman->ActiveChainstate();
+    const auto accept = [&](const CTransactionRef& tx) {
+        const MempoolAcceptResult res = ::AcceptToMemoryPool(chainstate, *test_setup.m_node.mempool, tx, false /* bypass_limits */);
+        assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
+    };
+    for (const COutPoint& coinbase : coinbases) {
+        const CAmount value = chainstate.CoinsTip().AccessCoin(coinbase).out.nValue;
+        const CTransactionRef parent = SignSpend(key, script_pubkey, coinbase, value, PERSIST_CHILDREN_PER_PARENT);
+        accept(parent);
+        for (uint32_t i = 0; i < PERSIST_CHILDREN_PER_PARENT; ++i) {
+            accept(SignSpend(key, script_pubkey, COutPoint(parent->GetHash(), i), parent->vout[i].nValue, 1));
+        }
+    }
+}
+
+// Restart-to-ready time of the mempool: every iteration starts from an empty
+// mempool and signature cache and loads mempool.dat. Without a checkpoint,
+// as after a legacy dump or a tip change, every script is checked again.
+static void LoadMempoolFromDisk(benchmark::Bench& bench, bool checkpoint)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    CTxMemPool& pool = *test_setup->m_node.mempool;
+    CChainState& chainstate = test_setup->m_node.chainman->ActiveChainstate();
+    FillMempoolSigned(*test_setup);
+    const size_t num_txs = pool.size();
+
+    gArgs.ForceSetArg("-persistmempoolv1", checkpoint ? "0" : "1");
+    bool dumped = DumpMempool(pool, chainstate, fsbridge::fopen, /* skip_file_commit */ true);
+    assert(dumped);
+
+    bench.minEpochIterations(10).batch(num_txs).unit("tx").run([&] {
+        pool.clear();
+        InitSignatureCache();
+        bool loaded = LoadMempool(pool, chainstate);
+        assert(loaded);
+        assert(pool.size() == num_txs);
+    });
+}
+
+static void MempoolLoadChecked(benchmark::Bench& bench)
+{
+    LoadMempoolFromDisk(bench, /* checkpoint */ false);
+}
+
+static void MempoolLoadCheckpoint(benchmark::Bench& bench)
+{
+    LoadMempoolFromDisk(bench, /* checkpoint */ true);
+}
+
+BENCHMARK(MempoolLoadChecked);
+BENCHMARK(MempoolLoadCheckpoint);
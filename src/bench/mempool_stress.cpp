@@ -91,4 +91,64 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+static CTransactionRef MakeChildTx(const std::vector<COutPoint>& prevouts, size_t n_outputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.resize(n_outputs);
+    for (auto& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_TRUE;
+        out.nValue = COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+// Add txs to the mempool in order, as done when accepting them, then remove
+// them in order as if they were mined, as done when connecting a block. Both
+// walk all in-mempool ancestors or descendants of every tx.
+static void MempoolAddRemove(benchmark::Bench& bench, const std::vector<CTransactionRef>& txs)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.batch(txs.size()).unit("tx").run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (const auto& tx : txs) {
+            AddTx(tx, pool);
+        }
+        pool.removeForBlock(txs, 1);
+        assert(pool.size() == 0);
+    });
+}
+
+// A single chain of txs, each spending the previous one: every tx has all
+// earlier txs as ancestors and all later ones as descendants.
+static void MempoolDeepChain(benchmark::Bench& bench)
+{
+    std::vector<CTransactionRef> txs{MakeChildTx({COutPoint(uint256::ONE, 0)}, 1)};
+    while (txs.size() < 500) {
+        txs.push_back(MakeChildTx({COutPoint(txs.back()->GetHash(), 0)}, 1));
+    }
+    MempoolAddRemove(bench, txs);
+}
+
+// A root tx with many children, which are all spent by a single tx: the
+// walks from the root and to the last tx cover the whole package, and reach
+// the same txs many times over.
+static void MempoolWidePackage(benchmark::Bench& bench)
+{
+    const size_t n_children = 500;
+    std::vector<CTransactionRef> txs{MakeChildTx({COutPoint(uint256::ONE, 0)}, n_children)};
+    std::vector<COutPoint> children_outputs;
+    for (size_t i = 0; i < n_children; ++i) {
+        txs.push_back(MakeChildTx({COutPoint(txs.front()->GetHash(), i)}, 1));
+        children_outputs.emplace_back(txs.back()->GetHash(), 0);
+    }
+    txs.push_back(MakeChildTx(children_outputs, 1));
+    MempoolAddRemove(bench, txs);
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolDeepChain);
+BENCHMARK(MempoolWidePackage);
@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <net.h>
+#include <net_processing.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <version.h>
+
+#include <cassert>
+#include <vector>
+
+// Microbenchmark for the message handler: every one of num_peers connected
+// peers has a ping queued, and one round of the message handler processes all
+// of them and sends the pongs. The pings of different peers are independent,
+// so with worker threads they are processed concurrently.
+static void HandleMessagesPeers(benchmark::Bench& bench, int num_peers, int num_threads)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+    const NodeContext& node = testing_setup->m_node;
+    ConnmanTestMsg connman{0x1337, 0x1337, *node.addrman};
+    const auto peerman = PeerManager::make(Params(), connman, *node.addrman, /* banman */ nullptr,
+                                           *node.chainman, *node.mempool, /* ignore_incoming_txs */ false);
+    CConnman::Options options;
+    options.m_msgproc = peerman.get();
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    connman.Init(options);
+
+    std::vector<CNode*> peers;
+    for (int i = 0; i < num_peers; ++i) {
+        const CAddress addr{CService{CNetAddr{}, 8333}, NODE_NONE};
+        CNode* peer = new CNode{/* id */ i, ServiceFlags(NODE_NETWORK | NODE_WITNESS), INVALID_SOCKET, addr, /* nKeyedNetGroupIn */ 0,
+                                /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "", ConnectionType::INBOUND,
+                                /* inbound_onion */ false};
+        peerman->InitializeNode(peer);
+        peer->nVersion = PROTOCOL_VERSION;
+        peer->SetCommonVersion(PROTOCOL_VERSION);
+        peer->fSuccessfullyConnected = true;
+        connman.AddTestNode(*peer);
+        peers.push_back(peer);
+    }
+    if (num_threads > 1) connman.StartTestMessageHandlerWorkers(num_threads - 1);
+
+    uint64_t nonce{0};
+    bench.batch(num_peers).unit("message").run([&] {
+        for (CNode* peer : peers) {
+            CSerializedNetMsg msg{CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, ++nonce)};
+            bool complete = connman.ReceiveMsgFrom(*peer, msg);
+            assert(complete);
+        }
+        connman.HandleMessagesOnce(peers);
+        for (CNode* peer : peers) {
+            // Drop the responses, there is no socket to send them to.
+            LOCK(peer->cs_vSend);
+            peer->vSendMsg.clear();
+            peer->nSendSize = 0;
+            peer->nSendOffset = 0;
+            peer->fPauseSend = false;
+        }
+    });
+
+    connman.StopTestMessageHandlerWorkers();
+    for (CNode* peer : peers) {
+        peerman->FinalizeNode(*peer);
+    }
+    connman.ClearTestNodes();
+}
+
+static void HandleMessagesSerial10Peers(benchmark::Bench& bench)
+{
+    HandleMessagesPeers(bench, 10, 1);
+}
+
+static void HandleMessagesSerial100Peers(benchmark::Bench& bench)
+{
+    HandleMessagesPeers(bench, 100, 1);
+}
+
+static void HandleMessagesSerial1000Peers(benchmark::Bench& bench)
+{
+    HandleMessagesPeers(bench, 1000, 1);
+}
+
+static void HandleMessagesParallel10Peers(benchmark::Bench& bench)
+{
+    if (GetNumCores() <= 1) return;
+    HandleMessagesPeers(bench, 10, GetNumCores());
+}
+
+static void HandleMessagesParallel100Peers(benchmark::Bench& bench)
+{
+    if (GetNumCores() <= 1) return;
+    HandleMessagesPeers(bench, 100, GetNumCores());
+}
+
+static void HandleMessagesParallel1000Peers(benchmark::Bench& bench)
+{
+    if (GetNumCores() <= 1) return;
+    HandleMessagesPeers(bench, 1000, GetNumCores());
+}
+
+BENCHMARK(HandleMessagesSerial10Peers);
+BENCHMARK(HandleMessagesSerial100Peers);
+BENCHMARK(HandleMessagesSerial1000Peers);
+BENCHMARK(HandleMessagesParallel10Peers);
+BENCHMARK(HandleMessagesParallel100Peers);
+BENCHMARK(HandleMessagesParallel1000Peers);
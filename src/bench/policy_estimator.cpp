@@ -0,0 +1,62 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <vector>
+
+// Give the estimator a history of blocks in which the highest feerate txs
+// confirm in the next block, lower ones in two and the lowest never.
+static void FillEstimator(CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0;
+    std::vector<CTransactionRef> delayed;
+    for (int blocknum = 0; blocknum < 1200; ++blocknum) {
+        std::vector<CTransactionRef> block;
+        block.swap(delayed);
+        for (int j = 0; j < 40; ++j) {
+            tx.vin[0].prevout.n = 100 * blocknum + j;
+            const CTransactionRef ptx = MakeTransactionRef(tx);
+            pool.addUnchecked(entry.Fee(1000 * (j + 1)).Height(blocknum).FromTx(ptx));
+            if (j < 5) continue;
+            if (j < 20) {
+                delayed.push_back(ptx);
+            } else {
+                block.push_back(ptx);
+            }
+        }
+        pool.removeForBlock(block, blocknum + 1);
+    }
+}
+
+// Wallets ask for a quote at one of a handful of targets many times between
+// blocks.
+static void EstimateSmartFee(benchmark::Bench& bench)
+{
+    const auto testing_setup = MakeNoLogFileContext<>();
+    CBlockPolicyEstimator fee_estimator;
+    CTxMemPool pool(&fee_estimator);
+    {
+        LOCK2(cs_main, pool.cs);
+        FillEstimator(pool);
+    }
+
+    const std::vector<int> targets{2, 3, 6, 12, 24, 144, 504, 1008};
+    size_t i = 0;
+    bench.minEpochIterations(1000).run([&] {
+        FeeCalculation fee_calc;
+        const CFeeRate feerate = fee_estimator.estimateSmartFee(targets[i % targets.size()], &fee_calc, i % 2);
+        assert(feerate > CFeeRate(0));
+        ++i;
+    });
+}
+
+BENCHMARK(EstimateSmartFee);
@@ -0,0 +1,79 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <vector>
+
+static const size_t PREFETCH_TXS = 1000;
+static const size_t PREFETCH_INPUTS_PER_TX = 2;
+
+// Build a database holding the coins spent by a synthetic block, so that
+// every input of the block is a cache miss.
+static CBlock SetupPrefetchBlock(CCoinsViewDB& db)
+{
+    FastRandomContext rand(true);
+    CCoinsViewCache cache(&db);
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < PREFETCH_TXS; ++i) {
+        CMutableTransaction tx;
+        for (size_t j = 0; j < PREFETCH_INPUTS_PER_TX; ++j) {
+            const COutPoint prevout(rand.rand256(), j);
+            CTxOut txout(1000, CScript() << OP_TRUE);
+            cache.AddCoin(prevout, Coin(txout, 1, false), false);
+            tx.vin.emplace_back(prevout);
+        }
+        // Also spend an output created earlier in the block, which must
+        // not be looked up.
+        if (i > 0) tx.vin.emplace_back(block.vtx.back()->GetHash(), 0);
+        tx.vout.emplace_back(1000, CScript() << OP_TRUE);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    cache.SetBestBlock(rand.rand256());
+    bool flushed = cache.Flush();
+    assert(flushed);
+    return block;
+}
+
+static void PrefetchInputs(benchmark::Bench& bench, CCheckQueue<CCoinPrefetch>* queue)
+{
+    CCoinsViewDB db("", 8 << 20, true, true);
+    const CBlock block = SetupPrefetchBlock(db);
+
+    bench.batch(PREFETCH_TXS * PREFETCH_INPUTS_PER_TX).unit("input").run([&] {
+        CCoinsViewCache cache(&db);
+        size_t fetched = PrefetchBlockInputs(block, cache, db, queue);
+        assert(fetched == PREFETCH_TXS * PREFETCH_INPUTS_PER_TX);
+    });
+}
+
+static void PrefetchInputsSerial(benchmark::Bench& bench)
+{
+    PrefetchInputs(bench, nullptr);
+}
+
+static void PrefetchInputsParallel(benchmark::Bench& bench)
+{
+    // Parallel prefetching is only enabled alongside parallel script checks.
+    if (GetNumCores() <= 1) return;
+
+    CCheckQueue<CCoinPrefetch> queue{16};
+    queue.StartWorkerThreads(GetNumCores() - 1);
+    PrefetchInputs(bench, &queue);
+    queue.StopWorkerThreads();
+}
+
+BENCHMARK(PrefetchInputsSerial);
+BENCHMARK(PrefetchInputsParallel);
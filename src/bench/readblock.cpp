@@ -0,0 +1,82 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chainparams.h>
+#include <flatfile.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+// Microbenchmarks for reading a block back from the block files, through
+// stdio or through memory mappings of the files (-mmapblocks).
+
+static FlatFilePos WriteTestBlock(const TestingSetup& setup)
+{
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    LOCK(cs_main);
+    const FlatFilePos pos{SaveBlockToDisk(block, 413567, setup.m_node.chainman->ActiveChain(), Params(), nullptr)};
+    assert(!pos.IsNull());
+    return pos;
+}
+
+static void ReadBlockFromDiskTest(benchmark::Bench& bench, bool mmap)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    const FlatFilePos pos{WriteTestBlock(*testing_setup)};
+    g_mmap_blocks = mmap;
+
+    bench.unit("block").run([&] {
+        CBlock block;
+        bool read = ReadBlockFromDisk(block, pos, Params().GetConsensus());
+        assert(read);
+    });
+    g_mmap_blocks = DEFAULT_MMAP_BLOCKS;
+}
+
+static void ReadRawBlockFromDiskTest(benchmark::Bench& bench, bool mmap)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    const FlatFilePos pos{WriteTestBlock(*testing_setup)};
+    g_mmap_blocks = mmap;
+
+    bench.unit("block").run([&] {
+        std::vector<uint8_t> block;
+        bool read = ReadRawBlockFromDisk(block, pos, Params().MessageStart());
+        assert(read);
+    });
+    g_mmap_blocks = DEFAULT_MMAP_BLOCKS;
+}
+
+static void ReadBlockFromDiskStdio(benchmark::Bench& bench) { ReadBlockFromDiskTest(bench, false); }
+static void ReadBlockFromDiskMmap(benchmark::Bench& bench) { ReadBlockFromDiskTest(bench, true); }
+static void ReadRawBlockFromDiskStdio(benchmark::Bench& bench) { ReadRawBlockFromDiskTest(bench, false); }
+static void ReadRawBlockFromDiskMmap(benchmark::Bench& bench) { ReadRawBlockFromDiskTest(bench, true); }
+
+static void ReadRawBlockFromDiskZeroCopy(benchmark::Bench& bench)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    const FlatFilePos pos{WriteTestBlock(*testing_setup)};
+    g_mmap_blocks = true;
+
+    bench.unit("block").run([&] {
+        std::shared_ptr<const MappedFlatFile> map;
+        Span<const uint8_t> block;
+        bool read = ReadRawBlockFromDisk(block, map, pos, Params().MessageStart());
+        assert(read);
+    });
+    g_mmap_blocks = DEFAULT_MMAP_BLOCKS;
+}
+
+BENCHMARK(ReadBlockFromDiskStdio);
+BENCHMARK(ReadBlockFromDiskMmap);
+BENCHMARK(ReadRawBlockFromDiskStdio);
+BENCHMARK(ReadRawBlockFromDiskMmap);
+BENCHMARK(ReadRawBlockFromDiskZeroCopy);
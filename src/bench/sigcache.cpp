@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <key.h>
+#include <primitives/transaction.h>
+#include <pubkey.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <vector>
+
+static const size_t SIGCACHE_INPUTS = 1000;
+
+// Microbenchmark for block script validation with a hot signature cache: the
+// signatures of a transaction spending SIGCACHE_INPUTS taproot outputs
+// through the key path are cached as on mempool acceptance, and then the
+// inputs are checked on a script check queue with threads_num threads, as
+// done by ConnectBlock. Every check is a cache hit that erases the entry.
+static void SigCacheHitCheckQueueThreads(benchmark::Bench& bench, int threads_num)
+{
+    if (threads_num > GetNumCores()) return;
+
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>();
+    const uint32_t flags{SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_TAPROOT};
+
+    CKey key;
+    key.MakeNewKey(true);
+    const XOnlyPubKey output_key{XOnlyPubKey(key.GetPubKey()).CreateTapTweak(nullptr)->first};
+    const CScript script_pubkey = CScript() << OP_1 << ToByteVector(output_key);
+
+    CMutableTransaction tx_credit;
+    tx_credit.vout.assign(SIGCACHE_INPUTS, CTxOut(1000, script_pubkey));
+    CMutableTransaction tx_spend;
+    for (size_t i = 0; i < SIGCACHE_INPUTS; ++i) {
+        tx_spend.vin.emplace_back(COutPoint(tx_credit.GetHash(), i));
+    }
+    tx_spend.vout.emplace_back(1000 * SIGCACHE_INPUTS, CScript() << OP_TRUE);
+
+    PrecomputedTransactionData sign_txdata;
+    sign_txdata.Init(tx_spend, std::vector<CTxOut>(tx_credit.vout), /* force */ true);
+    ScriptExecutionData execdata;
+    execdata.m_annex_init = true;
+    execdata.m_annex_present = false;
+    const uint256 merkle_root;
+    for (size_t i = 0; i < SIGCACHE_INPUTS; ++i) {
+        uint256 sighash;
+        bool ret = SignatureHashSchnorr(sighash, execdata, tx_spend, i, SIGHASH_DEFAULT, SigVersion::TAPROOT, sign_txdata, MissingDataBehavior::FAIL);
+        assert(ret);
+        std::vector<unsigned char> sig(64);
+        ret = key.SignSchnorr(sighash, sig, &merkle_root, nullptr);
+        assert(ret);
+        tx_spend.vin[i].scriptWitness.stack.push_back(std::move(sig));
+    }
+
+    const CTransaction tx{tx_spend};
+    PrecomputedTransactionData txdata;
+    txdata.Init(tx, std::vector<CTxOut>(tx_credit.vout));
+    for (size_t i = 0; i < SIGCACHE_INPUTS; ++i) {
+        bool ret = CScriptCheck(tx_credit.vout[i], tx, i, flags, /* cacheIn */ true, &txdata)();
+        assert(ret);
+    }
+
+    CCheckQueue<CScriptCheck> queue{128};
+    queue.StartWorkerThreads(threads_num - 1);
+    bench.batch(SIGCACHE_INPUTS).unit("input").run([&] {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        std::vector<CScriptCheck> checks;
+        checks.reserve(SIGCACHE_INPUTS);
+        for (size_t i = 0; i < SIGCACHE_INPUTS; ++i) {
+            checks.emplace_back(tx_credit.vout[i], tx, i, flags, /* cacheIn */ false, &txdata);
+        }
+        control.Add(checks);
+        bool ok = control.Wait();
+        assert(ok);
+    });
+    queue.StopWorkerThreads();
+}
+
+static void SigCacheHitCheckQueue1Thread(benchmark::Bench& bench)
+{
+    SigCacheHitCheckQueueThreads(bench, 1);
+}
+
+static void SigCacheHitCheckQueue2Threads(benchmark::Bench& bench)
+{
+    SigCacheHitCheckQueueThreads(bench, 2);
+}
+
+static void SigCacheHitCheckQueue4Threads(benchmark::Bench& bench)
+{
+    SigCacheHitCheckQueueThreads(bench, 4);
+}
+
+static void SigCacheHitCheckQueue8Threads(benchmark::Bench& bench)
+{
+    SigCacheHitCheckQueueThreads(bench, 8);
+}
+
+static void SigCacheHitCheckQueue16Threads(benchmark::Bench& bench)
+{
+    SigCacheHitCheckQueueThreads(bench, 16);
+}
+
+BENCHMARK(SigCacheHitCheckQueue1Thread);
+BENCHMARK(SigCacheHitCheckQueue2Threads);
+BENCHMARK(SigCacheHitCheckQueue4Threads);
+BENCHMARK(SigCacheHitCheckQueue8Threads);
+BENCHMARK(SigCacheHitCheckQueue16Threads);
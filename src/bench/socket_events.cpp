@@ -0,0 +1,123 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrman.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <compat.h>
+#include <net.h>
+#include <protocol.h>
+#include <streams.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include <cassert>
+#include <set>
+#include <vector>
+
+// Microbenchmark for one pass of the socket handler over num_peers
+// connections, of which only one has received data: waiting for events,
+// reading the data and checking the nodes. Each connection is a socketpair,
+// with the node holding one end and the bench the other.
+static void SocketEventsPeers(benchmark::Bench& bench, size_t num_peers, bool use_epoll)
+{
+#ifdef USE_POLL
+#ifndef USE_EPOLL
+    if (use_epoll) return;
+#endif
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < 2 * num_peers + 64) return;
+
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>();
+    CAddrMan addrman(/* deterministic */ true, /* consistency_check_ratio */ 0);
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    connman.Init(CConnman::Options{});
+    if (use_epoll) connman.InitTestSocketEvents();
+
+    std::vector<SOCKET> local_sockets;
+    std::vector<SOCKET> remote_sockets;
+    for (size_t i = 0; i < num_peers; ++i) {
+        int sockets[2];
+        int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+        assert(ret == 0);
+        local_sockets.push_back(sockets[0]);
+        remote_sockets.push_back(sockets[1]);
+        CNode* node = new CNode{/* id */ (NodeId)i, NODE_NETWORK, local_sockets.back(), CAddress(), /* nKeyedNetGroupIn */ 0,
+                                /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "", ConnectionType::INBOUND,
+                                /* inbound_onion */ false};
+        connman.AddTestNodeWithSocket(*node);
+    }
+
+    // Consume the initial events reported for the new sockets.
+    std::set<SOCKET> recv_set, send_set, error_set;
+    do {
+        recv_set.clear();
+        send_set.clear();
+        error_set.clear();
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+    } while (use_epoll && !send_set.empty());
+
+    // An empty message with a bad checksum: it is read and dropped, without
+    // being queued for processing or causing a disconnect.
+    std::vector<uint8_t> msg;
+    CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, msg, 0, CMessageHeader{Params().MessageStart(), NetMsgType::PING, 0}};
+
+    size_t active = 0;
+    bench.unit("pass").minEpochIterations(20).run([&] {
+        ssize_t ret = send(remote_sockets[active], msg.data(), msg.size(), 0);
+        assert(ret == (ssize_t)msg.size());
+        const uint64_t recv_before{connman.GetTotalBytesRecv()};
+        connman.SocketHandlerOnce();
+        assert(connman.GetTotalBytesRecv() == recv_before + msg.size());
+        active = (active + 1) % num_peers;
+    });
+
+    connman.ClearTestNodes();
+    connman.CloseTestSocketEvents();
+    for (SOCKET socket : remote_sockets) {
+        CloseSocket(socket);
+    }
+#endif
+}
+
+static void SocketEventsPoll100Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 100, false);
+}
+
+static void SocketEventsPoll1000Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 1000, false);
+}
+
+static void SocketEventsPoll5000Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 5000, false);
+}
+
+static void SocketEventsEpoll100Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 100, true);
+}
+
+static void SocketEventsEpoll1000Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 1000, true);
+}
+
+static void SocketEventsEpoll5000Peers(benchmark::Bench& bench)
+{
+    SocketEventsPeers(bench, 5000, true);
+}
+
+BENCHMARK(SocketEventsPoll100Peers);
+BENCHMARK(SocketEventsPoll1000Peers);
+BENCHMARK(SocketEventsPoll5000Peers);
+BENCHMARK(SocketEventsEpoll100Peers);
+BENCHMARK(SocketEventsEpoll1000Peers);
+BENCHMARK(SocketEventsEpoll5000Peers);
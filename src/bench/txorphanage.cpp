@@ -0,0 +1,79 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net_processing.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <script/script.h>
+#include <txorphanage.h>
+
+#include <set>
+#include <vector>
+
+static constexpr size_t ORPHAN_CHURN_PARENTS = 200;
+static constexpr size_t ORPHAN_CHURN_CHILDREN = 1000;
+static constexpr NodeId ORPHAN_CHURN_PEERS = 8;
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& prevouts, uint32_t num_outputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.assign(num_outputs, CTxOut(1000, CScript() << OP_TRUE));
+    return MakeTransactionRef(tx);
+}
+
+// A full orphanage's worth of children arrives from several peers before
+// their parents, which then arrive one by one and resolve their children.
+// The last few parents are mined rather than relayed.
+static void OrphanageChurn(benchmark::Bench& bench)
+{
+    FastRandomContext det_rand{true};
+    std::vector<CTransactionRef> parents;
+    for (size_t i = 0; i < ORPHAN_CHURN_PARENTS; ++i) {
+        parents.push_back(MakeTx({COutPoint(det_rand.rand256(), 0)}, 10));
+    }
+    std::vector<CTransactionRef> children;
+    for (size_t i = 0; i < ORPHAN_CHURN_CHILDREN; ++i) {
+        std::vector<COutPoint> prevouts;
+        const size_t num_inputs = 1 + det_rand.randrange(3);
+        for (size_t j = 0; j < num_inputs; ++j) {
+            prevouts.emplace_back(parents[det_rand.randrange(parents.size())]->GetHash(), det_rand.randrange(10));
+        }
+        children.push_back(MakeTx(prevouts, 1));
+    }
+    CBlock block;
+    block.vtx.assign(parents.end() - ORPHAN_CHURN_PARENTS / 10, parents.end());
+
+    TxOrphanage orphanage;
+    bench.minEpochIterations(10).batch(children.size()).unit("orphan").run([&] {
+        {
+            LOCK(g_cs_orphans);
+            for (size_t i = 0; i < children.size(); ++i) {
+                orphanage.AddTx(children[i], i % ORPHAN_CHURN_PEERS);
+                orphanage.LimitOrphans(DEFAULT_MAX_ORPHAN_TRANSACTIONS, DEFAULT_MAX_ORPHAN_SIZE * 1000000);
+            }
+            for (size_t i = 0; i + block.vtx.size() < parents.size(); ++i) {
+                std::set<uint256> work_set;
+                orphanage.AddChildrenToWorkSet(*parents[i], work_set);
+                for (const uint256& txid : work_set) {
+                    orphanage.EraseTx(txid);
+                }
+            }
+        }
+        orphanage.EraseForBlock(block);
+        {
+            LOCK(g_cs_orphans);
+            for (NodeId peer = 0; peer < ORPHAN_CHURN_PEERS; ++peer) {
+                orphanage.EraseForPeer(peer);
+            }
+        }
+        assert(orphanage.Size() == 0);
+    });
+}
+
+BENCHMARK(OrphanageChurn);
@@ -14,7 +14,8 @@
 #include <validation.h>
 #include <util/system.h>
 
-#include <unordered_map>
+#include <algorithm>
+#include <limits>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
@@ -44,7 +45,80 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* txhashes, uint64_t* out, size_t count) const {
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, out, count);
+    for (size_t i = 0; i < count; i++) {
+        out[i] &= 0xffffffffffffL;
+    }
+}
+
+namespace {
+
+/**
+ * Flat open-addressing table from the short IDs of a compact block to the
+ * index of their transaction in the block.
+ *
+ * Short IDs are chosen by the peer that sent the block, so they are placed by
+ * a randomly keyed multiplicative hash, and a short ID that can't be placed
+ * within MAX_PROBES slots of its hash is refused rather than letting a peer
+ * make lookups arbitrarily slow.
+ */
+class ShortIdTable
+{
+    //! Short IDs have 48 bits, so this is never one
+    static constexpr uint64_t EMPTY_SLOT = std::numeric_limits<uint64_t>::max();
+
+    std::vector<uint64_t> m_shortids;
+    std::vector<uint16_t> m_indexes;
+    const uint64_t m_multiplier;
+    int m_shift;
+
+    size_t Slot(uint64_t shortid) const { return (shortid * m_multiplier) >> m_shift; }
+
+public:
+    //! At a load factor of at most 1/4, a run this long of occupied slots is
+    //! vanishingly unlikely for well-formed blocks.
+    static constexpr size_t MAX_PROBES = 64;
+
+    explicit ShortIdTable(size_t count) : m_multiplier(GetRand(std::numeric_limits<uint64_t>::max()) | 1)
+    {
+        int bits = 4;
+        while ((size_t{1} << bits) < 4 * count) ++bits;
+        m_shortids.assign(size_t{1} << bits, EMPTY_SLOT);
+        m_indexes.resize(m_shortids.size());
+        m_shift = 64 - bits;
+    }
+
+    /** Add a short ID. Returns false if it is already present or can't be placed. */
+    bool Insert(uint64_t shortid, uint16_t index)
+    {
+        const size_t mask = m_shortids.size() - 1;
+        size_t slot = Slot(shortid);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe, slot = (slot + 1) & mask) {
+            if (m_shortids[slot] == shortid) return false;
+            if (m_shortids[slot] == EMPTY_SLOT) {
+                m_shortids[slot] = shortid;
+                m_indexes[slot] = index;
+                return true;
+            }
+        }
+        return false;
+    }
 
+    /** Index of the transaction with a short ID, or -1 if it isn't in the block. */
+    int Find(uint64_t shortid) const
+    {
+        const size_t mask = m_shortids.size() - 1;
+        size_t slot = Slot(shortid);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe, slot = (slot + 1) & mask) {
+            if (m_shortids[slot] == shortid) return m_indexes[slot];
+            if (m_shortids[slot] == EMPTY_SLOT) return -1;
+        }
+        return -1;
+    }
+};
+
+} // namespace
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
     if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
@@ -78,47 +152,56 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
     // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    ShortIdTable shorttxids(cmpctblock.shorttxids.size());
     uint16_t index_offset = 0;
     for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
         while (txn_available[i + index_offset])
             index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
+        // TODO: in the shortid-collision case, we should instead request both transactions
+        // which collided. Falling back to full-block-request here is overkill.
+        if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
+            return READ_STATUS_FAILED; // Short ID collision, or too uneven a distribution
     }
-    // TODO: in the shortid-collision case, we should instead request both transactions
-    // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
-        return READ_STATUS_FAILED; // Short ID collision
 
-    std::vector<bool> have_txn(txn_available.size());
+    // Copy the mempool's witness hashes and match them against the block
+    // without holding the mempool lock, then only take it again to fetch the
+    // matched transactions.
+    std::vector<uint256> mempool_wtxids;
+    std::vector<CTxMemPool::txiter> mempool_iters;
+    unsigned int mempool_updates;
     {
-    LOCK(pool->cs);
-    for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = pool->vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+        LOCK(pool->cs);
+        mempool_wtxids.reserve(pool->vTxHashes.size());
+        mempool_iters.reserve(pool->vTxHashes.size());
+        for (const auto& [wtxid, it] : pool->vTxHashes) {
+            mempool_wtxids.push_back(wtxid);
+            mempool_iters.push_back(it);
+        }
+        mempool_updates = pool->GetTransactionsUpdated();
+    }
+
+    std::vector<bool> have_txn(txn_available.size());
+    // For each transaction in the block, the position in the copy of its one match
+    std::vector<int32_t> mempool_match(txn_available.size(), -1);
+    // Short IDs are computed a chunk at a time, which keeps the early exit below cheap
+    static constexpr size_t SHORTID_CHUNK = 256;
+    uint64_t chunk_shortids[SHORTID_CHUNK];
+    for (size_t i = 0; i < mempool_wtxids.size(); i++) {
+        if (i % SHORTID_CHUNK == 0) {
+            cmpctblock.GetShortIDs(&mempool_wtxids[i], chunk_shortids, std::min(SHORTID_CHUNK, mempool_wtxids.size() - i));
+        }
+        const int index = shorttxids.Find(chunk_shortids[i % SHORTID_CHUNK]);
+        if (index >= 0) {
+            if (!have_txn[index]) {
+                mempool_match[index] = i;
+                have_txn[index] = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (mempool_match[index] >= 0) {
+                    mempool_match[index] = -1;
                     mempool_count--;
                 }
             }
@@ -126,18 +209,32 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
-        if (mempool_count == shorttxids.size())
+        if (mempool_count == cmpctblock.shorttxids.size())
             break;
     }
+    if (mempool_count > 0) {
+        LOCK(pool->cs);
+        // If nothing was added or removed since the copy, its iterators are still valid
+        const bool mempool_unchanged = pool->GetTransactionsUpdated() == mempool_updates;
+        for (size_t i = 0; i < txn_available.size(); i++) {
+            if (mempool_match[i] < 0) continue;
+            const auto it = mempool_unchanged ? mempool_iters[mempool_match[i]] : pool->get_iter_from_wtxid(mempool_wtxids[mempool_match[i]]);
+            if (it != pool->mapTx.end()) {
+                txn_available[i] = it->GetSharedTx();
+            } else {
+                // Removed from the mempool since, maybe it's among extra_txn
+                have_txn[i] = false;
+                mempool_count--;
+            }
+        }
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = extra_txn[i].second;
-                have_txn[idit->second]  = true;
+        const int index = shorttxids.Find(cmpctblock.GetShortID(extra_txn[i].first));
+        if (index >= 0) {
+            if (!have_txn[index]) {
+                txn_available[index] = extra_txn[i].second;
+                have_txn[index]  = true;
                 mempool_count++;
                 extra_count++;
             } else {
@@ -147,9 +244,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 // Note that we don't want duplication between extra_txn and mempool to
                 // trigger this case, so we compare witness hashes first
-                if (txn_available[idit->second] &&
-                        txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
-                    txn_available[idit->second].reset();
+                if (txn_available[index] &&
+                        txn_available[index]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                    txn_available[index].reset();
                     mempool_count--;
                     extra_count--;
                 }
@@ -158,7 +255,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
-        if (mempool_count == shorttxids.size())
+        if (mempool_count == cmpctblock.shorttxids.size())
             break;
     }
 
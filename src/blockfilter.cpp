@@ -2,9 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <mutex>
 #include <sstream>
 #include <set>
+#include <utility>
 
 #include <blockfilter.h>
 #include <crypto/siphash.h>
@@ -20,6 +22,9 @@ static constexpr int GCS_SER_TYPE = SER_NETWORK;
 /// Protocol version used to serialize parameters in GCS filter encoding.
 static constexpr int GCS_SER_VERSION = 0;
 
+/// Sets with fewer elements are sorted with std::sort rather than a radix sort.
+static constexpr size_t RADIX_SORT_MIN_SIZE = 256;
+
 static const std::map<BlockFilterType, std::string> g_filter_types = {
     {BlockFilterType::BASIC, "basic"},
 };
@@ -63,14 +68,51 @@ uint64_t GCSFilter::HashToRange(const Element& element) const
     return MapIntoRange(hash, m_F);
 }
 
+// Sort values in [0, range) with a least significant digit first radix sort
+// on bytes, skipping the bytes that are zero for the whole range and those
+// that all values share. Small sets are left to std::sort.
+static void SortHashedSet(std::vector<uint64_t>& values, uint64_t range)
+{
+    if (values.size() < RADIX_SORT_MIN_SIZE) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    std::vector<uint64_t> sorted(values.size());
+    for (int shift = 0; shift < 64 && ((range - 1) >> shift) != 0; shift += 8) {
+        size_t offsets[256] = {};
+        for (uint64_t value : values) {
+            ++offsets[(value >> shift) & 0xFF];
+        }
+        if (offsets[(values.front() >> shift) & 0xFF] == values.size()) continue;
+        size_t offset = 0;
+        for (size_t& count : offsets) {
+            offset += std::exchange(count, offset);
+        }
+        for (uint64_t value : values) {
+            sorted[offsets[(value >> shift) & 0xFF]++] = value;
+        }
+        values.swap(sorted);
+    }
+}
+
 std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
 {
-    std::vector<uint64_t> hashed_elements;
-    hashed_elements.reserve(elements.size());
+    std::vector<const unsigned char*> data;
+    std::vector<size_t> sizes;
+    data.reserve(elements.size());
+    sizes.reserve(elements.size());
     for (const Element& element : elements) {
-        hashed_elements.push_back(HashToRange(element));
+        data.push_back(element.data());
+        sizes.push_back(element.size());
+    }
+
+    std::vector<uint64_t> hashed_elements(elements.size());
+    SipHashBatch(m_params.m_siphash_k0, m_params.m_siphash_k1, data.data(), sizes.data(), hashed_elements.data(), hashed_elements.size());
+    for (uint64_t& hash : hashed_elements) {
+        hash = MapIntoRange(hash, m_F);
     }
-    std::sort(hashed_elements.begin(), hashed_elements.end());
+    SortHashedSet(hashed_elements, m_F);
     return hashed_elements;
 }
 
@@ -92,11 +134,11 @@ GCSFilter::GCSFilter(const Params& params, std::vector<unsigned char> encoded_fi
 
     // Verify that the encoded filter contains exactly N elements. If it has too much or too little
     // data, a std::ios_base::failure exception will be raised.
-    BitStreamReader<VectorReader> bitreader(stream);
+    GolombRiceReader reader(MakeSpan(m_encoded).subspan(GetSizeOfCompactSize(N)), m_params.m_P);
     for (uint64_t i = 0; i < m_N; ++i) {
-        GolombRiceDecode(bitreader, m_params.m_P);
+        reader.Decode();
     }
-    if (!stream.empty()) {
+    if (reader.BytesRemaining() != 0) {
         throw std::ios_base::failure("encoded_filter contains excess data");
     }
 }
@@ -119,32 +161,31 @@ GCSFilter::GCSFilter(const Params& params, const ElementSet& elements)
         return;
     }
 
-    BitStreamWriter<CVectorWriter> bitwriter(stream);
+    const std::vector<uint64_t> hashed_elements = BuildHashedSet(elements);
+    // With the BIP 158 parameters, M is about 1.5 * 2^P and deltas average
+    // under P + 3 bits.
+    m_encoded.reserve(m_encoded.size() + (hashed_elements.size() * (m_params.m_P + 3) + 7) / 8);
+    GolombRiceWriter writer(m_encoded, m_params.m_P);
 
     uint64_t last_value = 0;
-    for (uint64_t value : BuildHashedSet(elements)) {
+    for (uint64_t value : hashed_elements) {
         uint64_t delta = value - last_value;
-        GolombRiceEncode(bitwriter, m_params.m_P, delta);
+        writer.Encode(delta);
         last_value = value;
     }
 
-    bitwriter.Flush();
+    writer.Flush();
 }
 
 bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
 {
-    VectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, m_encoded, 0);
-
-    // Seek forward by size of N
-    uint64_t N = ReadCompactSize(stream);
-    assert(N == m_N);
-
-    BitStreamReader<VectorReader> bitreader(stream);
+    // Skip the encoding of N
+    GolombRiceReader reader(MakeSpan(m_encoded).subspan(GetSizeOfCompactSize(m_N)), m_params.m_P);
 
     uint64_t value = 0;
     size_t hashes_index = 0;
     for (uint32_t i = 0; i < m_N; ++i) {
-        uint64_t delta = GolombRiceDecode(bitreader, m_params.m_P);
+        uint64_t delta = reader.Decode();
         value += delta;
 
         while (true) {
@@ -10,6 +10,12 @@
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 template <typename T>
@@ -24,12 +30,30 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a deque of pending verifications, each with its own
+  * lock. The master spreads added verifications over the deques, threads
+  * take work from the back of their own deque, and once that is empty,
+  * steal from the front of the others'. The shared mutex is only used to
+  * put idle threads to sleep and wake them up again.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A thread's own deque of verifications.
+    struct WorkerQueue {
+        Mutex m_mutex;
+        std::deque<T> m_checks GUARDED_BY(m_mutex);
+    };
+
+    //! One deque for the master (at index 0), and one per worker thread.
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+    //! Index of the deque the next added verifications go to.
+    std::atomic<size_t> m_next_queue{0};
+
+    //! Mutex to put idle threads to sleep and wake them up
     Mutex m_mutex;
 
     //! Worker threads block on this when out of work
@@ -38,25 +62,23 @@ private:
     //! Master thread blocks on this when out of work
     std::condition_variable m_master_cv;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue GUARDED_BY(m_mutex);
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle GUARDED_BY(m_mutex){0};
-
-    //! The total number of workers (including the master).
-    int nTotal GUARDED_BY(m_mutex){0};
+    /**
+     * Number of verifications in the deques. It is only raised while
+     * holding m_mutex, so that threads can't miss new work before going to
+     * sleep. It may be transiently negative, when a thread takes
+     * verifications before they are accounted for.
+     */
+    std::atomic<int64_t> m_queued{0};
 
     //! The temporary evaluation result.
-    bool fAllOk GUARDED_BY(m_mutex){true};
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo GUARDED_BY(m_mutex){0};
+    std::atomic<unsigned int> nTodo{0};
 
     //! The maximum number of elements to be processed in one batch
     const unsigned int nBatchSize;
@@ -64,67 +86,80 @@ private:
     std::vector<std::thread> m_worker_threads;
     bool m_request_stop GUARDED_BY(m_mutex){false};
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster)
+    /**
+     * Move a batch of verifications into vChecks, from the back of the
+     * deque at index, or else from the front of another thread's deque.
+     * Returns false if no work was found.
+     */
+    bool TakeWork(size_t index, std::vector<T>& vChecks)
     {
-        std::condition_variable& cond = fMaster ? m_master_cv : m_worker_cv;
+        if (m_queued.load() <= 0) return false;
+        for (size_t i = 0; i < m_queues.size(); ++i) {
+            WorkerQueue& queue = *m_queues[(index + i) % m_queues.size()];
+            LOCK(queue.m_mutex);
+            if (queue.m_checks.empty()) continue;
+            // Leave half of the deque to other threads, so all of them
+            // finish approximately simultaneously. Don't do batches smaller
+            // than 1 (duh), or larger than nBatchSize.
+            const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, queue.m_checks.size() / 2));
+            vChecks.resize(nNow);
+            for (T& check : vChecks) {
+                // Swap jobs from the deque to the local batch vector instead of copying.
+                if (i == 0) {
+                    check.swap(queue.m_checks.back());
+                    queue.m_checks.pop_back();
+                } else {
+                    check.swap(queue.m_checks.front());
+                    queue.m_checks.pop_front();
+                }
+            }
+            m_queued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
+    /** Internal function that does bulk of the verification work. index 0 is the master thread. */
+    bool Loop(size_t index)
+    {
+        const bool fMaster = index == 0;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!TakeWork(index, vChecks)) {
                 WAIT_LOCK(m_mutex, lock);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        m_master_cv.notify_one();
+                if (fMaster) {
+                    while (m_queued <= 0 && nTodo != 0) {
+                        m_master_cv.wait(lock);
+                    }
+                    if (nTodo == 0) {
+                        // return the current status, and reset it for new work later
+                        return fAllOk.exchange(true);
+                    }
                 } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty() && !m_request_stop) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
+                    while (m_queued <= 0 && !m_request_stop) {
+                        m_worker_cv.wait(lock);
+                    }
+                    if (m_request_stop) {
+                        return false;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                if (m_request_stop) {
-                    return false;
-                }
-
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the m_mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            if (!fOk) fAllOk = false;
+            const unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                LOCK(m_mutex);
+                m_master_cv.notify_one();
+            }
         } while (true);
     }
 
@@ -136,22 +171,21 @@ public:
     explicit CCheckQueue(unsigned int nBatchSizeIn)
         : nBatchSize(nBatchSizeIn)
     {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
     }
 
-    //! Create a pool of new worker threads.
-    void StartWorkerThreads(const int threads_num)
+    //! Create a pool of new worker threads, named thread_name.<n>.
+    void StartWorkerThreads(const int threads_num, const std::string& thread_name = "scriptch")
     {
-        {
-            LOCK(m_mutex);
-            nIdle = 0;
-            nTotal = 0;
-            fAllOk = true;
-        }
+        fAllOk = true;
         assert(m_worker_threads.empty());
+        while (m_queues.size() < size_t(threads_num) + 1) {
+            m_queues.push_back(std::make_unique<WorkerQueue>());
+        }
         for (int n = 0; n < threads_num; ++n) {
-            m_worker_threads.emplace_back([this, n]() {
-                util::ThreadRename(strprintf("scriptch.%i", n));
-                Loop(false /* worker thread */);
+            m_worker_threads.emplace_back([this, n, thread_name]() {
+                util::ThreadRename(strprintf("%s.%i", thread_name, n));
+                Loop(n + 1 /* worker thread */);
             });
         }
     }
@@ -159,21 +193,28 @@ public:
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true /* master thread */);
+        return Loop(0 /* master thread */);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        LOCK(m_mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
         nTodo += vChecks.size();
+        // Spread the checks over the threads' deques, in chunks of up to nBatchSize.
+        const size_t chunk = std::max(1U, nBatchSize);
+        for (size_t pos = 0; pos < vChecks.size(); pos += chunk) {
+            WorkerQueue& queue = *m_queues[m_next_queue++ % m_queues.size()];
+            LOCK(queue.m_mutex);
+            for (size_t i = pos; i < std::min(pos + chunk, vChecks.size()); ++i) {
+                queue.m_checks.emplace_back();
+                vChecks[i].swap(queue.m_checks.back());
+            }
+        }
+        WITH_LOCK(m_mutex, m_queued += vChecks.size());
         if (vChecks.size() == 1)
             m_worker_cv.notify_one();
-        else if (vChecks.size() > 1)
+        else
             m_worker_cv.notify_all();
     }
 
@@ -11,6 +11,7 @@
 #include <memusage.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 #include <util/hasher.h>
 
@@ -18,6 +19,7 @@
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
 
 /**
@@ -131,7 +133,26 @@ struct CCoinsCacheEntry
     CCoinsCacheEntry(Coin&& coin_, unsigned char flag) : coin(std::move(coin_)), flags(flag) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and adds the size
+ * of 4 pointers. We do not know the exact node size used in the std::unordered_node implementation
+ * because it is implementation defined. Most implementations have an overhead of 1 or 2 pointers,
+ * so nodes can be connected in a linked list, and in some cases the hash value is stored as well.
+ * Using an additional sizeof(void*)*4 for MAX_BLOCK_SIZE_BYTES should thus be sufficient so that
+ * all implementations can allocate the nodes from the PoolAllocator.
+ *
+ * Allocating the nodes from a pool instead of one malloc each saves the per-allocation overhead,
+ * keeps entries close together in memory, and lets memusage::DynamicUsage() report the memory
+ * actually held by the map instead of estimating it per node.
+ */
+using CCoinsMap = std::unordered_map<COutPoint,
+                                     CCoinsCacheEntry,
+                                     SaltedOutpointHasher,
+                                     std::equal_to<COutPoint>,
+                                     PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                                   sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4>>;
+
+using CCoinsMapMemoryResource = CCoinsMap::allocator_type::ResourceType;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -179,6 +200,14 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Whether TakeCache() may be used instead of BatchWrite().
+    virtual bool CanTakeCache() const { return false; }
+
+    //! Like BatchWrite, but take over mapCoins as a whole together with the
+    //! memory resource its entries were allocated from, leaving both empty.
+    //! Returns false, with both untouched, if the write can't be accepted.
+    virtual bool TakeCache(std::unique_ptr<CCoinsMapMemoryResource>& resource, CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+
     //! Get a cursor to iterate over the whole state
     virtual std::unique_ptr<CCoinsViewCursor> Cursor() const;
 
@@ -204,6 +233,8 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool CanTakeCache() const override;
+    bool TakeCache(std::unique_ptr<CCoinsMapMemoryResource>& resource, CCoinsMap& mapCoins, const uint256& hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -218,6 +249,7 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable std::unique_ptr<CCoinsMapMemoryResource> m_cache_coins_memory_resource{std::make_unique<CCoinsMapMemoryResource>()};
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -237,6 +269,8 @@ public:
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    //! Entries flushed into this cache are merged into cacheCoins, not taken over.
+    bool CanTakeCache() const override { return false; }
     std::unique_ptr<CCoinsViewCursor> Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -248,6 +282,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Check if this cache holds an entry (spent or unspent) for the given
+     * outpoint, i.e. whether looking it up would be answered without
+     * consulting the backing CCoinsView.
+     */
+    bool HaveEntryInCache(const COutPoint &outpoint) const;
+
     /**
      * Return a reference to Coin in the cache, or coinEmpty if not found. This is
      * more efficient than GetCoin.
@@ -275,6 +316,17 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin);
 
+    /**
+     * Insert a coin that was read from the backing CCoinsView by the caller,
+     * exactly as FetchCoin() would have cached it (not DIRTY). Has no effect
+     * if an entry for the outpoint already exists.
+     *
+     * The coin must reflect the current state of the backing view. Used to
+     * warm the cache with coins that were looked up concurrently.
+     * @sa PrefetchBlockInputs()
+     */
+    void InsertFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
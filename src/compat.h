@@ -97,6 +97,12 @@ typedef char* sockopt_arg_type;
 #define USE_POLL
 #endif
 
+// epoll lets the socket handler keep its sockets registered across iterations
+// instead of passing all of them to the kernel on every poll() call.
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #if defined(USE_POLL) || defined(WIN32)
     return true;
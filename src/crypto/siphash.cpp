@@ -3,6 +3,27 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <crypto/siphash.h>
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <string>
+
+#include <compat/cpuid.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+namespace siphash_sse41
+{
+void Uint256_4way(uint64_t k0, uint64_t k1, const unsigned char* in, uint64_t* out);
+void Uint256Extra_4way(uint64_t k0, uint64_t k1, const unsigned char* in, const uint32_t* extra, uint64_t* out);
+}
+
+namespace siphash_avx2
+{
+void Uint256_8way(uint64_t k0, uint64_t k1, const unsigned char* in, uint64_t* out);
+void Uint256Extra_8way(uint64_t k0, uint64_t k1, const unsigned char* in, const uint32_t* extra, uint64_t* out);
+}
+#endif
 
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
@@ -171,3 +192,184 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+/** Hash the remaining input of a SipHash state that has compressed the first
+ *  size - remaining bytes of a size-byte input, in whole words, and finalize it. */
+uint64_t SipHashFinish(uint64_t v0, uint64_t v1, uint64_t v2, uint64_t v3, const unsigned char* data, size_t remaining, size_t size)
+{
+    for (; remaining >= 8; data += 8, remaining -= 8) {
+        const uint64_t m = ReadLE64(data);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t t = ((uint64_t)size) << 56;
+    for (size_t i = 0; i < remaining; ++i) {
+        t |= ((uint64_t)data[i]) << (8 * i);
+    }
+    v3 ^= t;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= t;
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+typedef void (*Uint256BatchFn)(uint64_t, uint64_t, const unsigned char*, uint64_t*);
+typedef void (*Uint256ExtraBatchFn)(uint64_t, uint64_t, const unsigned char*, const uint32_t*, uint64_t*);
+
+/** Multi-lane implementations hashing batch_lanes inputs per call, if available. */
+size_t batch_lanes = 0;
+Uint256BatchFn Uint256Batch = nullptr;
+Uint256ExtraBatchFn Uint256ExtraBatch = nullptr;
+
+bool SelfTest()
+{
+    uint256 vals[11];
+    uint32_t extras[11];
+    for (int i = 0; i < 11; ++i) {
+        for (int j = 0; j < 32; ++j) vals[i].begin()[j] = i * 32 + j;
+        extras[i] = 0xfedcba98 - i;
+    }
+    uint64_t out[11], out_extra[11];
+    SipHashUint256Batch(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals, out, 11);
+    SipHashUint256ExtraBatch(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals, extras, out_extra, 11);
+    for (int i = 0; i < 11; ++i) {
+        if (out[i] != SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals[i])) return false;
+        if (out_extra[i] != SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals[i], extras[i])) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+std::string SipHashAutoDetect()
+{
+    std::string ret = "standard";
+    batch_lanes = 0;
+    Uint256Batch = nullptr;
+    Uint256ExtraBatch = nullptr;
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+    bool have_sse41 = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    (void)AVXEnabled;
+    (void)have_sse41;
+    (void)have_avx2;
+    (void)enabled_avx;
+
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    have_sse41 = (ecx >> 19) & 1;
+    if (((ecx >> 27) & 1) && ((ecx >> 28) & 1)) {
+        enabled_avx = AVXEnabled();
+    }
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    have_avx2 = (ebx >> 5) & 1;
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_sse41) {
+        batch_lanes = 4;
+        Uint256Batch = siphash_sse41::Uint256_4way;
+        Uint256ExtraBatch = siphash_sse41::Uint256Extra_4way;
+        ret = "sse41(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && enabled_avx) {
+        batch_lanes = 8;
+        Uint256Batch = siphash_avx2::Uint256_8way;
+        Uint256ExtraBatch = siphash_avx2::Uint256Extra_8way;
+        ret = "avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* vals, uint64_t* out, size_t count)
+{
+    static_assert(sizeof(uint256) == 32, "batches are read as consecutive 32-byte inputs");
+    size_t i = 0;
+    if (Uint256Batch) {
+        for (; i + batch_lanes <= count; i += batch_lanes) {
+            Uint256Batch(k0, k1, vals[i].begin(), out + i);
+        }
+    }
+    for (; i < count; ++i) {
+        out[i] = SipHashUint256(k0, k1, vals[i]);
+    }
+}
+
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* vals, const uint32_t* extras, uint64_t* out, size_t count)
+{
+    size_t i = 0;
+    if (Uint256ExtraBatch) {
+        for (; i + batch_lanes <= count; i += batch_lanes) {
+            Uint256ExtraBatch(k0, k1, vals[i].begin(), extras + i, out + i);
+        }
+    }
+    for (; i < count; ++i) {
+        out[i] = SipHashUint256Extra(k0, k1, vals[i], extras[i]);
+    }
+}
+
+void SipHashBatch(uint64_t k0, uint64_t k1, const unsigned char* const* data, const size_t* sizes, uint64_t* out, size_t count)
+{
+    static constexpr size_t LANES = 4;
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+        size_t words = sizes[i] / 8;
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            s0[lane] = 0x736f6d6570736575ULL ^ k0;
+            s1[lane] = 0x646f72616e646f6dULL ^ k1;
+            s2[lane] = 0x6c7967656e657261ULL ^ k0;
+            s3[lane] = 0x7465646279746573ULL ^ k1;
+            words = std::min(words, sizes[i + lane] / 8);
+        }
+        for (size_t word = 0; word < words; ++word) {
+            for (size_t lane = 0; lane < LANES; ++lane) {
+                uint64_t v0 = s0[lane], v1 = s1[lane], v2 = s2[lane], v3 = s3[lane];
+                const uint64_t m = ReadLE64(data[i + lane] + 8 * word);
+                v3 ^= m;
+                SIPROUND;
+                SIPROUND;
+                v0 ^= m;
+                s0[lane] = v0;
+                s1[lane] = v1;
+                s2[lane] = v2;
+                s3[lane] = v3;
+            }
+        }
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            out[i + lane] = SipHashFinish(s0[lane], s1[lane], s2[lane], s3[lane], data[i + lane] + 8 * words, sizes[i + lane] - 8 * words, sizes[i + lane]);
+        }
+    }
+    for (; i < count; ++i) {
+        out[i] = SipHashFinish(0x736f6d6570736575ULL ^ k0, 0x646f72616e646f6dULL ^ k1,
+                               0x6c7967656e657261ULL ^ k0, 0x7465646279746573ULL ^ k1,
+                               data[i], sizes[i], sizes[i]);
+    }
+}
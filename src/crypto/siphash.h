@@ -6,6 +6,7 @@
 #define BITCOIN_CRYPTO_SIPHASH_H
 
 #include <stdint.h>
+#include <string>
 
 #include <uint256.h>
 
@@ -44,4 +45,24 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute out[i] = SipHashUint256(k0, k1, vals[i]) for count inputs at once.
+ *
+ *  Uses the multi-lane implementation picked by SipHashAutoDetect(), if any.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* vals, uint64_t* out, size_t count);
+/** Compute out[i] = SipHashUint256Extra(k0, k1, vals[i], extras[i]) for count inputs at once. */
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* vals, const uint32_t* extras, uint64_t* out, size_t count);
+
+/** Compute out[i] = CSipHasher(k0, k1).Write(data[i], sizes[i]).Finalize() for count inputs at once.
+ *
+ *  Inputs are hashed a word at a time, four at once in lockstep for as long
+ *  as they all have whole words left, so that their rounds can overlap.
+ */
+void SipHashBatch(uint64_t k0, uint64_t k1, const unsigned char* const* data, const size_t* sizes, uint64_t* out, size_t count);
+
+/** Autodetect the best available multi-lane SipHash implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SipHashAutoDetect();
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -0,0 +1,110 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace siphash_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+template <int n>
+__m256i inline RotL(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+template <>
+__m256i inline RotL<16>(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13, 6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13)); }
+template <>
+__m256i inline RotL<32>(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+
+/** SipHash state of 4 independent messages, one per 64-bit lane. */
+struct State
+{
+    __m256i v0, v1, v2, v3;
+
+    State(uint64_t k0, uint64_t k1) :
+        v0(K(0x736f6d6570736575ULL ^ k0)),
+        v1(K(0x646f72616e646f6dULL ^ k1)),
+        v2(K(0x6c7967656e657261ULL ^ k0)),
+        v3(K(0x7465646279746573ULL ^ k1)) {}
+
+    void inline __attribute__((always_inline)) Round()
+    {
+        v0 = Add(v0, v1); v1 = RotL<13>(v1); v1 = Xor(v1, v0);
+        v0 = RotL<32>(v0);
+        v2 = Add(v2, v3); v3 = RotL<16>(v3); v3 = Xor(v3, v2);
+        v0 = Add(v0, v3); v3 = RotL<21>(v3); v3 = Xor(v3, v0);
+        v2 = Add(v2, v1); v1 = RotL<17>(v1); v1 = Xor(v1, v2);
+        v2 = RotL<32>(v2);
+    }
+
+    void inline __attribute__((always_inline)) Compress(__m256i m)
+    {
+        v3 = Xor(v3, m);
+        Round();
+        Round();
+        v0 = Xor(v0, m);
+    }
+
+    __m256i inline __attribute__((always_inline)) Finalize()
+    {
+        v2 = Xor(v2, K(0xFF));
+        Round();
+        Round();
+        Round();
+        Round();
+        return Xor(Xor(v0, v1), Xor(v2, v3));
+    }
+};
+
+/** Compress four consecutive 32-byte inputs, transposing them so that each lane holds one input. */
+void inline __attribute__((always_inline)) CompressUint256(State& s, const unsigned char* in)
+{
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)in);
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(in + 32));
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(in + 64));
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(in + 96));
+    __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    s.Compress(_mm256_permute2x128_si256(t0, t2, 0x20));
+    s.Compress(_mm256_permute2x128_si256(t1, t3, 0x20));
+    s.Compress(_mm256_permute2x128_si256(t0, t2, 0x31));
+    s.Compress(_mm256_permute2x128_si256(t1, t3, 0x31));
+}
+
+}
+
+void Uint256_8way(uint64_t k0, uint64_t k1, const unsigned char* in, uint64_t* out)
+{
+    // Two independent states, so that the rounds of one fill the latency of the other
+    State a(k0, k1), b(k0, k1);
+    CompressUint256(a, in);
+    CompressUint256(b, in + 128);
+    const __m256i len = K(((uint64_t)4) << 59);
+    a.Compress(len);
+    b.Compress(len);
+    _mm256_storeu_si256((__m256i*)out, a.Finalize());
+    _mm256_storeu_si256((__m256i*)(out + 4), b.Finalize());
+}
+
+void Uint256Extra_8way(uint64_t k0, uint64_t k1, const unsigned char* in, const uint32_t* extra, uint64_t* out)
+{
+    State a(k0, k1), b(k0, k1);
+    CompressUint256(a, in);
+    CompressUint256(b, in + 128);
+    const __m256i len = K(((uint64_t)36) << 56);
+    a.Compress(Xor(len, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)extra))));
+    b.Compress(Xor(len, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(extra + 4)))));
+    _mm256_storeu_si256((__m256i*)out, a.Finalize());
+    _mm256_storeu_si256((__m256i*)(out + 4), b.Finalize());
+}
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace siphash_sse41 {
+namespace {
+
+__m128i inline K(uint64_t x) { return _mm_set1_epi64x(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi64(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+template <int n>
+__m128i inline RotL(__m128i x) { return _mm_or_si128(_mm_slli_epi64(x, n), _mm_srli_epi64(x, 64 - n)); }
+template <>
+__m128i inline RotL<16>(__m128i x) { return _mm_shuffle_epi8(x, _mm_setr_epi8(6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13)); }
+template <>
+__m128i inline RotL<32>(__m128i x) { return _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+
+/** SipHash state of 2 independent messages, one per 64-bit lane. */
+struct State
+{
+    __m128i v0, v1, v2, v3;
+
+    State(uint64_t k0, uint64_t k1) :
+        v0(K(0x736f6d6570736575ULL ^ k0)),
+        v1(K(0x646f72616e646f6dULL ^ k1)),
+        v2(K(0x6c7967656e657261ULL ^ k0)),
+        v3(K(0x7465646279746573ULL ^ k1)) {}
+
+    void inline __attribute__((always_inline)) Round()
+    {
+        v0 = Add(v0, v1); v1 = RotL<13>(v1); v1 = Xor(v1, v0);
+        v0 = RotL<32>(v0);
+        v2 = Add(v2, v3); v3 = RotL<16>(v3); v3 = Xor(v3, v2);
+        v0 = Add(v0, v3); v3 = RotL<21>(v3); v3 = Xor(v3, v0);
+        v2 = Add(v2, v1); v1 = RotL<17>(v1); v1 = Xor(v1, v2);
+        v2 = RotL<32>(v2);
+    }
+
+    void inline __attribute__((always_inline)) Compress(__m128i m)
+    {
+        v3 = Xor(v3, m);
+        Round();
+        Round();
+        v0 = Xor(v0, m);
+    }
+
+    __m128i inline __attribute__((always_inline)) Finalize()
+    {
+        v2 = Xor(v2, K(0xFF));
+        Round();
+        Round();
+        Round();
+        Round();
+        return Xor(Xor(v0, v1), Xor(v2, v3));
+    }
+};
+
+/** Compress two consecutive 32-byte inputs, transposing them so that each lane holds one input. */
+void inline __attribute__((always_inline)) CompressUint256(State& s, const unsigned char* in)
+{
+    __m128i r0 = _mm_loadu_si128((const __m128i*)in);
+    __m128i r1 = _mm_loadu_si128((const __m128i*)(in + 16));
+    __m128i r2 = _mm_loadu_si128((const __m128i*)(in + 32));
+    __m128i r3 = _mm_loadu_si128((const __m128i*)(in + 48));
+    s.Compress(_mm_unpacklo_epi64(r0, r2));
+    s.Compress(_mm_unpackhi_epi64(r0, r2));
+    s.Compress(_mm_unpacklo_epi64(r1, r3));
+    s.Compress(_mm_unpackhi_epi64(r1, r3));
+}
+
+}
+
+void Uint256_4way(uint64_t k0, uint64_t k1, const unsigned char* in, uint64_t* out)
+{
+    // Two independent states, so that the rounds of one fill the latency of the other
+    State a(k0, k1), b(k0, k1);
+    CompressUint256(a, in);
+    CompressUint256(b, in + 64);
+    const __m128i len = K(((uint64_t)4) << 59);
+    a.Compress(len);
+    b.Compress(len);
+    _mm_storeu_si128((__m128i*)out, a.Finalize());
+    _mm_storeu_si128((__m128i*)(out + 2), b.Finalize());
+}
+
+void Uint256Extra_4way(uint64_t k0, uint64_t k1, const unsigned char* in, const uint32_t* extra, uint64_t* out)
+{
+    State a(k0, k1), b(k0, k1);
+    CompressUint256(a, in);
+    CompressUint256(b, in + 64);
+    const __m128i len = K(((uint64_t)36) << 56);
+    a.Compress(Xor(len, _mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i*)extra))));
+    b.Compress(Xor(len, _mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i*)(extra + 2)))));
+    _mm_storeu_si128((__m128i*)out, a.Finalize());
+    _mm_storeu_si128((__m128i*)(out + 2), b.Finalize());
+}
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <flatfile.h>
@@ -10,6 +11,13 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -97,3 +105,66 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+MappedFlatFile::~MappedFlatFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile> MappedFlatFile::Map(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFlatFile>(new MappedFlatFile(static_cast<const unsigned char*>(data), size));
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile> FlatFileMapCache::Get(const fs::path& path, size_t min_size)
+{
+    LOCK(m_mutex);
+    auto it = std::find_if(m_maps.begin(), m_maps.end(), [&](const auto& entry) { return entry.first == path; });
+    if (it != m_maps.end() && it->second->Data().size() >= min_size) {
+        m_maps.splice(m_maps.begin(), m_maps, it);
+        return it->second;
+    }
+    if (it != m_maps.end()) m_maps.erase(it);
+
+    std::shared_ptr<const MappedFlatFile> map = MappedFlatFile::Map(path);
+    if (!map || map->Data().size() < min_size) return nullptr;
+    m_maps.emplace_front(path, map);
+    if (m_maps.size() > m_capacity) m_maps.pop_back();
+    return map;
+}
+
+void FlatFileMapCache::Erase(const fs::path& path)
+{
+    LOCK(m_mutex);
+    m_maps.remove_if([&](const auto& entry) { return entry.first == path; });
+}
+
+void FlatFileMapCache::Clear()
+{
+    LOCK(m_mutex);
+    m_maps.clear();
+}
@@ -6,10 +6,15 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <list>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -87,4 +92,62 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/**
+ * A read-only memory mapping of a whole file, as large as the file was when
+ * it was mapped. The mapped data stays valid for the lifetime of the object,
+ * even if the file is unlinked in the meantime. Bytes written to the file
+ * later are visible through the mapping if they lie within its size.
+ */
+class MappedFlatFile
+{
+private:
+    const unsigned char* const m_data;
+    const size_t m_size;
+
+    MappedFlatFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+
+public:
+    MappedFlatFile(const MappedFlatFile&) = delete;
+    MappedFlatFile& operator=(const MappedFlatFile&) = delete;
+    ~MappedFlatFile();
+
+    /** Map the file at path. Returns nullptr if that fails, or if mmap is not supported on this platform. */
+    static std::shared_ptr<const MappedFlatFile> Map(const fs::path& path);
+
+    Span<const unsigned char> Data() const { return {m_data, m_size}; }
+};
+
+/**
+ * Small LRU cache of read-only file mappings, so that repeated reads from
+ * the files of a FlatFileSeq don't have to open, seek and close them.
+ *
+ * Mappings must be erased when a file is truncated or deleted: reading a
+ * mapped page beyond the end of a file raises SIGBUS, and a mapping keeps
+ * the disk space of a deleted file in use.
+ */
+class FlatFileMapCache
+{
+private:
+    const size_t m_capacity;
+    Mutex m_mutex;
+    //! Mappings by file name, most recently used first.
+    std::list<std::pair<fs::path, std::shared_ptr<const MappedFlatFile>>> m_maps GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileMapCache(size_t capacity) : m_capacity(capacity) {}
+
+    /**
+     * Get a mapping of the file at path that covers at least min_size bytes,
+     * mapping the file again if it has grown since it was last mapped.
+     * Returns nullptr if the file can't be mapped or is smaller than min_size.
+     */
+    std::shared_ptr<const MappedFlatFile> Get(const fs::path& path, size_t min_size);
+
+    /** Drop the mapping of a file, if any. Readers holding it keep it alive. */
+    void Erase(const fs::path& path);
+
+    /** Drop all mappings. */
+    void Clear();
+};
+
 #endif // BITCOIN_FLATFILE_H
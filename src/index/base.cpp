@@ -13,10 +13,15 @@
 #include <validation.h> // For g_chainman
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
+
 constexpr uint8_t DB_BEST_BLOCK{'B'};
 
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+//! Blocks queued per sync thread, bounding the memory used by blocks read ahead
+constexpr size_t SYNC_BLOCKS_PER_THREAD = 2;
 
 template <typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
@@ -121,14 +126,116 @@ static const CBlockIndex* NextSyncBlock(const CBlockIndex* pindex_prev, CChain&
     return chain.Next(chain.FindFork(pindex_prev));
 }
 
+/**
+ * Blocks read from disk and prepared by worker threads, handed back to the
+ * sync thread in chain order so that only WriteBlock runs serially. With a
+ * single thread, each block is read by the sync thread when it is popped.
+ */
+class BaseIndex::SyncQueue
+{
+public:
+    struct Entry {
+        const CBlockIndex* pindex;
+        CBlock block;
+        bool read{false};
+        //! Null if the block could not be read or prepared
+        std::unique_ptr<PreparedBlock> prepared;
+        //! Whether a worker is done with the entry, guarded by SyncQueue::m_mutex
+        bool done{false};
+    };
+
+    SyncQueue(const BaseIndex& index, int threads) :
+        m_index(index), m_capacity(threads > 1 ? threads * SYNC_BLOCKS_PER_THREAD : 1)
+    {
+        for (int i = 0; threads > 1 && i < threads; ++i) {
+            m_workers.emplace_back([this, name = strprintf("%s.%d", index.GetName(), i)] {
+                util::TraceThread(name.c_str(), [this] { ThreadWorker(); });
+            });
+        }
+    }
+
+    ~SyncQueue()
+    {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_work_cv.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    bool Empty() const { return m_entries.empty(); }
+    bool Full() const { return m_entries.size() >= m_capacity; }
+    const CBlockIndex* Back() const { return m_entries.back()->pindex; }
+
+    void Push(const CBlockIndex* pindex)
+    {
+        m_entries.push_back(std::make_unique<Entry>());
+        m_entries.back()->pindex = pindex;
+        if (m_workers.empty()) return;
+        WITH_LOCK(m_mutex, m_todo.push_back(m_entries.back().get()));
+        m_work_cv.notify_one();
+    }
+
+    /** Wait until the oldest block is ready and take it off the queue. */
+    std::unique_ptr<Entry> Pop()
+    {
+        std::unique_ptr<Entry> entry = std::move(m_entries.front());
+        m_entries.pop_front();
+        if (m_workers.empty()) {
+            Prepare(*entry);
+        } else {
+            WAIT_LOCK(m_mutex, lock);
+            m_done_cv.wait(lock, [&] { return entry->done; });
+        }
+        return entry;
+    }
+
+private:
+    void Prepare(Entry& entry) const
+    {
+        entry.read = ReadBlockFromDisk(entry.block, entry.pindex, Params().GetConsensus());
+        if (entry.read) {
+            entry.prepared = m_index.PrepareBlock(entry.block, entry.pindex);
+        }
+    }
+
+    void ThreadWorker()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_work_cv.wait(lock, [&] { return m_stop || !m_todo.empty(); });
+            if (m_stop) return;
+            Entry* entry = m_todo.front();
+            m_todo.pop_front();
+            {
+                REVERSE_LOCK(lock);
+                Prepare(*entry);
+            }
+            entry->done = true;
+            m_done_cv.notify_all();
+        }
+    }
+
+    const BaseIndex& m_index;
+    const size_t m_capacity;
+    //! Queued blocks, only accessed by the sync thread
+    std::deque<std::unique_ptr<Entry>> m_entries;
+
+    Mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    std::deque<Entry*> m_todo GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_workers;
+};
+
 void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
     if (!m_synced) {
-        auto& consensus_params = Params().GetConsensus();
-
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
+        SyncQueue queue(*this, m_sync_threads);
         while (true) {
             if (m_interrupt) {
                 m_best_block_index = pindex;
@@ -141,22 +248,35 @@ void BaseIndex::ThreadSync()
 
             {
                 LOCK(cs_main);
-                const CBlockIndex* pindex_next = NextSyncBlock(pindex, m_chainstate->m_chain);
-                if (!pindex_next) {
+                // Queue the blocks that follow, so they are read while earlier ones are written.
+                const CBlockIndex* pindex_queued = queue.Empty() ? pindex : queue.Back();
+                while (!queue.Full()) {
+                    const CBlockIndex* pindex_next = NextSyncBlock(pindex_queued, m_chainstate->m_chain);
+                    if (!pindex_next) break;
+                    if (pindex_next->pprev != pindex_queued) {
+                        // Write the blocks queued before the reorg, then rewind.
+                        if (!queue.Empty()) break;
+                        if (!Rewind(pindex, pindex_next->pprev)) {
+                            FatalError("%s: Failed to rewind index %s to a previous chain tip",
+                                       __func__, GetName());
+                            return;
+                        }
+                    }
+                    queue.Push(pindex_next);
+                    pindex_queued = pindex_next;
+                }
+                if (queue.Empty()) {
                     m_best_block_index = pindex;
                     m_synced = true;
                     // No need to handle errors in Commit. See rationale above.
                     Commit();
                     break;
                 }
-                if (pindex_next->pprev != pindex && !Rewind(pindex, pindex_next->pprev)) {
-                    FatalError("%s: Failed to rewind index %s to a previous chain tip",
-                               __func__, GetName());
-                    return;
-                }
-                pindex = pindex_next;
             }
 
+            std::unique_ptr<SyncQueue::Entry> entry = queue.Pop();
+            pindex = entry->pindex;
+
             int64_t current_time = GetTime();
             if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
                 LogPrintf("Syncing %s with block chain from height %d\n",
@@ -171,13 +291,12 @@ void BaseIndex::ThreadSync()
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            if (!entry->read) {
                 FatalError("%s: Failed to read block %s from disk",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!entry->prepared || !WriteBlock(entry->block, pindex, *entry->prepared)) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
@@ -208,6 +327,11 @@ bool BaseIndex::CommitInternal(CDBBatch& batch)
     return true;
 }
 
+std::unique_ptr<BaseIndex::PreparedBlock> BaseIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    return std::make_unique<PreparedBlock>();
+}
+
 bool BaseIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
 {
     assert(current_tip == m_best_block_index);
@@ -261,7 +385,8 @@ void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const
         }
     }
 
-    if (WriteBlock(*block, pindex)) {
+    std::unique_ptr<PreparedBlock> prepared = PrepareBlock(*block, pindex);
+    if (prepared && WriteBlock(*block, pindex, *prepared)) {
         m_best_block_index = pindex;
     } else {
         FatalError("%s: Failed to write block %s to index",
@@ -338,9 +463,10 @@ void BaseIndex::Interrupt()
     m_interrupt();
 }
 
-bool BaseIndex::Start(CChainState& active_chainstate)
+bool BaseIndex::Start(CChainState& active_chainstate, int sync_threads)
 {
     m_chainstate = &active_chainstate;
+    m_sync_threads = sync_threads;
     // Need to register this ValidationInterface before running Init(), so that
     // callbacks are not missed if Init sets m_synced to true.
     RegisterValidationInterface(this);
@@ -11,9 +11,16 @@
 #include <threadinterrupt.h>
 #include <validationinterface.h>
 
+#include <memory>
+
 class CBlockIndex;
 class CChainState;
 
+/** Default for -indexthreads, the number of threads reading blocks ahead of a syncing index (0 = auto) */
+static constexpr int DEFAULT_INDEX_THREADS{0};
+/** Maximum number of threads reading blocks ahead of a syncing index */
+static constexpr int MAX_INDEX_THREADS{16};
+
 struct IndexSummary {
     std::string name;
     bool synced{false};
@@ -60,6 +67,14 @@ private:
     std::thread m_thread_sync;
     CThreadInterrupt m_interrupt;
 
+    /// Number of threads reading and preparing blocks ahead of m_thread_sync
+    /// while the index catches up with the chain. With 1, the sync thread
+    /// reads each block itself.
+    int m_sync_threads{1};
+
+    /// Blocks being read and prepared for the sync thread, in chain order.
+    class SyncQueue;
+
     /// Sync the index with the block index starting from the current best block.
     /// Intended to be run in its own thread, m_thread_sync, and can be
     /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
@@ -88,8 +103,20 @@ protected:
     /// Initialize internal state from the database and block index.
     [[nodiscard]] virtual bool Init();
 
-    /// Write update index entries for a newly connected block.
-    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+    /// Index entries of a block computed by PrepareBlock, to be written by WriteBlock.
+    struct PreparedBlock {
+        virtual ~PreparedBlock() = default;
+    };
+
+    /// Compute the index entries of a block that do not depend on earlier blocks.
+    /// While the index catches up with the chain, this runs on several threads
+    /// at once, ahead of the best block, so it must not read or modify index
+    /// state. Returns nullptr on failure.
+    virtual std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const;
+
+    /// Write update index entries for a newly connected block, given what
+    /// PrepareBlock computed for it. Blocks are written in chain order.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) { return true; }
 
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
@@ -119,7 +146,9 @@ public:
 
     /// Start initializes the sync state and registers the instance as a
     /// ValidationInterface so that it stays in sync with blockchain updates.
-    [[nodiscard]] bool Start(CChainState& active_chainstate);
+    /// Until it is in sync, sync_threads threads read and prepare blocks
+    /// ahead of the index.
+    [[nodiscard]] bool Start(CChainState& active_chainstate, int sync_threads = 1);
 
     /// Stops the instance from staying in sync with blockchain updates.
     void Stop();
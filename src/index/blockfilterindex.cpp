@@ -3,11 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <map>
+#include <optional>
 
 #include <dbwrapper.h>
 #include <index/blockfilterindex.h>
 #include <node/blockstorage.h>
+#include <streams.h>
 #include <util/system.h>
+#include <version.h>
 
 /* The index database stores three items for each block: the disk location of the encoded filter,
  * its dSHA256 hash, and the header. Those belonging to blocks on the active chain are indexed by
@@ -37,6 +40,11 @@ constexpr unsigned int FLTR_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
  *  is big enough for a 2,000,000 length block chain, which
  *  we should be enough until ~2047. */
 constexpr size_t CF_HEADERS_CACHE_MAX_SZ{2000};
+/** Share of the index's cache size given to the serialized filter cache, the
+ *  rest goes to the database. Basic filters of recent mainnet blocks are around
+ *  20 kB, so with the default -dbcache this holds about the 1000 filters of a
+ *  maximal getcfilters request. */
+constexpr size_t FILTER_CACHE_FRACTION{2};
 
 namespace {
 
@@ -93,7 +101,7 @@ static std::map<BlockFilterType, BlockFilterIndex> g_filter_indexes;
 
 BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
                                    size_t n_cache_size, bool f_memory, bool f_wipe)
-    : m_filter_type(filter_type)
+    : m_filter_type(filter_type), m_filter_cache_max_bytes(n_cache_size / FILTER_CACHE_FRACTION)
 {
     const std::string& filter_name = BlockFilterTypeName(filter_type);
     if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
@@ -102,7 +110,7 @@ BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
     fs::create_directories(path);
 
     m_name = filter_name + " block filter index";
-    m_db = std::make_unique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+    m_db = std::make_unique<BaseIndex::DB>(path / "db", n_cache_size - m_filter_cache_max_bytes, f_memory, f_wipe);
     m_filter_fileseq = std::make_unique<FlatFileSeq>(std::move(path), "fltr", FLTR_FILE_CHUNK_SIZE);
 }
 
@@ -161,6 +169,44 @@ bool BlockFilterIndex::ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& f
     return true;
 }
 
+/**
+ * Read the filter records at the given positions, in order. Each filter file
+ * is opened once for a run of records in it, and the reader only seeks between
+ * records that are not adjacent in the file, so a range of filters written in
+ * sequence is read in a single pass. fn(i, block_hash, encoded_filter) is
+ * called for the record at positions[i].
+ */
+template <typename Fn>
+static bool ReadFilterRecords(FlatFileSeq& fileseq, const std::vector<FlatFilePos>& positions, Fn fn)
+{
+    std::optional<CAutoFile> filein;
+    FlatFilePos next_pos;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        const FlatFilePos& pos = positions[i];
+        if (!filein || pos.nFile != next_pos.nFile) {
+            filein.emplace(fileseq.Open(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein->IsNull()) {
+                return false;
+            }
+        } else if (pos.nPos != next_pos.nPos && fseek(filein->Get(), pos.nPos, SEEK_SET)) {
+            return error("%s: Failed to seek to filter at %s", __func__, pos.ToString());
+        }
+
+        uint256 block_hash;
+        std::vector<uint8_t> encoded_filter;
+        try {
+            *filein >> block_hash >> encoded_filter;
+        } catch (const std::exception& e) {
+            return error("%s: Failed to deserialize block filter from disk: %s", __func__, e.what());
+        }
+        next_pos.nFile = pos.nFile;
+        next_pos.nPos = pos.nPos + GetSerializeSize(block_hash, CLIENT_VERSION) + GetSerializeSize(encoded_filter, CLIENT_VERSION);
+
+        fn(i, block_hash, std::move(encoded_filter));
+    }
+    return true;
+}
+
 size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter)
 {
     assert(filter.GetFilterType() == GetFilterType());
@@ -207,16 +253,29 @@ size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter&
     return data_size;
 }
 
-bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+/** The filter of a block, built ahead of chaining its header. */
+struct BlockFilterIndex::PreparedFilter : public BaseIndex::PreparedBlock {
+    BlockFilter filter;
+};
+
+std::unique_ptr<BaseIndex::PreparedBlock> BlockFilterIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
 {
     CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        return nullptr;
+    }
+
+    auto prepared = std::make_unique<PreparedFilter>();
+    prepared->filter = BlockFilter(m_filter_type, block, block_undo);
+    return prepared;
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    const BlockFilter& filter = static_cast<PreparedFilter&>(prepared).filter;
     uint256 prev_header;
 
     if (pindex->nHeight > 0) {
-        if (!UndoReadFromDisk(block_undo, pindex)) {
-            return false;
-        }
-
         std::pair<uint256, DBVal> read_out;
         if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
             return false;
@@ -231,8 +290,6 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
         prev_header = read_out.second.header;
     }
 
-    BlockFilter filter(m_filter_type, block, block_undo);
-
     size_t bytes_written = WriteFilterToDisk(m_next_filter_pos, filter);
     if (bytes_written == 0) return false;
 
@@ -420,15 +477,99 @@ bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* st
         return false;
     }
 
-    filters_out.resize(entries.size());
-    auto filter_pos_it = filters_out.begin();
+    std::vector<FlatFilePos> positions;
+    positions.reserve(entries.size());
     for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_pos_it)) {
-            return false;
+        positions.push_back(entry.pos);
+    }
+
+    filters_out.resize(entries.size());
+    return ReadFilterRecords(*m_filter_fileseq, positions,
+        [&](size_t i, const uint256& block_hash, std::vector<uint8_t>&& encoded_filter) {
+            filters_out[i] = BlockFilter(GetFilterType(), block_hash, std::move(encoded_filter));
+        });
+}
+
+void BlockFilterIndex::CacheFilter(const uint256& block_hash, SerializedFilter filter)
+{
+    AssertLockHeld(m_cs_filter_cache);
+
+    if (m_filter_cache_map.count(block_hash)) return;
+
+    m_filter_cache_bytes += filter->size();
+    m_filter_cache.emplace_front(block_hash, std::move(filter));
+    m_filter_cache_map.emplace(block_hash, m_filter_cache.begin());
+
+    while (m_filter_cache_bytes > m_filter_cache_max_bytes) {
+        const auto& [evicted_hash, evicted_filter] = m_filter_cache.back();
+        m_filter_cache_bytes -= evicted_filter->size();
+        m_filter_cache_map.erase(evicted_hash);
+        m_filter_cache.pop_back();
+    }
+}
+
+bool BlockFilterIndex::LookupSerializedFilterRange(int start_height, const CBlockIndex* stop_index,
+                                                   std::vector<SerializedFilter>& filters_out)
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: invalid start height %d for stop height %d",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    const size_t count{static_cast<size_t>(stop_index->nHeight - start_height + 1)};
+    filters_out.assign(count, nullptr);
+    std::vector<uint256> block_hashes(count);
+
+    // Serve the cached filters, and note the heights of the others. Filters
+    // are cached by block hash, so entries never go stale on a reorg.
+    int min_missing_height{stop_index->nHeight + 1};
+    int max_missing_height{-1};
+    {
+        LOCK(m_cs_filter_cache);
+        for (const CBlockIndex* block_index = stop_index;
+             block_index && block_index->nHeight >= start_height;
+             block_index = block_index->pprev) {
+            block_hashes[block_index->nHeight - start_height] = block_index->GetBlockHash();
+            auto it = m_filter_cache_map.find(block_hashes[block_index->nHeight - start_height]);
+            if (it == m_filter_cache_map.end()) {
+                min_missing_height = block_index->nHeight;
+                max_missing_height = std::max(max_missing_height, block_index->nHeight);
+                continue;
+            }
+            m_filter_cache.splice(m_filter_cache.begin(), m_filter_cache, it->second);
+            filters_out[block_index->nHeight - start_height] = it->second->second;
         }
-        ++filter_pos_it;
+    }
+    if (max_missing_height < 0) return true;
+
+    // Read the span of missing filters in one pass.
+    std::vector<DBVal> entries;
+    if (!LookupRange(*m_db, m_name, min_missing_height, stop_index->GetAncestor(max_missing_height), entries)) {
+        return false;
+    }
+    std::vector<FlatFilePos> positions;
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const size_t index = min_missing_height - start_height + i;
+        if (filters_out[index]) continue;
+        positions.push_back(entries[i].pos);
+        indexes.push_back(index);
+    }
+
+    const uint8_t filter_type_ser{static_cast<uint8_t>(GetFilterType())};
+    if (!ReadFilterRecords(*m_filter_fileseq, positions,
+            [&](size_t i, const uint256& block_hash, std::vector<uint8_t>&& encoded_filter) {
+                auto payload = std::make_shared<std::vector<unsigned char>>();
+                CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, *payload, 0, filter_type_ser, block_hash, encoded_filter};
+                filters_out[indexes[i]] = std::move(payload);
+            })) {
+        return false;
     }
 
+    LOCK(m_cs_filter_cache);
+    for (const size_t index : indexes) {
+        CacheFilter(block_hashes[index], filters_out[index]);
+    }
     return true;
 }
 
@@ -11,6 +11,10 @@
 #include <index/base.h>
 #include <util/hasher.h>
 
+#include <list>
+#include <memory>
+#include <unordered_map>
+
 /** Interval between compact filter checkpoints. See BIP 157. */
 static constexpr int CFCHECKPT_INTERVAL = 1000;
 
@@ -38,12 +42,36 @@ private:
     /** cache of block hash to filter header, to avoid disk access when responding to getcfcheckpt. */
     std::unordered_map<uint256, uint256, FilterHeaderHasher> m_headers_cache GUARDED_BY(m_cs_headers_cache);
 
+public:
+    /** A filter serialized as the payload of a cfilter message. */
+    using SerializedFilter = std::shared_ptr<const std::vector<unsigned char>>;
+
+private:
+    using FilterCacheList = std::list<std::pair<uint256, SerializedFilter>>;
+
+    /** limit on m_filter_cache_bytes, taken from the index's cache size */
+    const size_t m_filter_cache_max_bytes;
+    Mutex m_cs_filter_cache;
+    /** cache of serialized filters, most recently used first, to avoid disk access when many
+     *  peers request the same recent ranges with getcfilters. */
+    FilterCacheList m_filter_cache GUARDED_BY(m_cs_filter_cache);
+    /** entries of m_filter_cache by block hash */
+    std::unordered_map<uint256, FilterCacheList::iterator, FilterHeaderHasher> m_filter_cache_map GUARDED_BY(m_cs_filter_cache);
+    /** total payload size of the filters in m_filter_cache */
+    size_t m_filter_cache_bytes GUARDED_BY(m_cs_filter_cache){0};
+
+    void CacheFilter(const uint256& block_hash, SerializedFilter filter) EXCLUSIVE_LOCKS_REQUIRED(m_cs_filter_cache);
+
+    struct PreparedFilter;
+
 protected:
     bool Init() override;
 
     bool CommitInternal(CDBBatch& batch) override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
 
     bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
 
@@ -68,6 +96,14 @@ public:
     bool LookupFilterRange(int start_height, const CBlockIndex* stop_index,
                            std::vector<BlockFilter>& filters_out) const;
 
+    /**
+     * Get a range of filters between two heights on a chain, serialized as cfilter message
+     * payloads. Filters are served from a memory-bounded cache shared by all callers where
+     * possible; the others are read from disk in one pass and added to the cache.
+     */
+    bool LookupSerializedFilterRange(int start_height, const CBlockIndex* stop_index,
+                                     std::vector<SerializedFilter>& filters_out);
+
     /** Get a range of filter hashes between two heights on a chain. */
     bool LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
                                std::vector<uint256>& hashes_out) const;
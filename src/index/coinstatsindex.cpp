@@ -103,18 +103,75 @@ CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
     m_db = std::make_unique<CoinStatsIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
 }
 
-bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+// TODO: Deduplicate BIP30 related code
+static bool IsBIP30Block(const CBlockIndex* pindex)
 {
+    return (pindex->nHeight == 91722 && pindex->GetBlockHash() == uint256S("0x00000000000271a2dc26e7667f8419f2e15416dc6955e5a6c6cdf3f2574dd08e")) ||
+           (pindex->nHeight == 91812 && pindex->GetBlockHash() == uint256S("0x00000000000af0aed4792b1acee3d966af36cf5def14935db8de83d6f9306f2f"));
+}
+
+/**
+ * The undo data of a block and the hash of the coins it creates and spends,
+ * to be combined into the running MuHash in chain order.
+ */
+struct CoinStatsIndex::PreparedStats : public BaseIndex::PreparedBlock {
     CBlockUndo block_undo;
+    MuHash3072 muhash;
+};
+
+std::unique_ptr<BaseIndex::PreparedBlock> CoinStatsIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = std::make_unique<PreparedStats>();
+
+    // Ignore genesis block
+    if (pindex->nHeight == 0) return prepared;
+
+    if (!UndoReadFromDisk(prepared->block_undo, pindex)) {
+        return nullptr;
+    }
+
+    const bool is_bip30_block{IsBIP30Block(pindex)};
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const auto& tx{block.vtx.at(i)};
+
+        // Skip duplicate txid coinbase transactions (BIP30).
+        if (is_bip30_block && tx->IsCoinBase()) continue;
+
+        for (uint32_t j = 0; j < tx->vout.size(); ++j) {
+            const CTxOut& out{tx->vout[j]};
+            Coin coin{out, pindex->nHeight, tx->IsCoinBase()};
+            COutPoint outpoint{tx->GetHash(), j};
+
+            // Skip unspendable coins
+            if (coin.out.scriptPubKey.IsUnspendable()) continue;
+
+            prepared->muhash.Insert(MakeUCharSpan(TxOutSer(outpoint, coin)));
+        }
+
+        // The coinbase tx has no undo data since no former output is spent
+        if (!tx->IsCoinBase()) {
+            const auto& tx_undo{prepared->block_undo.vtxundo.at(i - 1)};
+
+            for (size_t j = 0; j < tx_undo.vprevout.size(); ++j) {
+                Coin coin{tx_undo.vprevout[j]};
+                COutPoint outpoint{tx->vin[j].prevout.hash, tx->vin[j].prevout.n};
+
+                prepared->muhash.Remove(MakeUCharSpan(TxOutSer(outpoint, coin)));
+            }
+        }
+    }
+    return prepared;
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    PreparedStats& stats = static_cast<PreparedStats&>(prepared);
+    const CBlockUndo& block_undo{stats.block_undo};
     const CAmount block_subsidy{GetBlockSubsidy(pindex->nHeight, Params().GetConsensus())};
     m_total_subsidy += block_subsidy;
 
     // Ignore genesis block
     if (pindex->nHeight > 0) {
-        if (!UndoReadFromDisk(block_undo, pindex)) {
-            return false;
-        }
-
         std::pair<uint256, DBVal> read_out;
         if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
             return false;
@@ -131,9 +188,7 @@ bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
             }
         }
 
-        // TODO: Deduplicate BIP30 related code
-        bool is_bip30_block{(pindex->nHeight == 91722 && pindex->GetBlockHash() == uint256S("0x00000000000271a2dc26e7667f8419f2e15416dc6955e5a6c6cdf3f2574dd08e")) ||
-                            (pindex->nHeight == 91812 && pindex->GetBlockHash() == uint256S("0x00000000000af0aed4792b1acee3d966af36cf5def14935db8de83d6f9306f2f"))};
+        const bool is_bip30_block{IsBIP30Block(pindex)};
 
         // Add the new utxos created from the block
         for (size_t i = 0; i < block.vtx.size(); ++i) {
@@ -146,41 +201,30 @@ bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
                 continue;
             }
 
-            for (uint32_t j = 0; j < tx->vout.size(); ++j) {
-                const CTxOut& out{tx->vout[j]};
-                Coin coin{out, pindex->nHeight, tx->IsCoinBase()};
-                COutPoint outpoint{tx->GetHash(), j};
-
+            for (const CTxOut& out : tx->vout) {
                 // Skip unspendable coins
-                if (coin.out.scriptPubKey.IsUnspendable()) {
-                    m_total_unspendable_amount += coin.out.nValue;
-                    m_total_unspendables_scripts += coin.out.nValue;
+                if (out.scriptPubKey.IsUnspendable()) {
+                    m_total_unspendable_amount += out.nValue;
+                    m_total_unspendables_scripts += out.nValue;
                     continue;
                 }
 
-                m_muhash.Insert(MakeUCharSpan(TxOutSer(outpoint, coin)));
-
                 if (tx->IsCoinBase()) {
-                    m_total_coinbase_amount += coin.out.nValue;
+                    m_total_coinbase_amount += out.nValue;
                 } else {
-                    m_total_new_outputs_ex_coinbase_amount += coin.out.nValue;
+                    m_total_new_outputs_ex_coinbase_amount += out.nValue;
                 }
 
                 ++m_transaction_output_count;
-                m_total_amount += coin.out.nValue;
-                m_bogo_size += GetBogoSize(coin.out.scriptPubKey);
+                m_total_amount += out.nValue;
+                m_bogo_size += GetBogoSize(out.scriptPubKey);
             }
 
             // The coinbase tx has no undo data since no former output is spent
             if (!tx->IsCoinBase()) {
                 const auto& tx_undo{block_undo.vtxundo.at(i - 1)};
 
-                for (size_t j = 0; j < tx_undo.vprevout.size(); ++j) {
-                    Coin coin{tx_undo.vprevout[j]};
-                    COutPoint outpoint{tx->vin[j].prevout.hash, tx->vin[j].prevout.n};
-
-                    m_muhash.Remove(MakeUCharSpan(TxOutSer(outpoint, coin)));
-
+                for (const Coin& coin : tx_undo.vprevout) {
                     m_total_prevout_spent_amount += coin.out.nValue;
 
                     --m_transaction_output_count;
@@ -218,6 +262,9 @@ bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
     value.second.total_unspendables_scripts = m_total_unspendables_scripts;
     value.second.total_unspendables_unclaimed_rewards = m_total_unspendables_unclaimed_rewards;
 
+    // The coins created and spent by the block were hashed by PrepareBlock
+    m_muhash *= stats.muhash;
+
     uint256 out;
     m_muhash.Finalize(out);
     value.second.muhash = out;
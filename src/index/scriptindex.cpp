@@ -0,0 +1,222 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <crypto/sha256.h>
+#include <index/scriptindex.h>
+#include <node/blockstorage.h>
+#include <script/script.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry per output, under the key
+ * [DB_SCRIPT_OUTPUT, SHA256(scriptPubKey), uint32 height (BE), txid, uint32 vout (BE)].
+ * The height and output index are big-endian so that the outputs of a script
+ * are iterated in chain order. The value holds the amount of the output and,
+ * once it is spent, the txid, input index and height of the spending
+ * transaction. Outputs that can never be spent (OP_RETURN) are not indexed.
+ */
+constexpr uint8_t DB_SCRIPT_OUTPUT{'o'};
+
+std::unique_ptr<ScriptIndex> g_script_index;
+
+namespace {
+
+struct DBKey {
+    uint256 script_hash;
+    int height;
+    COutPoint outpoint;
+
+    DBKey(const uint256& script_hash_in, int height_in, const COutPoint& outpoint_in) :
+        script_hash(script_hash_in), height(height_in), outpoint(outpoint_in) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_SCRIPT_OUTPUT);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        const uint8_t prefix{ser_readdata8(s)};
+        if (prefix != DB_SCRIPT_OUTPUT) {
+            throw std::ios_base::failure("Invalid format for scriptindex DB key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+struct DBVal {
+    CAmount value{0};
+    uint256 spending_txid;
+    uint32_t spending_vin{0};
+    int32_t spending_height{-1};
+
+    SERIALIZE_METHODS(DBVal, obj)
+    {
+        READWRITE(obj.value, obj.spending_txid, obj.spending_vin, obj.spending_height);
+    }
+};
+
+uint256 HashScript(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+} // namespace
+
+/** Access to the scriptindex database (indexes/scriptindex/) */
+class ScriptIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(gArgs.GetDataDirNet() / "indexes" / "scriptindex", n_cache_size, f_memory, f_wipe)
+    {}
+};
+
+/** The entries a block adds or updates, in the order they must be written. */
+struct ScriptIndex::PreparedEntries : public BaseIndex::PreparedBlock {
+    std::vector<std::pair<DBKey, DBVal>> entries;
+};
+
+ScriptIndex::ScriptIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<ScriptIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ScriptIndex::~ScriptIndex() {}
+
+std::unique_ptr<BaseIndex::PreparedBlock> ScriptIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = std::make_unique<PreparedEntries>();
+
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return prepared;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return nullptr;
+    }
+
+    // Outputs spent within the block are created by an earlier transaction,
+    // so writing the entries in transaction order leaves them marked spent.
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx{*block.vtx[i]};
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& tx_undo{block_undo.vtxundo.at(i - 1)};
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                const Coin& coin{tx_undo.vprevout.at(j)};
+                DBVal value;
+                value.value = coin.out.nValue;
+                value.spending_txid = tx.GetHash();
+                value.spending_vin = j;
+                value.spending_height = pindex->nHeight;
+                prepared->entries.emplace_back(DBKey{HashScript(coin.out.scriptPubKey), int(coin.nHeight), tx.vin[j].prevout}, value);
+            }
+        }
+        for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+            const CTxOut& out{tx.vout[j]};
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            DBVal value;
+            value.value = out.nValue;
+            prepared->entries.emplace_back(DBKey{HashScript(out.scriptPubKey), pindex->nHeight, COutPoint{tx.GetHash(), j}}, value);
+        }
+    }
+    return prepared;
+}
+
+bool ScriptIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    CDBBatch batch(*m_db);
+    for (const auto& [key, value] : static_cast<PreparedEntries&>(prepared).entries) {
+        batch.Write(key, value);
+    }
+    // Move the best block along with the entries, so that after an unclean
+    // shutdown the index never holds entries past its locator, which would
+    // not be rewound on a reorg.
+    m_db->WriteBestBlock(batch, WITH_LOCK(cs_main, return m_chainstate->m_chain.GetLocator(pindex)));
+    return m_db->WriteBatch(batch);
+}
+
+bool ScriptIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Undo the blocks from the tip down: erase the outputs each block created,
+    // and mark the outputs it spent from earlier blocks unspent again.
+    CDBBatch batch(*m_db);
+    const auto& consensus_params{Params().GetConsensus()};
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params) || !UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransaction& tx{*block.vtx[i]};
+            for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                const CTxOut& out{tx.vout[j]};
+                if (out.scriptPubKey.IsUnspendable()) continue;
+                batch.Erase(DBKey{HashScript(out.scriptPubKey), pindex->nHeight, COutPoint{tx.GetHash(), j}});
+            }
+            if (tx.IsCoinBase()) continue;
+            const CTxUndo& tx_undo{block_undo.vtxundo.at(i - 1)};
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                const Coin& coin{tx_undo.vprevout.at(j)};
+                if (int(coin.nHeight) == pindex->nHeight) continue;
+                DBVal value;
+                value.value = coin.out.nValue;
+                batch.Write(DBKey{HashScript(coin.out.scriptPubKey), int(coin.nHeight), tx.vin[j].prevout}, value);
+            }
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& ScriptIndex::GetDB() const { return *m_db; }
+
+bool ScriptIndex::LookupScript(const CScript& script, int start_height, const std::optional<COutPoint>& start_after, size_t count,
+                               bool unspent_only, std::vector<ScriptIndexEntry>& entries) const
+{
+    const uint256 script_hash{HashScript(script)};
+    start_height = std::max(start_height, 0);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBKey{script_hash, start_height, start_after.value_or(COutPoint{uint256(), 0})});
+
+    for (; db_it->Valid() && entries.size() < count; db_it->Next()) {
+        DBKey key{uint256(), 0, COutPoint()};
+        if (!db_it->GetKey(key) || key.script_hash != script_hash) break;
+        // The seek lands on start_after itself if it is still indexed.
+        if (start_after && key.height == start_height && key.outpoint == *start_after) continue;
+
+        DBVal value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s for output %s",
+                         __func__, GetName(), key.outpoint.ToString());
+        }
+        if (unspent_only && !value.spending_txid.IsNull()) continue;
+
+        ScriptIndexEntry& entry = entries.emplace_back();
+        entry.height = key.height;
+        entry.outpoint = key.outpoint;
+        entry.value = value.value;
+        entry.spending_txid = value.spending_txid;
+        entry.spending_vin = value.spending_vin;
+        entry.spending_height = value.spending_height;
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SCRIPTINDEX_H
+#define BITCOIN_INDEX_SCRIPTINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <optional>
+#include <vector>
+
+class CScript;
+
+/** Maximum number of outputs returned by a script history query */
+static constexpr size_t MAX_SCRIPT_HISTORY_COUNT{1000};
+
+/** An output paying to an indexed scriptPubKey, and the input spending it if any. */
+struct ScriptIndexEntry {
+    //! Height of the block that created the output
+    int height{0};
+    COutPoint outpoint;
+    CAmount value{0};
+    //! Null while the output is unspent
+    uint256 spending_txid;
+    uint32_t spending_vin{0};
+    int spending_height{-1};
+
+    bool IsSpent() const { return !spending_txid.IsNull(); }
+};
+
+/**
+ * ScriptIndex records, for every scriptPubKey on the active chain, the outputs
+ * paying to it and the inputs that spent them. Entries of a script are stored
+ * under the SHA256 of the script, ordered by the height of the block that
+ * created the output, so that the history of a script from a given height is
+ * a single range read.
+ */
+class ScriptIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    struct PreparedEntries;
+
+protected:
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "scriptindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ScriptIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ScriptIndex() override;
+
+    /// Look up the outputs paying to a script.
+    ///
+    /// @param[in]   script        The scriptPubKey to look up.
+    /// @param[in]   start_height  Skip outputs created below this height.
+    /// @param[in]   start_after   If set, also skip the outputs created at start_height up to and
+    ///                            including this one, so that the last output of a page, with its
+    ///                            height, continues the query.
+    /// @param[in]   count         Return at most this many outputs.
+    /// @param[in]   unspent_only  Only return outputs that are not spent on the indexed chain.
+    /// @param[out]  entries       The outputs, ordered by height, txid and output index.
+    /// @return  false on a database error
+    bool LookupScript(const CScript& script, int start_height, const std::optional<COutPoint>& start_after, size_t count,
+                      bool unspent_only, std::vector<ScriptIndexEntry>& entries) const;
+};
+
+/// The global scriptPubKey index. May be null.
+extern std::unique_ptr<ScriptIndex> g_script_index;
+
+#endif // BITCOIN_INDEX_SCRIPTINDEX_H
@@ -0,0 +1,151 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/spentindex.h>
+#include <node/blockstorage.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry per spent output, under the key
+ * [DB_SPENT_OUTPUT, txid, vout]. The value holds the txid, input index and
+ * height of the spending transaction and the value of the spent output.
+ */
+constexpr uint8_t DB_SPENT_OUTPUT{'s'};
+
+std::unique_ptr<SpentIndex> g_spent_index;
+
+namespace {
+
+struct DBVal {
+    uint256 spending_txid;
+    uint32_t spending_vin{0};
+    int32_t spending_height{-1};
+    CAmount value{0};
+
+    SERIALIZE_METHODS(DBVal, obj)
+    {
+        READWRITE(obj.spending_txid, obj.spending_vin, obj.spending_height, obj.value);
+    }
+};
+
+} // namespace
+
+/** Access to the spentindex database (indexes/spentindex/) */
+class SpentIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(gArgs.GetDataDirNet() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe)
+    {}
+};
+
+/** The outputs a block spends, with the inputs spending them. */
+struct SpentIndex::PreparedSpends : public BaseIndex::PreparedBlock {
+    std::vector<std::pair<COutPoint, DBVal>> spends;
+};
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+std::unique_ptr<BaseIndex::PreparedBlock> SpentIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = std::make_unique<PreparedSpends>();
+
+    // The genesis block and blocks with only a coinbase spend nothing.
+    if (block.vtx.size() <= 1) return prepared;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return nullptr;
+    }
+
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        const CTransaction& tx{*block.vtx[i]};
+        const CTxUndo& tx_undo{block_undo.vtxundo.at(i - 1)};
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            DBVal value;
+            value.spending_txid = tx.GetHash();
+            value.spending_vin = j;
+            value.spending_height = pindex->nHeight;
+            value.value = tx_undo.vprevout.at(j).out.nValue;
+            prepared->spends.emplace_back(tx.vin[j].prevout, value);
+        }
+    }
+    return prepared;
+}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    CDBBatch batch(*m_db);
+    for (const auto& [outpoint, value] : static_cast<PreparedSpends&>(prepared).spends) {
+        batch.Write(std::make_pair(DB_SPENT_OUTPUT, outpoint), value);
+    }
+    // Write the locator in the same batch, so that an unclean shutdown can't
+    // leave spends recorded past the best block, where Rewind won't erase them.
+    m_db->WriteBestBlock(batch, WITH_LOCK(cs_main, return m_chainstate->m_chain.GetLocator(pindex)));
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // An output is spent at most once on a chain, so erasing the outputs the
+    // disconnected blocks spent restores the index as of new_tip.
+    CDBBatch batch(*m_db);
+    const auto& consensus_params{Params().GetConsensus()};
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        for (const CTransactionRef& tx : block.vtx) {
+            if (tx->IsCoinBase()) continue;
+            for (const CTxIn& txin : tx->vin) {
+                batch.Erase(std::make_pair(DB_SPENT_OUTPUT, txin.prevout));
+            }
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& SpentIndex::GetDB() const { return *m_db; }
+
+bool SpentIndex::FindSpender(const COutPoint& outpoint, SpentIndexEntry& entry) const
+{
+    DBVal value;
+    if (!m_db->Read(std::make_pair(DB_SPENT_OUTPUT, outpoint), value)) {
+        return false;
+    }
+    entry.spending_txid = value.spending_txid;
+    entry.spending_vin = value.spending_vin;
+    entry.spending_height = value.spending_height;
+    entry.value = value.value;
+    return true;
+}
+
+bool SpentIndex::FindPrevoutValues(const CTransaction& tx, std::vector<CAmount>& values) const
+{
+    if (tx.IsCoinBase()) return false;
+
+    values.clear();
+    values.reserve(tx.vin.size());
+    for (uint32_t i = 0; i < tx.vin.size(); ++i) {
+        SpentIndexEntry entry;
+        if (!FindSpender(tx.vin[i].prevout, entry) ||
+            entry.spending_txid != tx.GetHash() || entry.spending_vin != i) {
+            return false;
+        }
+        values.push_back(entry.value);
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+/** The input spending an output, and the value of the output it spent. */
+struct SpentIndexEntry {
+    uint256 spending_txid;
+    uint32_t spending_vin{0};
+    int spending_height{-1};
+    //! Value of the spent output
+    CAmount value{0};
+};
+
+/**
+ * SpentIndex maps every outpoint spent on the active chain to the input that
+ * spent it. Each entry also carries the value of the spent output, so the
+ * inputs of a confirmed transaction can be valued without reading undo data.
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    struct PreparedSpends;
+
+protected:
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the input spending an output.
+    ///
+    /// @param[in]   outpoint  The output to look up.
+    /// @param[out]  entry     The spending input and the value of the output.
+    /// @return  true if the output is spent on the indexed chain
+    bool FindSpender(const COutPoint& outpoint, SpentIndexEntry& entry) const;
+
+    /// Look up the values of the outputs spent by a confirmed transaction.
+    ///
+    /// @param[in]   tx      A non-coinbase transaction in the indexed chain.
+    /// @param[out]  values  The value spent by each input of tx.
+    /// @return  true if every input of tx is indexed as spent by tx
+    bool FindPrevoutValues(const CTransaction& tx, std::vector<CAmount>& values) const;
+};
+
+/// The global spent output index. May be null.
+extern std::unique_ptr<SpentIndex> g_spent_index;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
@@ -211,19 +211,32 @@ bool TxIndex::Init()
     return BaseIndex::Init();
 }
 
-bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+/** Disk locations of the transactions of a block. */
+struct TxIndex::PreparedTxPos : public BaseIndex::PreparedBlock {
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+};
+
+std::unique_ptr<BaseIndex::PreparedBlock> TxIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
 {
+    auto prepared = std::make_unique<PreparedTxPos>();
+
     // Exclude genesis block transaction because outputs are not spendable.
-    if (pindex->nHeight == 0) return true;
+    if (pindex->nHeight == 0) return prepared;
 
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
-    vPos.reserve(block.vtx.size());
+    prepared->vPos.reserve(block.vtx.size());
     for (const auto& tx : block.vtx) {
-        vPos.emplace_back(tx->GetHash(), pos);
+        prepared->vPos.emplace_back(tx->GetHash(), pos);
         pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
     }
-    return m_db->WriteTxs(vPos);
+    return prepared;
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    if (pindex->nHeight == 0) return true;
+
+    return m_db->WriteTxs(static_cast<PreparedTxPos&>(prepared).vPos);
 }
 
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
@@ -22,11 +22,15 @@ protected:
 private:
     const std::unique_ptr<DB> m_db;
 
+    struct PreparedTxPos;
+
 protected:
     /// Override base class init to migrate from old database.
     bool Init() override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
 
     BaseIndex::DB& GetDB() const override;
 
@@ -8,6 +8,7 @@
 #include <amount.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <coins.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
@@ -23,6 +24,8 @@
 #include <util/system.h>
 
 #include <algorithm>
+#include <array>
+#include <unordered_map>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -55,6 +58,7 @@ void RegenerateCommitments(CBlock& block, ChainstateManager& chainman)
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    selection_threads = DEFAULT_BLOCK_SELECTION_THREADS;
 }
 
 BlockAssembler::BlockAssembler(CChainState& chainstate, const CTxMemPool& mempool, const CChainParams& params, const Options& options)
@@ -65,6 +69,7 @@ BlockAssembler::BlockAssembler(CChainState& chainstate, const CTxMemPool& mempoo
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    m_selection_threads = std::max(0, options.selection_threads);
 }
 
 static BlockAssembler::Options DefaultOptions()
@@ -79,6 +84,7 @@ static BlockAssembler::Options DefaultOptions()
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.selection_threads = gArgs.GetArg("-blockselectionthreads", DEFAULT_BLOCK_SELECTION_THREADS);
     return options;
 }
 
@@ -97,57 +103,204 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    m_packages_skipped = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+/**
+ * Flat copy of what package selection needs from the mempool, so that it can
+ * run without holding the mempool lock. Entry i's in-mempool parents are
+ * parents[parent_offsets[i]] to parents[parent_offsets[i + 1] - 1], and its
+ * children likewise.
+ */
+struct MempoolSnapshot {
+    std::vector<CTransactionRef> txs;
+    std::vector<CAmount> fees;
+    std::vector<CAmount> modified_fees;
+    std::vector<int64_t> sizes;
+    std::vector<int64_t> weights;
+    std::vector<int64_t> sigops_costs;
+    std::vector<uint64_t> ancestor_counts;
+    std::vector<uint64_t> ancestor_sizes;
+    std::vector<CAmount> ancestor_modified_fees;
+    std::vector<int64_t> ancestor_sigops_costs;
+    std::vector<uint32_t> parent_offsets;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> child_offsets;
+    std::vector<uint32_t> children;
+
+    explicit MempoolSnapshot(const CTxMemPool& mempool) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+
+    /** Turn the parent entries recorded while copying into indices, and fill in the children */
+    void LinkEntries();
+
+private:
+    //! Entry and parent entry addresses, only used to identify them after the mempool lock is released
+    std::vector<const CTxMemPoolEntry*> m_entries;
+    std::vector<const CTxMemPoolEntry*> m_parent_entries;
+};
+
+MempoolSnapshot::MempoolSnapshot(const CTxMemPool& mempool)
 {
-    int64_t nTimeStart = GetTimeMicros();
+    const size_t count = mempool.mapTx.size();
+    txs.reserve(count);
+    fees.reserve(count);
+    modified_fees.reserve(count);
+    sizes.reserve(count);
+    weights.reserve(count);
+    sigops_costs.reserve(count);
+    ancestor_counts.reserve(count);
+    ancestor_sizes.reserve(count);
+    ancestor_modified_fees.reserve(count);
+    ancestor_sigops_costs.reserve(count);
+    parent_offsets.reserve(count + 1);
+    m_entries.reserve(count);
+
+    parent_offsets.push_back(0);
+    for (const CTxMemPoolEntry& entry : mempool.mapTx) {
+        txs.push_back(entry.GetSharedTx());
+        fees.push_back(entry.GetFee());
+        modified_fees.push_back(entry.GetModifiedFee());
+        sizes.push_back(entry.GetTxSize());
+        weights.push_back(entry.GetTxWeight());
+        sigops_costs.push_back(entry.GetSigOpCost());
+        ancestor_counts.push_back(entry.GetCountWithAncestors());
+        ancestor_sizes.push_back(entry.GetSizeWithAncestors());
+        ancestor_modified_fees.push_back(entry.GetModFeesWithAncestors());
+        ancestor_sigops_costs.push_back(entry.GetSigOpCostWithAncestors());
+        m_entries.push_back(&entry);
+        for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+            m_parent_entries.push_back(&parent);
+        }
+        parent_offsets.push_back(m_parent_entries.size());
+    }
+}
 
-    resetBlock();
+void MempoolSnapshot::LinkEntries()
+{
+    std::unordered_map<const CTxMemPoolEntry*, uint32_t> indices;
+    indices.reserve(m_entries.size());
+    for (uint32_t i = 0; i < m_entries.size(); ++i) {
+        indices.emplace(m_entries[i], i);
+    }
+    parents.reserve(m_parent_entries.size());
+    for (const CTxMemPoolEntry* parent : m_parent_entries) {
+        parents.push_back(indices.at(parent));
+    }
 
-    pblocktemplate.reset(new CBlockTemplate());
+    // Count the children of each entry, then place them
+    child_offsets.assign(m_entries.size() + 1, 0);
+    for (const uint32_t parent : parents) {
+        ++child_offsets[parent + 1];
+    }
+    for (size_t i = 1; i < child_offsets.size(); ++i) {
+        child_offsets[i] += child_offsets[i - 1];
+    }
+    children.resize(parents.size());
+    std::vector<uint32_t> next_child(child_offsets.begin(), child_offsets.end() - 1);
+    for (uint32_t i = 0; i < m_entries.size(); ++i) {
+        for (uint32_t p = parent_offsets[i]; p < parent_offsets[i + 1]; ++p) {
+            children[next_child[parents[p]]++] = i;
+        }
+    }
 
-    if(!pblocktemplate.get())
-        return nullptr;
-    CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
+    m_entries.clear();
+    m_entries.shrink_to_fit();
+    m_parent_entries.clear();
+    m_parent_entries.shrink_to_fit();
+}
 
-    // Add dummy coinbase tx as first transaction
-    pblock->vtx.emplace_back();
-    pblocktemplate->vTxFees.push_back(-1); // updated at end
-    pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
-
-    LOCK2(cs_main, m_mempool.cs);
-    CBlockIndex* pindexPrev = m_chainstate.m_chain.Tip();
-    assert(pindexPrev != nullptr);
-    nHeight = pindexPrev->nHeight + 1;
-
-    pblock->nVersion = g_versionbitscache.ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
-    // -regtest only: allow overriding block.nVersion with
-    // -blockversion=N to test forking scenarios
-    if (chainparams.MineBlocksOnDemand())
-        pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
-
-    pblock->nTime = GetAdjustedTime();
-    const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
-
-    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                       ? nMedianTimePast
-                       : pblock->GetBlockTime();
-
-    // Decide whether to include witness transactions
-    // This is only needed in case the witness softfork activation is reverted
-    // (which would require a very deep reorganization).
-    // Note that the mempool would accept transactions with witness data before
-    // the deployment is active, but we would only ever mine blocks after activation
-    // unless there is a massive block reorganization with the witness softfork
-    // not activated.
-    // TODO: replace this with a call to main to assess validity of a mempool
-    // transaction (which in most cases can be a no-op).
-    fIncludeWitness = DeploymentActiveAfter(pindexPrev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_SEGWIT);
-
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+// Create the coinbase transaction paying fees and subsidy to scriptPubKeyIn,
+// with the witness commitment for the transactions in the template.
+static void CreateCoinbase(CBlockTemplate& block_template, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev, CAmount fees, const Consensus::Params& consensus_params)
+{
+    const int height = pindexPrev->nHeight + 1;
+    CBlock& block = block_template.block;
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = fees + GetBlockSubsidy(height, consensus_params);
+    coinbaseTx.vin[0].scriptSig = CScript() << height << OP_0;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    block_template.vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindexPrev, consensus_params);
+    block_template.vTxFees[0] = -fees;
+    block_template.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    WAIT_LOCK(cs_main, main_lock);
+    CBlockIndex* pindexPrev;
+    int nPackagesSelected;
+    int nDescendantsUpdated;
+    // Selecting from a snapshot releases cs_main, so the tip may move and the
+    // template has to be started over. Rather than retry indefinitely, fall
+    // back to selecting while holding the locks.
+    for (int attempt = 1; ; ++attempt) {
+        resetBlock();
+
+        pblocktemplate.reset(new CBlockTemplate());
+
+        if(!pblocktemplate.get())
+            return nullptr;
+        CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
+
+        // Add dummy coinbase tx as first transaction
+        pblock->vtx.emplace_back();
+        pblocktemplate->vTxFees.push_back(-1); // updated at end
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+
+        pindexPrev = m_chainstate.m_chain.Tip();
+        assert(pindexPrev != nullptr);
+        nHeight = pindexPrev->nHeight + 1;
+
+        pblock->nVersion = g_versionbitscache.ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+        // -regtest only: allow overriding block.nVersion with
+        // -blockversion=N to test forking scenarios
+        if (chainparams.MineBlocksOnDemand())
+            pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
+
+        pblock->nTime = GetAdjustedTime();
+        const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
+
+        nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                           ? nMedianTimePast
+                           : pblock->GetBlockTime();
+
+        // Decide whether to include witness transactions
+        // This is only needed in case the witness softfork activation is reverted
+        // (which would require a very deep reorganization).
+        // Note that the mempool would accept transactions with witness data before
+        // the deployment is active, but we would only ever mine blocks after activation
+        // unless there is a massive block reorganization with the witness softfork
+        // not activated.
+        // TODO: replace this with a call to main to assess validity of a mempool
+        // transaction (which in most cases can be a no-op).
+        fIncludeWitness = DeploymentActiveAfter(pindexPrev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_SEGWIT);
+
+        nPackagesSelected = 0;
+        nDescendantsUpdated = 0;
+        if (m_selection_threads > 0 && attempt <= MAX_BLOCK_SELECTION_ATTEMPTS) {
+            MempoolSnapshot snapshot{WITH_LOCK(m_mempool.cs, return MempoolSnapshot(m_mempool))};
+            LogPrint(BCLog::BENCH, "CreateNewBlock() mempool snapshot: %.2fms (%u txs)\n", 0.001 * (GetTimeMicros() - nTimeStart), snapshot.txs.size());
+            {
+                REVERSE_LOCK(main_lock);
+                snapshot.LinkEntries();
+                addPackageTxsFromSnapshot(snapshot, nPackagesSelected, nDescendantsUpdated);
+            }
+            if (pindexPrev == m_chainstate.m_chain.Tip()) break;
+            // The template would build on a stale tip.
+            LogPrint(BCLog::BENCH, "CreateNewBlock(): tip changed during transaction selection, retrying\n");
+        } else {
+            LOCK(m_mempool.cs);
+            addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+            break;
+        }
+    }
+    CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -155,16 +308,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     m_last_block_weight = nBlockWeight;
 
     // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    CreateCoinbase(*pblocktemplate, scriptPubKeyIn, pindexPrev, nFees, chainparams.GetConsensus());
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
@@ -173,7 +317,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     BlockValidationState state;
     if (!TestBlockValidity(state, chainparams, m_chainstate, *pblock, pindexPrev, false, false)) {
@@ -380,6 +523,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            m_packages_skipped = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -435,6 +579,285 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+namespace {
+/** How packages of equal feerate are ordered when selecting from a snapshot */
+enum class SelectionTieBreak {
+    TXID,         //!< By txid, as addPackageTxs does
+    FEWER_SIGOPS, //!< Fewer package sigops first, leaving room for more packages
+    SMALLER_SIZE, //!< Smaller package size first, packing more packages in
+};
+
+/** A package in the selection queue, stale once its entry's version moves on */
+struct QueuedPackage {
+    CAmount score_fee;
+    int64_t score_size;
+    int64_t size;
+    int64_t sigops_cost;
+    uint32_t index;
+    uint32_t version;
+};
+
+/** The transactions picked for one candidate template and their totals */
+struct PackageSelection {
+    std::vector<uint32_t> txs;
+    uint64_t weight;
+    uint64_t sigops_cost;
+    CAmount fees{0};
+    CAmount modified_fees{0};
+    bool packages_skipped{false};
+    int packages_selected{0};
+    int descendants_updated{0};
+};
+
+/**
+ * Greedily select packages by modified ancestor feerate from the snapshot,
+ * in the same way as BlockAssembler::addPackageTxs: the ancestor state of
+ * transactions left in the snapshot is updated as their ancestors are
+ * selected, and the best package is considered next.
+ */
+void SelectPackages(const MempoolSnapshot& snapshot, const std::vector<bool>& includable, SelectionTieBreak tie_break,
+                    uint64_t block_max_weight, const CFeeRate& block_min_fee_rate, PackageSelection& selection)
+{
+    const size_t count = snapshot.txs.size();
+    std::vector<uint64_t> ancestor_sizes{snapshot.ancestor_sizes};
+    std::vector<CAmount> ancestor_fees{snapshot.ancestor_modified_fees};
+    std::vector<int64_t> ancestor_sigops{snapshot.ancestor_sigops_costs};
+    std::vector<uint32_t> versions(count, 0);
+    std::vector<bool> in_block(count, false);
+    // Marks entries visited by the current graph walk
+    std::vector<uint64_t> visited(count, 0);
+    uint64_t epoch{0};
+
+    // Like CompareTxMemPoolEntryByAncestorFee, score packages by the lower of
+    // the transaction's own and its ancestor feerate.
+    const auto make_entry = [&](uint32_t i) {
+        QueuedPackage package{snapshot.modified_fees[i], snapshot.sizes[i], int64_t(ancestor_sizes[i]), ancestor_sigops[i], i, versions[i]};
+        if ((double)snapshot.modified_fees[i] * ancestor_sizes[i] > (double)ancestor_fees[i] * snapshot.sizes[i]) {
+            package.score_fee = ancestor_fees[i];
+            package.score_size = ancestor_sizes[i];
+        }
+        return package;
+    };
+    // Heap order, so returns whether b is the better package
+    const auto worse = [&](const QueuedPackage& a, const QueuedPackage& b) {
+        const double f1 = (double)a.score_fee * b.score_size;
+        const double f2 = (double)a.score_size * b.score_fee;
+        if (f1 != f2) return f1 < f2;
+        if (tie_break == SelectionTieBreak::FEWER_SIGOPS && a.sigops_cost != b.sigops_cost) return a.sigops_cost > b.sigops_cost;
+        if (tie_break == SelectionTieBreak::SMALLER_SIZE && a.size != b.size) return a.size > b.size;
+        return snapshot.txs[b.index]->GetHash() < snapshot.txs[a.index]->GetHash();
+    };
+
+    std::vector<QueuedPackage> queue;
+    queue.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        queue.push_back(make_entry(i));
+    }
+    std::make_heap(queue.begin(), queue.end(), worse);
+
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t consecutive_failed = 0;
+    std::vector<uint32_t> package;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> updated;
+
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), worse);
+        const QueuedPackage best = queue.back();
+        queue.pop_back();
+        const uint32_t index = best.index;
+        if (in_block[index] || best.version != versions[index]) continue;
+
+        if (ancestor_fees[index] < block_min_fee_rate.GetFee(ancestor_sizes[index])) {
+            // Everything else we might consider has a lower fee rate
+            break;
+        }
+
+        if (selection.weight + WITNESS_SCALE_FACTOR * ancestor_sizes[index] >= block_max_weight ||
+            selection.sigops_cost + ancestor_sigops[index] >= MAX_BLOCK_SIGOPS_COST) {
+            selection.packages_skipped = true;
+            ++consecutive_failed;
+            if (consecutive_failed > MAX_CONSECUTIVE_FAILURES && selection.weight > block_max_weight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        // Collect the ancestors that aren't in the block yet
+        package.clear();
+        ++epoch;
+        visited[index] = epoch;
+        stack.assign(1, index);
+        bool final{true};
+        while (!stack.empty()) {
+            const uint32_t i = stack.back();
+            stack.pop_back();
+            package.push_back(i);
+            final = final && includable[i];
+            for (uint32_t p = snapshot.parent_offsets[i]; p < snapshot.parent_offsets[i + 1]; ++p) {
+                const uint32_t parent = snapshot.parents[p];
+                if (in_block[parent] || visited[parent] == epoch) continue;
+                visited[parent] = epoch;
+                stack.push_back(parent);
+            }
+        }
+        if (!final) continue;
+
+        // This transaction will make it in; reset the failed counter.
+        consecutive_failed = 0;
+
+        // Parents have fewer ancestors than their children, which gives a
+        // valid order for the block.
+        std::sort(package.begin(), package.end(), [&](uint32_t a, uint32_t b) {
+            if (snapshot.ancestor_counts[a] != snapshot.ancestor_counts[b]) return snapshot.ancestor_counts[a] < snapshot.ancestor_counts[b];
+            return snapshot.txs[a]->GetHash() < snapshot.txs[b]->GetHash();
+        });
+        for (const uint32_t i : package) {
+            in_block[i] = true;
+            selection.txs.push_back(i);
+            selection.weight += snapshot.weights[i];
+            selection.sigops_cost += snapshot.sigops_costs[i];
+            selection.fees += snapshot.fees[i];
+            selection.modified_fees += snapshot.modified_fees[i];
+        }
+        ++selection.packages_selected;
+
+        // Update the ancestor state of descendants that are left out
+        updated.clear();
+        for (const uint32_t added : package) {
+            ++epoch;
+            stack.assign(1, added);
+            while (!stack.empty()) {
+                const uint32_t i = stack.back();
+                stack.pop_back();
+                for (uint32_t c = snapshot.child_offsets[i]; c < snapshot.child_offsets[i + 1]; ++c) {
+                    const uint32_t child = snapshot.children[c];
+                    if (visited[child] == epoch) continue;
+                    visited[child] = epoch;
+                    stack.push_back(child);
+                    // Only children in this package can be in the block already
+                    if (in_block[child]) continue;
+                    ++selection.descendants_updated;
+                    ancestor_sizes[child] -= snapshot.sizes[added];
+                    ancestor_fees[child] -= snapshot.modified_fees[added];
+                    ancestor_sigops[child] -= snapshot.sigops_costs[added];
+                    updated.push_back(child);
+                }
+            }
+        }
+        std::sort(updated.begin(), updated.end());
+        updated.erase(std::unique(updated.begin(), updated.end()), updated.end());
+        for (const uint32_t i : updated) {
+            ++versions[i];
+            queue.push_back(make_entry(i));
+            std::push_heap(queue.begin(), queue.end(), worse);
+        }
+    }
+}
+
+/** Closure selecting one candidate template on the block selection threads */
+class CandidateSelection
+{
+private:
+    const MempoolSnapshot* m_snapshot{nullptr};
+    const std::vector<bool>* m_includable{nullptr};
+    SelectionTieBreak m_tie_break{SelectionTieBreak::TXID};
+    uint64_t m_block_max_weight{0};
+    CFeeRate m_block_min_fee_rate;
+    PackageSelection* m_selection{nullptr};
+
+public:
+    CandidateSelection() = default;
+    CandidateSelection(const MempoolSnapshot& snapshot, const std::vector<bool>& includable, SelectionTieBreak tie_break,
+                       uint64_t block_max_weight, const CFeeRate& block_min_fee_rate, PackageSelection& selection) :
+        m_snapshot(&snapshot), m_includable(&includable), m_tie_break(tie_break),
+        m_block_max_weight(block_max_weight), m_block_min_fee_rate(block_min_fee_rate), m_selection(&selection) { }
+
+    bool operator()()
+    {
+        SelectPackages(*m_snapshot, *m_includable, m_tie_break, m_block_max_weight, m_block_min_fee_rate, *m_selection);
+        return true;
+    }
+
+    void swap(CandidateSelection& other)
+    {
+        std::swap(m_snapshot, other.m_snapshot);
+        std::swap(m_includable, other.m_includable);
+        std::swap(m_tie_break, other.m_tie_break);
+        std::swap(m_block_max_weight, other.m_block_max_weight);
+        std::swap(m_block_min_fee_rate, other.m_block_min_fee_rate);
+        std::swap(m_selection, other.m_selection);
+    }
+};
+} // namespace
+
+/** Each candidate is a long job, so hand them out one at a time. */
+static CCheckQueue<CandidateSelection> selectionqueue(1);
+
+void StartBlockSelectionThreads(int threads_num)
+{
+    selectionqueue.StartWorkerThreads(threads_num, "blocksel");
+}
+
+void StopBlockSelectionThreads()
+{
+    selectionqueue.StopWorkerThreads();
+}
+
+void BlockAssembler::addPackageTxsFromSnapshot(const MempoolSnapshot& snapshot, int& nPackagesSelected, int& nDescendantsUpdated)
+{
+    // Transaction-level checks, as in TestPackageTransactions
+    std::vector<bool> includable(snapshot.txs.size());
+    for (size_t i = 0; i < snapshot.txs.size(); ++i) {
+        const CTransaction& tx = *snapshot.txs[i];
+        includable[i] = IsFinalTx(tx, nHeight, nLockTimeCutoff) && (fIncludeWitness || !tx.HasWitness());
+    }
+
+    const std::array<SelectionTieBreak, MAX_BLOCK_SELECTION_CANDIDATES> tie_breaks{
+        SelectionTieBreak::TXID, SelectionTieBreak::FEWER_SIGOPS, SelectionTieBreak::SMALLER_SIZE};
+    const size_t num_candidates = std::min<size_t>(m_selection_threads, tie_breaks.size());
+    std::vector<PackageSelection> candidates(num_candidates);
+    for (PackageSelection& candidate : candidates) {
+        candidate.weight = nBlockWeight;
+        candidate.sigops_cost = nBlockSigOpsCost;
+    }
+    std::vector<CandidateSelection> selections;
+    for (size_t i = 0; i < num_candidates; ++i) {
+        selections.emplace_back(snapshot, includable, tie_breaks[i], nBlockMaxWeight, blockMinFeeRate, candidates[i]);
+    }
+    // The calling thread selects candidates as well, so this also works
+    // without any selection threads running.
+    CCheckQueueControl<CandidateSelection> control(&selectionqueue);
+    control.Add(selections);
+    control.Wait();
+
+    // Keep the candidate with the highest fees, preferring earlier ones on ties
+    const PackageSelection* best = &candidates[0];
+    for (const PackageSelection& candidate : candidates) {
+        if (candidate.modified_fees > best->modified_fees) best = &candidate;
+    }
+
+    const bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+    for (const uint32_t i : best->txs) {
+        pblocktemplate->block.vtx.emplace_back(snapshot.txs[i]);
+        pblocktemplate->vTxFees.push_back(snapshot.fees[i]);
+        pblocktemplate->vTxSigOpsCost.push_back(snapshot.sigops_costs[i]);
+        if (fPrintPriority) {
+            LogPrintf("fee %s txid %s\n",
+                      CFeeRate(snapshot.modified_fees[i], snapshot.sizes[i]).ToString(),
+                      snapshot.txs[i]->GetHash().ToString());
+        }
+    }
+    nBlockTx += best->txs.size();
+    nBlockWeight = best->weight;
+    nBlockSigOpsCost = best->sigops_cost;
+    nFees += best->fees;
+    m_packages_skipped = best->packages_skipped;
+    nPackagesSelected += best->packages_selected;
+    nDescendantsUpdated += best->descendants_updated;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -453,3 +876,156 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+BlockTemplateCache::BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params, const CScript& coinbase_script)
+    : m_mempool(mempool),
+      m_chainparams(params),
+      m_coinbase_script(coinbase_script)
+{
+}
+
+void BlockTemplateCache::Invalidate()
+{
+    m_template.reset();
+    m_txids.clear();
+}
+
+bool BlockTemplateCache::NextNotification(uint64_t mempool_sequence)
+{
+    // Without a template there is nothing to update, and notifications from
+    // before the template was assembled are already reflected in it.
+    if (!m_template || mempool_sequence < m_next_sequence) return false;
+    // A gap means we missed a change, e.g. a removal for a block.
+    if (mempool_sequence != m_next_sequence) {
+        Invalidate();
+        return false;
+    }
+    ++m_next_sequence;
+    ++m_transactions_updated;
+    return true;
+}
+
+void BlockTemplateCache::AppendTransaction(const CTransactionRef& tx)
+{
+    const std::optional<CTxMemPool::txiter> it = m_mempool.GetIter(tx->GetHash());
+    if (!it) {
+        // Already removed again; we'll hear about it, but can't tell now
+        // whether it would have qualified.
+        Invalidate();
+        return;
+    }
+    const CTxMemPoolEntry& entry = **it;
+    for (const CTxIn& txin : tx->vin) {
+        if (!m_txids.count(txin.prevout.hash) && m_mempool.GetIter(txin.prevout.hash)) {
+            // A parent was left out of the template, so this transaction can
+            // only be included as part of a package.
+            Invalidate();
+            return;
+        }
+    }
+
+    // With all its parents in the block, the transaction is a package of its
+    // own, which BlockAssembler::addPackageTxs would have left out if its
+    // feerate is too low or it isn't final, without affecting other packages.
+    if (entry.GetModifiedFee() < m_block_min_fee_rate.GetFee(entry.GetTxSize())) return;
+    if (!IsFinalTx(*tx, m_height, m_lock_time_cutoff) || (!m_include_witness && tx->HasWitness())) return;
+
+    // When space is short, it might have displaced other packages.
+    if (m_packages_skipped ||
+        m_block_weight + WITNESS_SCALE_FACTOR * entry.GetTxSize() >= m_block_max_weight ||
+        m_block_sigops_cost + entry.GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST) {
+        Invalidate();
+        return;
+    }
+
+    m_template->block.vtx.emplace_back(entry.GetSharedTx());
+    m_template->vTxFees.push_back(entry.GetFee());
+    m_template->vTxSigOpsCost.push_back(entry.GetSigOpCost());
+    m_block_weight += entry.GetTxWeight();
+    m_block_sigops_cost += entry.GetSigOpCost();
+    m_fees += entry.GetFee();
+    m_txids.insert(tx->GetHash());
+    m_coinbase_stale = true;
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    LOCK2(m_mempool.cs, m_mutex);
+    if (!NextNotification(mempool_sequence)) return;
+    AppendTransaction(tx);
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    LOCK(m_mutex);
+    if (!NextNotification(mempool_sequence)) return;
+    if (m_txids.count(tx->GetHash())) Invalidate();
+}
+
+void BlockTemplateCache::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    LOCK(m_mutex);
+    Invalidate();
+}
+
+void BlockTemplateCache::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    LOCK(m_mutex);
+    Invalidate();
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::CreateNewBlock(CChainState& chainstate)
+{
+    uint64_t sequence;
+    unsigned int transactions_updated;
+    {
+        LOCK(m_mempool.cs);
+        sequence = m_mempool.GetSequence();
+        transactions_updated = m_mempool.GetTransactionsUpdated();
+    }
+
+    BlockAssembler assembler(chainstate, m_mempool, m_chainparams);
+    std::unique_ptr<CBlockTemplate> block_template = assembler.CreateNewBlock(m_coinbase_script);
+
+    LOCK2(m_mempool.cs, m_mutex);
+    Invalidate();
+    // Only cache the template if we can tell which mempool state it reflects.
+    if (!block_template || m_mempool.GetSequence() != sequence || m_mempool.GetTransactionsUpdated() != transactions_updated) {
+        return block_template;
+    }
+    m_template = std::make_unique<CBlockTemplate>(*block_template);
+    for (const CTransactionRef& tx : m_template->block.vtx) {
+        m_txids.insert(tx->GetHash());
+    }
+    m_coinbase_stale = false;
+    m_next_sequence = sequence;
+    m_transactions_updated = transactions_updated;
+    m_block_weight = assembler.nBlockWeight;
+    m_block_sigops_cost = assembler.nBlockSigOpsCost;
+    m_fees = assembler.nFees;
+    m_packages_skipped = assembler.m_packages_skipped;
+    m_block_max_weight = assembler.nBlockMaxWeight;
+    m_block_min_fee_rate = assembler.blockMinFeeRate;
+    m_height = assembler.nHeight;
+    m_lock_time_cutoff = assembler.nLockTimeCutoff;
+    m_include_witness = assembler.fIncludeWitness;
+    return block_template;
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::GetBlockTemplate(const CBlockIndex* tip)
+{
+    LOCK2(m_mempool.cs, m_mutex);
+    if (!m_template || m_template->block.hashPrevBlock != tip->GetBlockHash()) return nullptr;
+    // Notifications still in flight, or changes that aren't notified, such
+    // as fee prioritisation.
+    if (m_mempool.GetSequence() != m_next_sequence || m_mempool.GetTransactionsUpdated() != m_transactions_updated) {
+        return nullptr;
+    }
+    if (m_coinbase_stale) {
+        CreateCoinbase(*m_template, m_coinbase_script, tip, m_fees, m_chainparams.GetConsensus());
+        m_coinbase_stale = false;
+    }
+    BlockAssembler::m_last_block_num_txs = m_template->block.vtx.size() - 1;
+    BlockAssembler::m_last_block_weight = m_block_weight;
+    return std::make_unique<CBlockTemplate>(*m_template);
+}
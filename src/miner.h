@@ -7,23 +7,34 @@
 #define BITCOIN_MINER_H
 
 #include <primitives/block.h>
+#include <script/script.h>
+#include <sync.h>
 #include <txmempool.h>
+#include <util/hasher.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <memory>
 #include <optional>
 #include <stdint.h>
+#include <unordered_set>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
 class CBlockIndex;
 class CChainParams;
-class CScript;
+struct MempoolSnapshot;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blockselectionthreads, 0 selects transactions while holding the mempool lock */
+static const int DEFAULT_BLOCK_SELECTION_THREADS = 0;
+/** Maximum number of candidate templates compared when selecting from a mempool snapshot */
+static const int MAX_BLOCK_SELECTION_CANDIDATES = 3;
+/** Number of times a template is selected from a mempool snapshot before selecting under the locks, if the tip keeps moving */
+static const int MAX_BLOCK_SELECTION_ATTEMPTS = 2;
 
 struct CBlockTemplate
 {
@@ -133,6 +144,8 @@ private:
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    //! Number of candidate templates to select from a mempool snapshot, or 0 to select under the mempool lock
+    int m_selection_threads;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -140,6 +153,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    //! Whether a package with a high enough feerate was left out because it didn't fit
+    bool m_packages_skipped;
 
     // Chain context for the block
     int nHeight;
@@ -153,18 +168,23 @@ public:
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        int selection_threads;
     };
 
     explicit BlockAssembler(CChainState& chainstate, const CTxMemPool& mempool, const CChainParams& params);
     explicit BlockAssembler(CChainState& chainstate, const CTxMemPool& mempool, const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /** Construct a new block template with coinbase to scriptPubKeyIn. When
+      * selecting from a mempool snapshot, cs_main is released during the
+      * selection, so callers shouldn't hold it. */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
     inline static std::optional<int64_t> m_last_block_num_txs{};
     inline static std::optional<int64_t> m_last_block_weight{};
 
 private:
+    friend class BlockTemplateCache;
+
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
@@ -196,6 +216,79 @@ private:
       * state updated assuming given transactions are inBlock. Returns number
       * of updated descendants. */
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+
+    /** Add transactions based on feerate including unconfirmed ancestors, from
+      * a snapshot of the mempool so the mempool lock needn't be held. Up to
+      * m_selection_threads candidate templates, differing in how packages of
+      * equal feerate are ordered, are selected concurrently and the one with
+      * the highest fees is used. Increments nPackagesSelected /
+      * nDescendantsUpdated with corresponding statistics. */
+    void addPackageTxsFromSnapshot(const MempoolSnapshot& snapshot, int& nPackagesSelected, int& nDescendantsUpdated);
+};
+
+/**
+ * Keeps the block template for the next block up to date as transactions
+ * enter the mempool, so that getblocktemplate doesn't need to assemble a new
+ * one from scratch when the mempool has changed.
+ *
+ * A template built by CreateNewBlock is cached, and transactions announced
+ * through TransactionAddedToMempool are appended to it when that gives the
+ * same set of transactions as assembling a new template would: all their
+ * in-mempool parents are in the template, and no package was left out of it
+ * for lack of space. Any other change to the mempool or the chain (removal of
+ * a transaction in the template, a transaction that doesn't qualify, fee
+ * prioritisation, a new block) drops the cached template, and the next
+ * caller assembles a new one.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+private:
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const CScript m_coinbase_script;
+
+    mutable Mutex m_mutex;
+    //! The cached template, or nullptr if none is up to date.
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    std::unordered_set<uint256, SaltedTxidHasher> m_txids GUARDED_BY(m_mutex);
+    //! Whether the coinbase and witness commitment need updating for appended transactions
+    bool m_coinbase_stale GUARDED_BY(m_mutex){false};
+    //! Mempool sequence number of the next notification to apply
+    uint64_t m_next_sequence GUARDED_BY(m_mutex){0};
+    //! Expected CTxMemPool::GetTransactionsUpdated() once all notifications so far are applied
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+
+    // Block resources and context of the cached template, as in BlockAssembler
+    uint64_t m_block_weight GUARDED_BY(m_mutex){0};
+    uint64_t m_block_sigops_cost GUARDED_BY(m_mutex){0};
+    CAmount m_fees GUARDED_BY(m_mutex){0};
+    bool m_packages_skipped GUARDED_BY(m_mutex){false};
+    unsigned int m_block_max_weight GUARDED_BY(m_mutex){0};
+    CFeeRate m_block_min_fee_rate GUARDED_BY(m_mutex);
+    int m_height GUARDED_BY(m_mutex){0};
+    int64_t m_lock_time_cutoff GUARDED_BY(m_mutex){0};
+    bool m_include_witness GUARDED_BY(m_mutex){false};
+
+    void Invalidate() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Advance to the notification with the given sequence number, returning false if it's not to be applied. */
+    bool NextNotification(uint64_t mempool_sequence) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void AppendTransaction(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs, m_mutex);
+
+protected:
+    // CValidationInterface
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
+
+public:
+    BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params, const CScript& coinbase_script);
+
+    /** Assemble a new block template from scratch and cache it */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(CChainState& chainstate) LOCKS_EXCLUDED(m_mempool.cs, m_mutex);
+
+    /** Return a copy of the cached template if it is up to date with tip and the mempool, nullptr otherwise */
+    std::unique_ptr<CBlockTemplate> GetBlockTemplate(const CBlockIndex* tip) LOCKS_EXCLUDED(m_mempool.cs, m_mutex);
 };
 
 /** Modify the extranonce in a block */
@@ -205,4 +298,9 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 /** Update an old GenerateCoinbaseCommitment from CreateNewBlock after the block txs have changed */
 void RegenerateCommitments(CBlock& block, ChainstateManager& chainman);
 
+/** Run instances of the threads selecting candidate templates from mempool snapshots */
+void StartBlockSelectionThreads(int threads_num);
+/** Stop all of the block selection threads */
+void StopBlockSelectionThreads();
+
 #endif // BITCOIN_MINER_H
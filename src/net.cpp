@@ -10,6 +10,7 @@
 #include <net.h>
 
 #include <banman.h>
+#include <checkqueue.h>
 #include <clientversion.h>
 #include <compat.h>
 #include <consensus/consensus.h>
@@ -42,6 +43,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <algorithm>
 #include <array>
 #include <cstdint>
@@ -98,6 +103,11 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifdef USE_EPOLL
+/** Maximum number of events returned by a single epoll_wait() call. Further events are returned by the next call. */
+static constexpr int MAX_EPOLL_EVENTS = 1024;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -1205,6 +1215,7 @@ void CConnman::CreateNodeFromAcceptedSocket(SOCKET hSocket,
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(*pnode);
     }
 
     // We received a new connection, harvest entropy from the time (and our peer count)
@@ -1392,6 +1403,103 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
+void CConnman::InitSocketEvents()
+{
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("Failed to create epoll instance, falling back to poll(): %s\n", NetworkErrorString(WSAGetLastError()));
+        return;
+    }
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        // Level-triggered, as only one connection is accepted per iteration.
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = const_cast<ListenSocket*>(&hListenSocket);
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("Failed to register listening socket with epoll, falling back to poll(): %s\n", NetworkErrorString(WSAGetLastError()));
+            CloseSocketEvents();
+            return;
+        }
+    }
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode& node)
+{
+#ifdef USE_EPOLL
+    if (m_epoll_fd == -1) return;
+    LOCK(node.cs_hSocket);
+    if (node.hSocket == INVALID_SOCKET) return;
+    // Registered once the node is in vNodes, so that no event is reported
+    // before SocketHandler() can see the node. The socket stays registered
+    // until it is closed, which removes it from the epoll instance before the
+    // node can be deleted, so events always refer to a live node.
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = &node;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, node.hSocket, &event) != 0) {
+        LogPrint(BCLog::NET, "failed to register socket with epoll for peer=%d: %s\n", node.GetId(), NetworkErrorString(WSAGetLastError()));
+        node.fDisconnect = true;
+    }
+#endif
+}
+
+void CConnman::ResumeReceive(CNode& node)
+{
+#ifdef USE_EPOLL
+    if (m_epoll_fd == -1) return;
+    LOCK(node.cs_hSocket);
+    if (node.hSocket == INVALID_SOCKET) return;
+    // Data that arrived while the node was paused raised its only edge then,
+    // and SocketHandler() may be waiting in epoll_wait() with nothing else to
+    // report. Modifying the registration reports the socket again if it is
+    // ready, which wakes the wait.
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = &node;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, node.hSocket, &event) != 0) {
+        LogPrint(BCLog::NET, "failed to re-arm socket with epoll for peer=%d: %s\n", node.GetId(), NetworkErrorString(WSAGetLastError()));
+    }
+#endif
+}
+
+void CConnman::CloseSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+    // Only called once the nodes are gone, so there are no references left
+    // to release.
+    m_sock_pending_nodes.clear();
+#endif
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::vector<const ListenSocket*>& listen_ready, std::map<CNode*, uint32_t>& nodes_ready)
+{
+    // Don't wait if a node can still make progress on readiness reported earlier.
+    const int timeout = m_sock_pending_nodes.empty() ? SELECT_TIMEOUT_MILLISECONDS : 0;
+    std::array<struct epoll_event, MAX_EPOLL_EVENTS> events;
+    const int num_events = epoll_wait(m_epoll_fd, events.data(), events.size(), timeout);
+
+    if (interruptNet) return;
+
+    for (int i = 0; i < num_events; ++i) {
+        const void* ptr = events[i].data.ptr;
+        const auto listen_it = std::find_if(vhListenSocket.begin(), vhListenSocket.end(),
+                                            [ptr](const ListenSocket& listen_socket) { return &listen_socket == ptr; });
+        if (listen_it != vhListenSocket.end()) {
+            listen_ready.push_back(&*listen_it);
+        } else {
+            nodes_ready[static_cast<CNode*>(events[i].data.ptr)] |= events[i].events;
+        }
+    }
+}
+#endif
+
 #ifdef USE_POLL
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
@@ -1512,6 +1620,12 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 
 void CConnman::SocketHandler()
 {
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        SocketHandlerEpoll();
+        return;
+    }
+#endif
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
 
@@ -1543,9 +1657,6 @@ void CConnman::SocketHandler()
         if (interruptNet)
             return;
 
-        //
-        // Receive
-        //
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
@@ -1557,74 +1668,164 @@ void CConnman::SocketHandler()
             sendSet = send_set.count(pnode->hSocket) > 0;
             errorSet = error_set.count(pnode->hSocket) > 0;
         }
-        if (recvSet || errorSet)
-        {
-            // typical socket buffer is 8K-64K
-            uint8_t pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, (char*)pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        SocketHandlerNode(*pnode, recvSet, sendSet, errorSet);
+
+        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
+    }
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodesCopy)
+            pnode->Release();
+    }
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketHandlerEpoll()
+{
+    std::vector<const ListenSocket*> listen_ready;
+    std::map<CNode*, uint32_t> nodes_ready;
+    SocketEventsEpoll(listen_ready, nodes_ready);
+
+    if (interruptNet) return;
+
+    for (const ListenSocket* listen_socket : listen_ready) {
+        AcceptConnection(*listen_socket);
+    }
+
+    // Service the nodes with new events, and those with readiness left over
+    // from the last iteration, which still hold the reference taken then.
+    // Nodes are only deleted by this thread, so the ones reported by epoll
+    // can be referenced without cs_vNodes.
+    for (const auto& [pnode, events] : nodes_ready) {
+        pnode->AddRef();
+    }
+    for (CNode* pnode : m_sock_pending_nodes) {
+        if (!nodes_ready.emplace(pnode, 0).second) pnode->Release();
+    }
+    m_sock_pending_nodes.clear();
+
+    std::vector<CNode*> nodes_done;
+    for (const auto& [pnode, events] : nodes_ready) {
+        if (interruptNet || WITH_LOCK(pnode->cs_hSocket, return pnode->hSocket == INVALID_SOCKET)) {
+            nodes_done.push_back(pnode);
+            continue;
+        }
+
+        // Edge-triggered events are only reported when the socket becomes
+        // readable or writable, so remember its readiness until a read
+        // would block or a write is short. Apply the same
+        // preference for draining the send buffer as GenerateSelectSet().
+        pnode->m_sock_readable |= (events & EPOLLIN) != 0;
+        pnode->m_sock_writable |= (events & EPOLLOUT) != 0;
+        bool send_pending = WITH_LOCK(pnode->cs_vSend, return !pnode->vSendMsg.empty());
+        SocketHandlerNode(*pnode,
+                          /* recv_ready */ !send_pending && !pnode->fPauseRecv && pnode->m_sock_readable,
+                          /* send_ready */ send_pending && pnode->m_sock_writable,
+                          /* error */ (events & (EPOLLERR | EPOLLHUP)) != 0);
+
+        send_pending = WITH_LOCK(pnode->cs_vSend, return !pnode->vSendMsg.empty());
+        if ((send_pending && pnode->m_sock_writable) || (!send_pending && !pnode->fPauseRecv && pnode->m_sock_readable)) {
+            m_sock_pending_nodes.push_back(pnode);
+        } else {
+            nodes_done.push_back(pnode);
+        }
+    }
+
+    // Inactivity is measured in seconds, so checking every node more often
+    // than once a second gains nothing.
+    const int64_t now = GetTimeSeconds();
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : nodes_done) {
+            pnode->Release();
+        }
+        if (now != m_last_inactivity_check) {
+            m_last_inactivity_check = now;
+            for (CNode* pnode : vNodes) {
+                if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
             }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(Span<const uint8_t>(pchBuf, nBytes), notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
+        }
+    }
+}
+#endif
+
+void CConnman::SocketHandlerNode(CNode& node, bool recv_ready, bool send_ready, bool error)
+{
+    if (recv_ready || error)
+    {
+        // typical socket buffer is 8K-64K
+        uint8_t pchBuf[0x10000];
+        int nBytes = 0;
+        {
+            LOCK(node.cs_hSocket);
+            if (node.hSocket == INVALID_SOCKET)
+                return;
+            nBytes = recv(node.hSocket, (char*)pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        }
+        if (nBytes > 0)
+        {
+            bool notify = false;
+            if (!node.ReceiveMsgBytes(Span<const uint8_t>(pchBuf, nBytes), notify))
+                node.CloseSocketDisconnect();
+            RecordBytesRecv(nBytes);
+            if (notify) {
+                size_t nSizeAdded = 0;
+                auto it(node.vRecvMsg.begin());
+                for (; it != node.vRecvMsg.end(); ++it) {
+                    // vRecvMsg contains only completed CNetMessage
+                    // the single possible partially deserialized message are held by TransportDeserializer
+                    nSizeAdded += it->m_raw_message_size;
                 }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+                {
+                    LOCK(node.cs_vProcessMsg);
+                    node.vProcessMsg.splice(node.vProcessMsg.end(), node.vRecvMsg, node.vRecvMsg.begin(), it);
+                    node.nProcessQueueSize += nSizeAdded;
+                    node.fPauseRecv = node.nProcessQueueSize > nReceiveFloodSize;
                 }
-                pnode->CloseSocketDisconnect();
+                WakeMessageHandler();
+            }
+        }
+        else if (nBytes == 0)
+        {
+            // socket closed gracefully
+            if (!node.fDisconnect) {
+                LogPrint(BCLog::NET, "socket closed for peer=%d\n", node.GetId());
             }
-            else if (nBytes < 0)
+            node.CloseSocketDisconnect();
+        }
+        else if (nBytes < 0)
+        {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
             {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
+                if (!node.fDisconnect) {
+                    LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", node.GetId(), NetworkErrorString(nErr));
                 }
+                node.CloseSocketDisconnect();
             }
+#ifdef USE_EPOLL
+            // Only a read that would block shows the socket has been
+            // drained. A short read doesn't, as the end of the stream may
+            // have arrived together with the data without another event.
+            if (nErr == WSAEWOULDBLOCK) node.m_sock_readable = false;
+#endif
         }
+    }
 
-        if (sendSet) {
-            // Send data
-            size_t bytes_sent = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
-            if (bytes_sent) RecordBytesSent(bytes_sent);
+    if (send_ready) {
+        // Send data
+        size_t bytes_sent;
+        {
+            LOCK(node.cs_vSend);
+            bytes_sent = SocketSendData(node);
+#ifdef USE_EPOLL
+            // Data left in the queue means a short write, so the send buffer is
+            // full and another event will be raised once it has space again.
+            if (!node.vSendMsg.empty()) node.m_sock_writable = false;
+#endif
         }
-
-        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
-    }
-    {
-        LOCK(cs_vNodes);
-        for (CNode* pnode : vNodesCopy)
-            pnode->Release();
+        if (bytes_sent) RecordBytesSent(bytes_sent);
     }
 }
 
@@ -2229,6 +2430,91 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(*pnode);
+    }
+}
+
+/** Handles the messages of one node on a message handler worker thread. */
+struct CConnman::MessageHandlerJob {
+    CConnman* m_connman{nullptr};
+    CNode* m_node{nullptr};
+    std::atomic<bool>* m_more_work{nullptr};
+
+    MessageHandlerJob() = default;
+    MessageHandlerJob(CConnman& connman, CNode& node, std::atomic<bool>& more_work)
+        : m_connman(&connman), m_node(&node), m_more_work(&more_work) {}
+
+    bool operator()()
+    {
+        if (m_connman->flagInterruptMsgProc) return true;
+        if (m_connman->HandleNodeMessages(*m_node)) *m_more_work = true;
+        return true;
+    }
+
+    void swap(MessageHandlerJob& other) noexcept
+    {
+        std::swap(m_connman, other.m_connman);
+        std::swap(m_node, other.m_node);
+        std::swap(m_more_work, other.m_more_work);
+    }
+};
+
+bool CConnman::HandleNodeMessages(CNode& node)
+{
+    if (node.fDisconnect)
+        return false;
+
+    // Receive messages
+    bool fMoreNodeWork = m_msgproc->ProcessMessages(&node, flagInterruptMsgProc);
+    fMoreNodeWork &= !node.fPauseSend;
+    if (flagInterruptMsgProc)
+        return false;
+    // Send messages
+    {
+        LOCK(node.cs_sendProcessing);
+        m_msgproc->SendMessages(&node);
+    }
+    return fMoreNodeWork;
+}
+
+bool CConnman::HandleMessagesRound(const std::vector<CNode*>& nodes)
+{
+    if (m_msghand_queue) {
+        std::atomic<bool> more_work{false};
+        std::vector<MessageHandlerJob> jobs;
+        jobs.reserve(nodes.size());
+        for (CNode* pnode : nodes) {
+            jobs.emplace_back(*this, *pnode, more_work);
+        }
+        CCheckQueueControl<MessageHandlerJob> control(m_msghand_queue.get());
+        control.Add(jobs);
+        control.Wait();
+        return more_work;
+    }
+
+    bool fMoreWork = false;
+    for (CNode* pnode : nodes) {
+        fMoreWork |= HandleNodeMessages(*pnode);
+        if (flagInterruptMsgProc)
+            break;
+    }
+    return fMoreWork;
+}
+
+void CConnman::StartMessageHandlerWorkers(int threads_num)
+{
+    assert(!m_msghand_queue);
+    // Hand out one node at a time, as handling a node's messages is
+    // expensive compared to taking it from the queue.
+    m_msghand_queue = std::make_unique<CCheckQueue<MessageHandlerJob>>(/* nBatchSizeIn */ 1);
+    m_msghand_queue->StartWorkerThreads(threads_num, "msghand");
+}
+
+void CConnman::StopMessageHandlerWorkers()
+{
+    if (m_msghand_queue) {
+        m_msghand_queue->StopWorkerThreads();
+        m_msghand_queue.reset();
     }
 }
 
@@ -2246,32 +2532,14 @@ void CConnman::ThreadMessageHandler()
             }
         }
 
-        bool fMoreWork = false;
-
         // Randomize the order in which we process messages from/to our peers.
         // This prevents attacks in which an attacker exploits having multiple
         // consecutive connections in the vNodes list.
         Shuffle(vNodesCopy.begin(), vNodesCopy.end(), rng);
 
-        for (CNode* pnode : vNodesCopy)
-        {
-            if (pnode->fDisconnect)
-                continue;
-
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
-            // Send messages
-            {
-                LOCK(pnode->cs_sendProcessing);
-                m_msgproc->SendMessages(pnode);
-            }
-
-            if (flagInterruptMsgProc)
-                return;
-        }
+        const bool fMoreWork = HandleMessagesRound(vNodesCopy);
+        if (flagInterruptMsgProc)
+            return;
 
         {
             LOCK(cs_vNodes);
@@ -2583,6 +2851,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Send and receive from sockets, accept connections
+    InitSocketEvents();
     threadSocketHandler = std::thread(&util::TraceThread, "net", [this] { ThreadSocketHandler(); });
 
     if (!gArgs.GetBoolArg("-dnsseed", DEFAULT_DNSSEED))
@@ -2608,6 +2877,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Process messages
+    if (m_msghand_threads > 1) {
+        StartMessageHandlerWorkers(m_msghand_threads - 1);
+    }
     threadMessageHandler = std::thread(&util::TraceThread, "msghand", [this] { ThreadMessageHandler(); });
 
     if (connOptions.m_i2p_accept_incoming && m_i2p_sam_session.get() != nullptr) {
@@ -2667,6 +2939,7 @@ void CConnman::StopThreads()
     }
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    StopMessageHandlerWorkers();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2710,6 +2983,8 @@ void CConnman::StopNodes()
         }
     }
 
+    CloseSocketEvents();
+
     for (CNode* pnode : vNodesDisconnected) {
         DeleteNode(pnode);
     }
@@ -2751,6 +3026,8 @@ std::vector<CAddress> CConnman::GetAddresses(CNode& requestor, size_t max_addres
         .Write(local_socket_bytes.data(), local_socket_bytes.size())
         .Finalize();
     const auto current_time = GetTime<std::chrono::microseconds>();
+    // Message handler threads may serve getaddr requests concurrently.
+    LOCK(m_addr_response_caches_mutex);
     auto r = m_addr_response_caches.emplace(cache_id, CachedAddrResponse{});
     CachedAddrResponse& cache_entry = r.first->second;
     if (cache_entry.m_cache_entry_expiration < current_time) { // If emplace() added new one it has expiration 0.
@@ -40,6 +40,8 @@
 
 class CScheduler;
 class CNode;
+template <typename T>
+class CCheckQueue;
 class BanMan;
 struct bilingual_str;
 
@@ -84,6 +86,10 @@ static constexpr bool DEFAULT_DNSSEED{true};
 static constexpr bool DEFAULT_FIXEDSEEDS{true};
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of threads processing peers' messages */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of threads processing peers' messages */
+static const int MAX_MSGHAND_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -695,6 +701,12 @@ private:
 
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
 
+    //! Whether the socket was last reported readable/writable by an
+    //! edge-triggered epoll event and has not yet been found to block.
+    //! Used only by SocketHandler thread.
+    bool m_sock_readable{false};
+    bool m_sock_writable{false};
+
     mutable RecursiveMutex cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
 
@@ -763,6 +775,7 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_msghand_threads = DEFAULT_MSGHAND_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -793,6 +806,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msghand_threads = connOptions.m_msghand_threads;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
@@ -862,7 +876,7 @@ public:
      * A non-malicious call (from RPC or a peer with addr permission) should
      * call the function without a parameter to avoid using the cache.
      */
-    std::vector<CAddress> GetAddresses(CNode& requestor, size_t max_addresses, size_t max_pct);
+    std::vector<CAddress> GetAddresses(CNode& requestor, size_t max_addresses, size_t max_pct) EXCLUSIVE_LOCKS_REQUIRED(!m_addr_response_caches_mutex);
 
     // This allows temporarily exceeding m_max_outbound_full_relay, with the goal of finding
     // a peer that is better than all our current peers.
@@ -943,6 +957,12 @@ public:
 
     void WakeMessageHandler();
 
+    /**
+     * Make the socket handler read from a node again after its receive was
+     * unpaused (see CNode::fPauseRecv), even if no new data arrives.
+     */
+    void ResumeReceive(CNode& node);
+
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
         Variable intervals will result in privacy decrease.
@@ -973,6 +993,20 @@ private:
     void ProcessAddrFetch();
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
+    /**
+     * Process the received messages of a node and send its messages.
+     * @return whether the node has more messages to process right away.
+     */
+    bool HandleNodeMessages(CNode& node);
+    /**
+     * Handle the messages of each node once. With message handler worker
+     * threads, different nodes are handled concurrently, while each node is
+     * only handled by one thread at a time.
+     * @return whether any node has more messages to process right away.
+     */
+    bool HandleMessagesRound(const std::vector<CNode*>& nodes);
+    void StartMessageHandlerWorkers(int threads_num);
+    void StopMessageHandlerWorkers();
     void ThreadI2PAcceptIncoming();
     void AcceptConnection(const ListenSocket& hListenSocket);
 
@@ -995,7 +1029,25 @@ private:
     bool InactivityCheck(const CNode& node) const;
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_EPOLL
+    /**
+     * Wait for edge-triggered events on the sockets registered with m_epoll_fd.
+     * Only sockets whose readiness changed are returned, with the epoll events
+     * for each node; see SocketHandlerEpoll() for how readiness is tracked
+     * until the socket would block.
+     */
+    void SocketEventsEpoll(std::vector<const ListenSocket*>& listen_ready, std::map<CNode*, uint32_t>& nodes_ready);
+    /** SocketHandler() for epoll, which only visits the nodes that are ready. */
+    void SocketHandlerEpoll();
+#endif
+    /** Create the epoll instance, if supported, and register the listening sockets with it. */
+    void InitSocketEvents();
+    /** Register the socket of a new node with the epoll instance, if any. */
+    void RegisterSocketEvents(CNode& node) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void CloseSocketEvents();
     void SocketHandler();
+    /** Receive from and send to a node, as far as its socket is ready. */
+    void SocketHandlerNode(CNode& node, bool recv_ready, bool send_ready, bool error);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -1057,6 +1109,22 @@ private:
     unsigned int nReceiveFloodSize{0};
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    /**
+     * epoll instance that listening sockets and node sockets are registered
+     * with for as long as they are open, or -1 to fall back to poll().
+     * Created before the network threads are started and closed after they
+     * have been stopped.
+     */
+    int m_epoll_fd{-1};
+    /**
+     * Nodes that had readiness left over after the last SocketHandler()
+     * iteration, each holding a reference. Used only by SocketHandler thread.
+     */
+    std::vector<CNode*> m_sock_pending_nodes;
+    /** When the inactivity of all nodes was last checked. Used only by SocketHandler thread. */
+    int64_t m_last_inactivity_check{0};
+#endif
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
     CAddrMan& addrman;
@@ -1095,7 +1163,8 @@ private:
      * resulting in at most ~196 KB. Every separate local socket may
      * add up to ~196 KB extra.
      */
-    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches;
+    Mutex m_addr_response_caches_mutex;
+    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches GUARDED_BY(m_addr_response_caches_mutex);
 
     /**
      * Services this instance offers.
@@ -1166,6 +1235,12 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+
+    /** Number of threads handling messages, including threadMessageHandler. */
+    int m_msghand_threads{DEFAULT_MSGHAND_THREADS};
+    struct MessageHandlerJob;
+    /** Queue through which threadMessageHandler hands nodes to the worker threads, if there are any. */
+    std::unique_ptr<CCheckQueue<MessageHandlerJob>> m_msghand_queue;
     std::thread threadI2PAcceptIncoming;
 
     /** flag for deciding to connect to an extra outbound peer,
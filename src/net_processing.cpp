@@ -10,6 +10,7 @@
 #include <blockencodings.h>
 #include <blockfilter.h>
 #include <chainparams.h>
+#include <clientversion.h>
 #include <consensus/validation.h>
 #include <deploymentstatus.h>
 #include <hash.h>
@@ -223,8 +224,11 @@ struct Peer {
     /** Whether a ping has been requested by the user */
     std::atomic<bool> m_ping_queued{false};
 
+    /** Protects m_addrs_to_send and m_addr_known, which are also updated
+     *  while processing other peers' messages (see RelayAddress()). */
+    Mutex m_addr_known_mutex;
     /** A vector of addresses to send to the peer, limited to MAX_ADDR_TO_SEND. */
-    std::vector<CAddress> m_addrs_to_send;
+    std::vector<CAddress> m_addrs_to_send GUARDED_BY(m_addr_known_mutex);
     /** Probabilistic filter to track recent addr messages relayed with this
      *  peer. Used to avoid relaying redundant addresses to this peer.
      *
@@ -234,7 +238,7 @@ struct Peer {
      *
      *  Presence of this filter must correlate with m_addr_relay_enabled.
      **/
-    std::unique_ptr<CRollingBloomFilter> m_addr_known;
+    std::unique_ptr<CRollingBloomFilter> m_addr_known GUARDED_BY(m_addr_known_mutex);
     /** Whether we are participating in address relay with this connection.
      *
      *  We set this bool to true for outbound peers (other than
@@ -317,6 +321,8 @@ public:
     void RelayTransaction(const uint256& txid, const uint256& wtxid) override;
     void SetBestHeight(int height) override { m_best_height = height; };
     void Misbehaving(const NodeId pnode, const int howmuch, const std::string& message) override;
+    bool DumpOrphans() override;
+    void LoadOrphans() override;
     void ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
                         const std::chrono::microseconds time_received, const std::atomic<bool>& interruptMsgProc) override;
 
@@ -425,6 +431,9 @@ private:
     /** Whether this node is running in blocks only mode */
     const bool m_ignore_incoming_txs;
 
+    /** Quantizes the fee filters sent to peers. Shared by the message handler threads. */
+    FeeFilterRounder m_fee_filter_rounder{CFeeRate{DEFAULT_MIN_RELAY_TX_FEE}};
+
     /** Whether we've completed initial sync yet, for determining when to turn
       * on extra block-relay-only peers. */
     bool m_initial_sync_finished{false};
@@ -572,6 +581,12 @@ private:
     /** Storage for orphan information */
     TxOrphanage m_orphanage;
 
+    /** Limit m_orphanage to -maxorphantx and -maxorphansize */
+    void LimitOrphans() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Whether LoadOrphans() has run, so that orphans.dat may be overwritten */
+    std::atomic<bool> m_orphans_loaded{false};
+
     void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
     /** Orphan/conflicted/etc transactions that are kept for compact block reconstruction.
@@ -786,6 +801,7 @@ static bool IsAddrCompatible(const Peer& peer, const CAddress& addr)
 
 static void AddAddressKnown(Peer& peer, const CAddress& addr)
 {
+    LOCK(peer.m_addr_known_mutex);
     assert(peer.m_addr_known);
     peer.m_addr_known->insert(addr.GetKey());
 }
@@ -795,6 +811,7 @@ static void PushAddress(Peer& peer, const CAddress& addr, FastRandomContext& ins
     // Known checking here is only to save space from duplicates.
     // Before sending, we'll filter it again for known addresses that were
     // added after addresses were pushed.
+    LOCK(peer.m_addr_known_mutex);
     assert(peer.m_addr_known);
     if (addr.IsValid() && !peer.m_addr_known->contains(addr.GetKey()) && IsAddrCompatible(peer, addr)) {
         if (peer.m_addrs_to_send.size() >= MAX_ADDR_TO_SEND) {
@@ -1800,14 +1817,19 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
     std::shared_ptr<const CBlock> pblock;
     if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
         pblock = a_recent_block;
-    } else if (inv.IsMsgWitnessBlk()) {
+    } else if (inv.IsMsgWitnessBlk() || (inv.IsMsgBlk() && !DeploymentActiveAt(*pindex, m_chainparams.GetConsensus(), Consensus::DEPLOYMENT_SEGWIT))) {
         // Fast-path: in this case it is possible to serve the block directly from disk,
-        // as the network format matches the format on disk
-        std::vector<uint8_t> block_data;
-        if (!ReadRawBlockFromDisk(block_data, pindex, m_chainparams.MessageStart())) {
+        // as the network format matches the format on disk. Blocks from before segwit
+        // activation can't contain witnesses, so this also holds for their
+        // serialization without witnesses.
+        // The block is read straight into the message payload, without deserializing it
+        // or copying it again.
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(msg.data, pindex, m_chainparams.MessageStart())) {
             assert(!"cannot load block from disk");
         }
-        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+        m_connman.PushMessage(&pfrom, std::move(msg));
         // Don't set pblock as we've sent the block
     } else {
         // Send block from disk
@@ -2211,6 +2233,108 @@ void PeerManagerImpl::ProcessHeadersMessage(CNode& pfrom, const Peer& peer,
     return;
 }
 
+void PeerManagerImpl::LimitOrphans()
+{
+    unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    size_t nMaxOrphanSize = (size_t)std::max((int64_t)0, gArgs.GetArg("-maxorphansize", DEFAULT_MAX_ORPHAN_SIZE)) * 1000000;
+    unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx, nMaxOrphanSize);
+    if (nEvicted > 0) {
+        LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
+    }
+}
+
+static const uint64_t ORPHANS_DUMP_VERSION = 1;
+
+bool PeerManagerImpl::DumpOrphans()
+{
+    if (!m_orphans_loaded) return false;
+
+    // Orphans wait for their parents to be relayed, which doesn't happen
+    // while we're offline, so only their remaining time is kept.
+    const int64_t now = GetTime();
+    const auto orphans = WITH_LOCK(g_cs_orphans, return m_orphanage.GetOrphanTxs());
+
+    try {
+        FILE* filestr{fsbridge::fopen(gArgs.GetDataDirNet() / "orphans.dat.new", "wb")};
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << ORPHANS_DUMP_VERSION;
+        file << (uint64_t)orphans.size();
+        for (const auto& [tx, time_expire] : orphans) {
+            file << *tx;
+            file << int64_t{std::max<int64_t>(time_expire - now, 0)};
+        }
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        if (!RenameOver(gArgs.GetDataDirNet() / "orphans.dat.new", gArgs.GetDataDirNet() / "orphans.dat")) {
+            throw std::runtime_error("Rename failed");
+        }
+        LogPrintf("Dumped %u orphan transactions\n", orphans.size());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump orphan transactions: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void PeerManagerImpl::LoadOrphans()
+{
+    CAutoFile file(fsbridge::fopen(gArgs.GetDataDirNet() / "orphans.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open orphan transactions file from disk. Continuing anyway.\n");
+        m_orphans_loaded = true;
+        return;
+    }
+
+    // Loaded orphans are attributed to no peer
+    const NodeId loaded_from{-1};
+    std::set<uint256> orphan_work_set;
+    size_t loaded{0};
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != ORPHANS_DUMP_VERSION) {
+            throw std::runtime_error("unknown version");
+        }
+        uint64_t num;
+        file >> num;
+        const int64_t now = GetTime();
+        LOCK(g_cs_orphans);
+        while (num--) {
+            CTransactionRef tx;
+            int64_t remaining_time;
+            file >> tx;
+            file >> remaining_time;
+            if (m_orphanage.AddTx(tx, loaded_from, now + remaining_time)) {
+                orphan_work_set.insert(tx->GetHash());
+                ++loaded;
+                // Apply the limits as the file is read, so that it can't
+                // make the orphanage any larger than relay could. Evicted
+                // orphans are skipped by ProcessOrphanTx().
+                LimitOrphans();
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize orphan transactions on disk: %s. Continuing anyway.\n", e.what());
+    }
+
+    // Accept the orphans whose parents arrived with the mempool; the others
+    // wait for their parents to be relayed as usual.
+    {
+        LOCK2(cs_main, g_cs_orphans);
+        while (!orphan_work_set.empty()) {
+            ProcessOrphanTx(orphan_work_set);
+        }
+    }
+    LogPrintf("Imported orphan transactions from disk: %u loaded, %u still orphans\n", loaded, m_orphanage.Size());
+    m_orphans_loaded = true;
+}
+
 /**
  * Reconsider orphan transactions after a parent has been accepted to the mempool.
  *
@@ -2361,16 +2485,19 @@ void PeerManagerImpl::ProcessGetCFilters(CNode& peer, CDataStream& vRecv)
         return;
     }
 
-    std::vector<BlockFilter> filters;
-    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+    // The filters come already serialized as cfilter payloads, shared with
+    // other peers requesting the same range.
+    std::vector<BlockFilterIndex::SerializedFilter> filters;
+    if (!filter_index->LookupSerializedFilterRange(start_height, stop_index, filters)) {
         LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
                      BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
         return;
     }
 
     for (const auto& filter : filters) {
-        CSerializedNetMsg msg = CNetMsgMaker(peer.GetCommonVersion())
-            .Make(NetMsgType::CFILTER, filter);
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::CFILTER;
+        msg.data.assign(filter->begin(), filter->end());
         m_connman.PushMessage(&peer, std::move(msg));
     }
 }
@@ -3310,11 +3437,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
                 m_txrequest.ForgetTxHash(tx.GetWitnessHash());
 
                 // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
-                }
+                LimitOrphans();
             } else {
                 LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
                 // We will continue to reject this tx since it has rejected
@@ -3758,7 +3881,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
         }
         peer->m_getaddr_recvd = true;
 
-        peer->m_addrs_to_send.clear();
+        WITH_LOCK(peer->m_addr_known_mutex, peer->m_addrs_to_send.clear());
         std::vector<CAddress> vAddr;
         if (pfrom.HasPermission(NetPermissionFlags::Addr)) {
             vAddr = m_connman.GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND, /* network */ std::nullopt);
@@ -4068,15 +4191,18 @@ bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt
     if (pfrom->fPauseSend) return false;
 
     std::list<CNetMessage> msgs;
+    bool resume_receive{false};
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty()) return false;
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().m_raw_message_size;
+        resume_receive = pfrom->fPauseRecv && pfrom->nProcessQueueSize <= m_connman.GetReceiveFloodSize();
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > m_connman.GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    if (resume_receive) m_connman.ResumeReceive(*pfrom);
     CNetMessage& msg(msgs.front());
 
     TRACE6(net, inbound_message,
@@ -4350,7 +4476,7 @@ void PeerManagerImpl::MaybeSendAddr(CNode& node, Peer& peer, std::chrono::micros
         // bandwidth cost that we can incur by doing this (which happens
         // once a day on average).
         if (peer.m_next_local_addr_send != 0us) {
-            peer.m_addr_known->reset();
+            WITH_LOCK(peer.m_addr_known_mutex, peer.m_addr_known->reset());
         }
         if (std::optional<CAddress> local_addr = GetLocalAddrForPeer(&node)) {
             FastRandomContext insecure_rand;
@@ -4364,6 +4490,7 @@ void PeerManagerImpl::MaybeSendAddr(CNode& node, Peer& peer, std::chrono::micros
 
     peer.m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
 
+    LOCK(peer.m_addr_known_mutex);
     if (!Assume(peer.m_addrs_to_send.size() <= MAX_ADDR_TO_SEND)) {
         // Should be impossible since we always check size before adding to
         // m_addrs_to_send. Recover by trimming the vector.
@@ -4372,7 +4499,7 @@ void PeerManagerImpl::MaybeSendAddr(CNode& node, Peer& peer, std::chrono::micros
 
     // Remove addr records that the peer already knows about, and add new
     // addrs to the m_addr_known filter on the same pass.
-    auto addr_already_known = [&peer](const CAddress& addr) {
+    auto addr_already_known = [&peer](const CAddress& addr) EXCLUSIVE_LOCKS_REQUIRED(peer.m_addr_known_mutex) {
         bool ret = peer.m_addr_known->contains(addr.GetKey());
         if (!ret) peer.m_addr_known->insert(addr.GetKey());
         return ret;
@@ -4412,14 +4539,13 @@ void PeerManagerImpl::MaybeSendFeefilter(CNode& pto, std::chrono::microseconds c
     if (pto.HasPermission(NetPermissionFlags::ForceRelay)) return;
 
     CAmount currentFilter = m_mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
-    static FeeFilterRounder g_filter_rounder{CFeeRate{DEFAULT_MIN_RELAY_TX_FEE}};
 
     if (m_chainman.ActiveChainstate().IsInitialBlockDownload()) {
         // Received tx-inv messages are discarded when the active
         // chainstate is in IBD, so tell the peer to not send them.
         currentFilter = MAX_MONEY;
     } else {
-        static const CAmount MAX_FILTER{g_filter_rounder.round(MAX_MONEY)};
+        static const CAmount MAX_FILTER{m_fee_filter_rounder.round(MAX_MONEY)};
         if (pto.m_tx_relay->lastSentFeeFilter == MAX_FILTER) {
             // Send the current filter if we sent MAX_FILTER previously
             // and made it out of IBD.
@@ -4427,7 +4553,7 @@ void PeerManagerImpl::MaybeSendFeefilter(CNode& pto, std::chrono::microseconds c
         }
     }
     if (current_time > pto.m_tx_relay->m_next_send_feefilter) {
-        CAmount filterToSend = g_filter_rounder.round(currentFilter);
+        CAmount filterToSend = m_fee_filter_rounder.round(currentFilter);
         // We always have a fee filter of at least minRelayTxFee
         filterToSend = std::max(filterToSend, ::minRelayTxFee.GetFeePerK());
         if (filterToSend != pto.m_tx_relay->lastSentFeeFilter) {
@@ -4472,6 +4598,9 @@ bool PeerManagerImpl::SetupAddressRelay(const CNode& node, Peer& peer)
     // information of addr traffic to infer the link.
     if (node.IsBlockOnlyConn()) return false;
 
+    // Set up m_addr_known before another peer's RelayAddress() can see
+    // m_addr_relay_enabled and push addresses to this peer.
+    LOCK(peer.m_addr_known_mutex);
     if (!peer.m_addr_relay_enabled.exchange(true)) {
         // First addr message we have received from the peer, initialize
         // m_addr_known
@@ -15,7 +15,11 @@ class CTxMemPool;
 class ChainstateManager;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
-static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 1000;
+/** Default for -maxorphansize, maximum memory usage of orphan transactions in megabytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_SIZE = 10;
+/** Default for -persistorphans */
+static const bool DEFAULT_PERSIST_ORPHANS = false;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
@@ -73,6 +77,13 @@ public:
      */
     virtual void CheckForStaleTipAndEvictPeers() = 0;
 
+    /** Write the orphan transactions to orphans.dat. Does nothing until LoadOrphans() has been called. */
+    virtual bool DumpOrphans() = 0;
+
+    /** Add the orphan transactions in orphans.dat to the orphan pool, and
+     *  accept those whose parents are known by now to the mempool. */
+    virtual void LoadOrphans() = 0;
+
     /** Process a single message from a peer. Public for fuzz testing */
     virtual void ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
                                 const std::chrono::microseconds time_received, const std::atomic<bool>& interruptMsgProc) = 0;
@@ -8,6 +8,7 @@
 #include <chainparams.h>
 #include <clientversion.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <hash.h>
@@ -21,6 +22,7 @@
 
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
+std::atomic_bool g_mmap_blocks(DEFAULT_MMAP_BLOCKS);
 bool fHavePruned = false;
 bool fPruneMode = false;
 uint64_t nPruneTarget = 0;
@@ -46,6 +48,38 @@ static FILE* OpenUndoFile(const FlatFilePos& pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
+/** Memory mappings of recently read block and undo files, used with -mmapblocks. */
+static FlatFileMapCache g_block_file_maps{MAX_MAPPED_BLOCK_FILES};
+static FlatFileMapCache g_undo_file_maps{MAX_MAPPED_BLOCK_FILES};
+
+/**
+ * Find the record (block or undo data) at pos in a memory mapping of its file,
+ * if -mmapblocks is set. Records are stored after the network magic and their
+ * size, and undo data is followed by a trailer_size byte checksum.
+ *
+ * Returns the mapping header and record point into, or nullptr if the record
+ * can't be mapped, in which case it should be read through stdio instead.
+ */
+static std::shared_ptr<const MappedFlatFile> MapRecord(FlatFileMapCache& maps, FlatFileSeq (*seq)(), const FlatFilePos& pos, size_t trailer_size,
+                                                        Span<const unsigned char>& header, Span<const unsigned char>& record)
+{
+    if (!g_mmap_blocks || pos.IsNull() || pos.nPos < 8) return nullptr;
+    const fs::path path = seq().FileName(pos);
+    std::shared_ptr<const MappedFlatFile> map = maps.Get(path, pos.nPos);
+    if (!map) return nullptr;
+    const uint32_t size = ReadLE32(map->Data().data() + pos.nPos - 4);
+    if (size > MAX_SIZE) return nullptr;
+    const size_t end = size_t{pos.nPos} + size + trailer_size;
+    if (map->Data().size() < end) {
+        // The record may have been appended after the file was mapped.
+        map = maps.Get(path, end);
+        if (!map) return nullptr;
+    }
+    header = map->Data().subspan(pos.nPos - 8, 8);
+    record = map->Data().subspan(pos.nPos, size);
+    return map;
+}
+
 bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
     return (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0);
@@ -65,6 +99,8 @@ void CleanupBlockRevFiles()
     // Remove the rev files immediately and insert the blk file paths into an
     // ordered map keyed by block file index.
     LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    g_block_file_maps.Clear();
+    g_undo_file_maps.Clear();
     fs::path blocksdir = gArgs.GetBlocksDirPath();
     for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
         if (fs::is_regular_file(*it) &&
@@ -141,6 +177,26 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
         return error("%s: no undo data available", __func__);
     }
 
+    Span<const unsigned char> header, record;
+    if (const auto map = MapRecord(g_undo_file_maps, UndoFileSeq, pos, uint256::size(), header, record)) {
+        // The checksum can be computed over the mapped record directly,
+        // rather than through a CHashVerifier.
+        CHashWriter hasher(SER_GETHASH, 0);
+        hasher << pindex->pprev->GetBlockHash();
+        hasher.write((const char*)record.data(), record.size());
+        uint256 hashChecksum;
+        try {
+            SpanReader{SER_DISK, CLIENT_VERSION, record} >> blockundo;
+            SpanReader{SER_DISK, CLIENT_VERSION, map->Data().subspan(pos.nPos + record.size())} >> hashChecksum;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (hashChecksum != hasher.GetHash()) {
+            return error("%s: Checksum mismatch", __func__);
+        }
+        return true;
+    }
+
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
@@ -172,6 +228,8 @@ static void FlushUndoFile(int block_file, bool finalize = false)
     if (!UndoFileSeq().Flush(undo_pos_old, finalize)) {
         AbortNode("Flushing undo file to disk failed. This is likely the result of an I/O error.");
     }
+    // Don't keep a mapping that extends past the truncated end of the file.
+    if (finalize) g_undo_file_maps.Erase(UndoFileSeq().FileName(undo_pos_old));
 }
 
 void FlushBlockFile(bool fFinalize = false, bool finalize_undo = false)
@@ -181,6 +239,7 @@ void FlushBlockFile(bool fFinalize = false, bool finalize_undo = false)
     if (!BlockFileSeq().Flush(block_pos_old, fFinalize)) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
     }
+    if (fFinalize) g_block_file_maps.Erase(BlockFileSeq().FileName(block_pos_old));
     // we do not always flush the undo file, as the chain tip may be lagging behind the incoming blocks,
     // e.g. during IBD or a sync after a node going offline
     if (!fFinalize || finalize_undo) FlushUndoFile(nLastBlockFile, finalize_undo);
@@ -201,6 +260,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        g_block_file_maps.Erase(BlockFileSeq().FileName(pos));
+        g_undo_file_maps.Erase(UndoFileSeq().FileName(pos));
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -366,17 +427,26 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-    }
+    Span<const unsigned char> header, record;
+    if (MapRecord(g_block_file_maps, BlockFileSeq, pos, 0, header, record)) {
+        try {
+            SpanReader{SER_DISK, CLIENT_VERSION, record} >> block;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -410,8 +480,31 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const MappedFlatFile>& map, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    Span<const unsigned char> header;
+    map = MapRecord(g_block_file_maps, BlockFileSeq, pos, 0, header, block);
+    if (!map) return false;
+    if (memcmp(header.data(), message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+        map.reset();
+        return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                     HexStr(header.first(CMessageHeader::MESSAGE_START_SIZE)),
+                     HexStr(message_start));
+    }
+    return true;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    if (g_mmap_blocks) {
+        std::shared_ptr<const MappedFlatFile> map;
+        Span<const uint8_t> mapped_block;
+        if (ReadRawBlockFromDisk(mapped_block, map, pos, message_start)) {
+            block.assign(mapped_block.begin(), mapped_block.end());
+            return true;
+        }
+    }
+
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -7,9 +7,11 @@
 
 #include <fs.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
+#include <span.h>
 
 #include <atomic>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 class ArgsManager;
@@ -21,12 +23,16 @@ class CBlockUndo;
 class CChain;
 class CChainParams;
 class ChainstateManager;
+class MappedFlatFile;
 struct FlatFilePos;
 namespace Consensus {
 struct Params;
 }
 
 static constexpr bool DEFAULT_STOPAFTERBLOCKIMPORT{false};
+static constexpr bool DEFAULT_MMAP_BLOCKS{false};
+/** The number of block files, and of undo files, kept memory mapped with -mmapblocks */
+static constexpr size_t MAX_MAPPED_BLOCK_FILES{8};
 
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
@@ -37,6 +43,8 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
+/** Whether block and undo files are read through memory mappings (-mmapblocks). */
+extern std::atomic_bool g_mmap_blocks;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
@@ -71,6 +79,13 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/**
+ * Get the serialized block at pos without copying it, from a memory mapping of
+ * its block file. block stays valid for as long as map is held. Returns false
+ * if the block can't be read this way, e.g. without -mmapblocks, in which case
+ * the copying ReadRawBlockFromDisk should be used.
+ */
+bool ReadRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const MappedFlatFile>& map, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationState& state, CBlockIndex* pindex, const CChainParams& chainparams);
@@ -12,6 +12,7 @@
 
 class ArgsManager;
 class BanMan;
+class BlockTemplateCache;
 class CAddrMan;
 class CBlockPolicyEstimator;
 class CConnman;
@@ -46,6 +47,8 @@ struct NodeContext {
     std::unique_ptr<PeerManager> peerman;
     std::unique_ptr<ChainstateManager> chainman;
     std::unique_ptr<BanMan> banman;
+    //! Block template kept up to date with the mempool for getblocktemplate.
+    std::unique_ptr<BlockTemplateCache> block_template_cache;
     ArgsManager* args{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
     std::unique_ptr<interfaces::Chain> chain;
     //! List of all chain clients (wallet processes or other client) connected to node.
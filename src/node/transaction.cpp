@@ -13,8 +13,11 @@
 #include <validation.h>
 #include <validationinterface.h>
 #include <node/transaction.h>
+#include <policy/policy.h>
+#include <util/hasher.h>
 
 #include <future>
+#include <unordered_map>
 
 static TransactionError HandleATMPError(const TxValidationState& state, std::string& err_string_out)
 {
@@ -29,6 +32,87 @@ static TransactionError HandleATMPError(const TxValidationState& state, std::str
     }
 }
 
+/**
+ * Submit tx to the mempool unless it's already there or confirmed. wtxid is
+ * set to the wtxid to relay, and submitted to whether tx entered the mempool.
+ */
+static TransactionError SubmitTransaction(NodeContext& node, const CTransactionRef& tx, uint256& wtxid, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool& submitted) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const uint256& txid = tx->GetHash();
+    wtxid = tx->GetWitnessHash();
+    submitted = false;
+
+    // If the transaction is already confirmed in the chain, don't do anything
+    // and return early.
+    CCoinsViewCache &view = node.chainman->ActiveChainstate().CoinsTip();
+    for (size_t o = 0; o < tx->vout.size(); o++) {
+        const Coin& existingCoin = view.AccessCoin(COutPoint(txid, o));
+        // IsSpent doesn't mean the coin is spent, it means the output doesn't exist.
+        // So if the output does exist, then this transaction exists in the chain.
+        if (!existingCoin.IsSpent()) return TransactionError::ALREADY_IN_CHAIN;
+    }
+
+    if (auto mempool_tx = node.mempool->get(txid); mempool_tx) {
+        // There's already a transaction in the mempool with this txid. Don't
+        // try to submit this transaction to the mempool (since it'll be
+        // rejected as a TX_CONFLICT), but do attempt to reannounce the mempool
+        // transaction if relay=true.
+        //
+        // The mempool transaction may have the same or different witness (and
+        // wtxid) as this transaction. Use the mempool's wtxid for reannouncement.
+        wtxid = mempool_tx->GetWitnessHash();
+        return TransactionError::OK;
+    }
+
+    // Transaction is not already in the mempool.
+    if (max_tx_fee > 0) {
+        // First, call ATMP with test_accept and check the fee. If ATMP
+        // fails here, return error immediately.
+        const MempoolAcceptResult result = AcceptToMemoryPool(node.chainman->ActiveChainstate(), *node.mempool, tx, false /* bypass_limits */,
+                                                              true /* test_accept */);
+        if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
+            return HandleATMPError(result.m_state, err_string);
+        } else if (result.m_base_fees.value() > max_tx_fee) {
+            return TransactionError::MAX_FEE_EXCEEDED;
+        }
+    }
+    // Try to submit the transaction to the mempool.
+    const MempoolAcceptResult result = AcceptToMemoryPool(node.chainman->ActiveChainstate(), *node.mempool, tx, false /* bypass_limits */,
+                                                          false /* test_accept */);
+    if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
+        return HandleATMPError(result.m_state, err_string);
+    }
+
+    // Transaction was accepted to the mempool.
+    submitted = true;
+
+    if (relay) {
+        // the mempool tracks locally submitted transactions to make a
+        // best-effort of initial broadcast
+        node.mempool->AddUnbroadcastTx(txid);
+    }
+    return TransactionError::OK;
+}
+
+/**
+ * For transactions broadcast from outside the wallet, make sure that the
+ * wallet has been notified of the transaction before continuing.
+ *
+ * This prevents a race where a user might call sendrawtransaction with a
+ * transaction to/from their wallet, immediately call some wallet RPC, and get
+ * a stale result because callbacks have not yet been processed.
+ */
+static void WaitForValidationCallbacks() LOCKS_EXCLUDED(cs_main)
+{
+    std::promise<void> promise;
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+    // Wait until Validation Interface clients have been notified of the
+    // transaction entering the mempool.
+    promise.get_future().wait();
+}
+
 TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback)
 {
     // BroadcastTransaction can be called by either sendrawtransaction RPC or the wallet.
@@ -38,89 +122,105 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
     assert(node.mempool);
     assert(node.peerman);
 
-    std::promise<void> promise;
-    uint256 txid = tx->GetHash();
-    uint256 wtxid = tx->GetWitnessHash();
-    bool callback_set = false;
+    uint256 wtxid;
+    bool submitted;
+    const TransactionError err = WITH_LOCK(cs_main, return SubmitTransaction(node, tx, wtxid, err_string, max_tx_fee, relay, submitted));
+    if (err != TransactionError::OK) return err;
 
-    {
-        LOCK(cs_main);
+    if (submitted && wait_callback) WaitForValidationCallbacks();
 
-        // If the transaction is already confirmed in the chain, don't do anything
-        // and return early.
-        CCoinsViewCache &view = node.chainman->ActiveChainstate().CoinsTip();
-        for (size_t o = 0; o < tx->vout.size(); o++) {
-            const Coin& existingCoin = view.AccessCoin(COutPoint(txid, o));
-            // IsSpent doesn't mean the coin is spent, it means the output doesn't exist.
-            // So if the output does exist, then this transaction exists in the chain.
-            if (!existingCoin.IsSpent()) return TransactionError::ALREADY_IN_CHAIN;
-        }
+    if (relay) {
+        node.peerman->RelayTransaction(tx->GetHash(), wtxid);
+    }
 
-        if (auto mempool_tx = node.mempool->get(txid); mempool_tx) {
-            // There's already a transaction in the mempool with this txid. Don't
-            // try to submit this transaction to the mempool (since it'll be
-            // rejected as a TX_CONFLICT), but do attempt to reannounce the mempool
-            // transaction if relay=true.
-            //
-            // The mempool transaction may have the same or different witness (and
-            // wtxid) as this transaction. Use the mempool's wtxid for reannouncement.
-            wtxid = mempool_tx->GetWitnessHash();
-        } else {
-            // Transaction is not already in the mempool.
-            if (max_tx_fee > 0) {
-                // First, call ATMP with test_accept and check the fee. If ATMP
-                // fails here, return error immediately.
-                const MempoolAcceptResult result = AcceptToMemoryPool(node.chainman->ActiveChainstate(), *node.mempool, tx, false /* bypass_limits */,
-                                                                      true /* test_accept */);
-                if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
-                    return HandleATMPError(result.m_state, err_string);
-                } else if (result.m_base_fees.value() > max_tx_fee) {
-                    return TransactionError::MAX_FEE_EXCEEDED;
-                }
+    return TransactionError::OK;
+}
+
+std::vector<BroadcastResult> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const CFeeRate& max_tx_fee_rate, bool relay, bool wait_callback)
+{
+    assert(node.chainman);
+    assert(node.mempool);
+    assert(node.peerman);
+
+    // Submit parents in the batch before their children. A transaction can't
+    // be its own ancestor, so a depth-first walk over the parents terminates.
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> batch_txids;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        batch_txids.emplace(txs[i]->GetHash(), i);
+    }
+    std::vector<size_t> order;
+    order.reserve(txs.size());
+    std::vector<bool> ordered(txs.size(), false);
+    std::vector<std::pair<size_t, size_t>> stack; // transaction and next input to look at
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (ordered[i]) continue;
+        ordered[i] = true;
+        stack.emplace_back(i, 0);
+        while (!stack.empty()) {
+            auto& [index, input] = stack.back();
+            if (input == txs[index]->vin.size()) {
+                order.push_back(index);
+                stack.pop_back();
+                continue;
             }
-            // Try to submit the transaction to the mempool.
-            const MempoolAcceptResult result = AcceptToMemoryPool(node.chainman->ActiveChainstate(), *node.mempool, tx, false /* bypass_limits */,
-                                                                  false /* test_accept */);
-            if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
-                return HandleATMPError(result.m_state, err_string);
+            const auto it = batch_txids.find(txs[index]->vin[input++].prevout.hash);
+            if (it != batch_txids.end() && !ordered[it->second]) {
+                ordered[it->second] = true;
+                stack.emplace_back(it->second, 0);
             }
+        }
+    }
 
-            // Transaction was accepted to the mempool.
+    // Look up the outputs spent by each transaction, from the chain, the
+    // mempool or earlier transactions in the batch, and remember which coins
+    // weren't cached before so rejected transactions don't leave them behind.
+    std::vector<CTransactionRef> ordered_txs;
+    ordered_txs.reserve(txs.size());
+    for (const size_t index : order) {
+        ordered_txs.push_back(txs[index]);
+    }
+    std::vector<std::vector<CTxOut>> spent_outputs(txs.size());
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txs.size());
+    {
+        LOCK2(cs_main, node.mempool->cs);
+        // Missing inputs are reported on submission.
+        LookupSpentOutputs(node.chainman->ActiveChainstate(), *node.mempool, ordered_txs, spent_outputs, &coins_to_uncache);
+    }
 
-            if (relay) {
-                // the mempool tracks locally submitted transactions to make a
-                // best-effort of initial broadcast
-                node.mempool->AddUnbroadcastTx(txid);
-            }
+    // Invalid scripts are reported on submission too.
+    PrecheckTransactionScripts(ordered_txs, spent_outputs);
 
-            if (wait_callback) {
-                // For transactions broadcast from outside the wallet, make sure
-                // that the wallet has been notified of the transaction before
-                // continuing.
-                //
-                // This prevents a race where a user might call sendrawtransaction
-                // with a transaction to/from their wallet, immediately call some
-                // wallet RPC, and get a stale result because callbacks have not
-                // yet been processed.
-                CallFunctionInValidationInterfaceQueue([&promise] {
-                    promise.set_value();
-                });
-                callback_set = true;
+    std::vector<BroadcastResult> results(txs.size());
+    std::vector<uint256> relay_wtxids(txs.size());
+    bool any_submitted = false;
+    {
+        LOCK(cs_main);
+        for (size_t n = 0; n < order.size(); ++n) {
+            const CTransactionRef& tx = ordered_txs[n];
+            BroadcastResult& result = results[order[n]];
+            const CAmount max_tx_fee = max_tx_fee_rate.GetFee(GetVirtualTransactionSize(*tx));
+            bool submitted;
+            result.error = SubmitTransaction(node, tx, relay_wtxids[order[n]], result.err_string, max_tx_fee, relay, submitted);
+            any_submitted |= submitted;
+            if (result.error != TransactionError::OK) {
+                for (const COutPoint& outpoint : coins_to_uncache[n]) {
+                    node.chainman->ActiveChainstate().CoinsTip().Uncache(outpoint);
+                }
             }
         }
-    } // cs_main
-
-    if (callback_set) {
-        // Wait until Validation Interface clients have been notified of the
-        // transaction entering the mempool.
-        promise.get_future().wait();
     }
 
+    if (any_submitted && wait_callback) WaitForValidationCallbacks();
+
     if (relay) {
-        node.peerman->RelayTransaction(txid, wtxid);
+        for (size_t i = 0; i < txs.size(); ++i) {
+            if (results[i].error == TransactionError::OK) {
+                node.peerman->RelayTransaction(txs[i]->GetHash(), relay_wtxids[i]);
+            }
+        }
     }
 
-    return TransactionError::OK;
+    return results;
 }
 
 CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMemPool* const mempool, const uint256& hash, const Consensus::Params& consensusParams, uint256& hashBlock)
@@ -10,6 +10,9 @@
 #include <primitives/transaction.h>
 #include <util/error.h>
 
+#include <string>
+#include <vector>
+
 class CBlockIndex;
 class CTxMemPool;
 struct NodeContext;
@@ -24,6 +27,9 @@ struct Params;
  */
 static const CFeeRate DEFAULT_MAX_RAW_TX_FEE_RATE{COIN / 10};
 
+/** Maximum number of transactions in one sendrawtransactions RPC or REST batch. */
+static constexpr unsigned int MAX_RAW_TX_BATCH_SIZE{1000};
+
 /**
  * Submit a transaction to the mempool and (optionally) relay it to all P2P peers.
  *
@@ -43,6 +49,31 @@ static const CFeeRate DEFAULT_MAX_RAW_TX_FEE_RATE{COIN / 10};
  */
 [[nodiscard]] TransactionError BroadcastTransaction(NodeContext& node, CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/** Outcome of submitting one transaction of a batch, as returned by BroadcastTransaction */
+struct BroadcastResult {
+    TransactionError error{TransactionError::OK};
+    std::string err_string;
+};
+
+/**
+ * Submit a batch of transactions to the mempool and (optionally) relay them
+ * to all P2P peers.
+ *
+ * The scripts of all transactions are first checked on the script checking
+ * threads against the coins they spend, without holding cs_main. cs_main is
+ * then taken once to submit the transactions one by one, as
+ * BroadcastTransaction would, after any parents in the batch. Their signature
+ * checks hit the signature cache by then.
+ *
+ * @param[in]  node             reference to node context
+ * @param[in]  txs              the transactions to broadcast
+ * @param[in]  max_tx_fee_rate  reject txs with fee rates higher than this (if 0, accept any fee rate)
+ * @param[in]  relay            flag if both mempool insertion and p2p relay are requested
+ * @param[in]  wait_callback    wait until callbacks have been processed, see BroadcastTransaction
+ * @returns the result for each transaction, in the order of txs
+ */
+std::vector<BroadcastResult> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const CFeeRate& max_tx_fee_rate, bool relay, bool wait_callback);
+
 /**
  * Return transaction with a given hash.
  * If mempool is provided and block_index is not provided, check it first for the tx.
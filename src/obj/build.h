@@ -0,0 +1 @@
+#define BUILD_GIT_COMMIT "0c44609fc4e4-dirty"
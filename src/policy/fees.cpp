@@ -13,6 +13,8 @@
 #include <util/serfloat.h>
 #include <util/system.h>
 
+#include <numeric>
+
 static const char* FEE_ESTIMATES_FILENAME = "fee_estimates.dat";
 
 static constexpr double INF_FEERATE = 1e99;
@@ -44,6 +46,21 @@ struct EncodedDoubleFormatter
     }
 };
 
+/** Write a row-major matrix of doubles stored in a flat vector in the same
+ * layout as a vector of rows, so the file format doesn't depend on how the
+ * stats are held in memory. */
+void WriteEncodedMatrix(CAutoFile& fileout, const std::vector<double>& matrix, size_t rows)
+{
+    const size_t cols = matrix.size() / rows;
+    WriteCompactSize(fileout, rows);
+    for (size_t row = 0; row < rows; ++row) {
+        WriteCompactSize(fileout, cols);
+        for (size_t col = 0; col < cols; ++col) {
+            fileout << EncodeDouble(matrix[row * cols + col]);
+        }
+    }
+}
+
 } // namespace
 
 /**
@@ -66,13 +83,20 @@ private:
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
 
+    // The per-period and per-block counters below are stored as one
+    // contiguous array each rather than a vector per period, so that decaying
+    // them every block is a single pass over memory.
+
+    // Number of periods tracked: the rows of confAvg and failAvg
+    size_t m_max_periods;
+
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of these totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * buckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * buckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -88,8 +112,9 @@ private:
 
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
-    // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    // that are unconfirmed for each possible confirmation value Y. Stored by
+    // bucket, as estimates sum each bucket over a range of Y.
+    std::vector<int> unconfTxs;  //unconfTxs[X * GetMaxConfirms() + Y]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
@@ -142,7 +167,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * m_max_periods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -158,16 +183,11 @@ public:
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
                                 const std::map<double, unsigned int>& defaultBucketMap,
                                unsigned int maxPeriods, double _decay, unsigned int _scale)
-    : buckets(defaultBuckets), bucketMap(defaultBucketMap), decay(_decay), scale(_scale)
+    : buckets(defaultBuckets), bucketMap(defaultBucketMap), m_max_periods(maxPeriods), decay(_decay), scale(_scale)
 {
     assert(_scale != 0 && "_scale must be non-zero");
-    confAvg.resize(maxPeriods);
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-        failAvg[i].resize(buckets.size());
-    }
-
+    confAvg.resize(maxPeriods * buckets.size());
+    failAvg.resize(maxPeriods * buckets.size());
     txCtAvg.resize(buckets.size());
     m_feerate_avg.resize(buckets.size());
 
@@ -176,19 +196,18 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
-    oldUnconfTxs.resize(newbuckets);
+    unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
+    oldUnconfTxs.assign(newbuckets, 0);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
+    const unsigned int bins = GetMaxConfirms();
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+        int& unconf = unconfTxs[j * bins + nBlockHeight % bins];
+        oldUnconfTxs[j] += unconf;
+        unconf = 0;
     }
 }
 
@@ -200,8 +219,8 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
     unsigned int bucketindex = bucketMap.lower_bound(feerate)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    for (size_t i = periodsToConfirm; i <= m_max_periods; i++) {
+        confAvg[(i - 1) * buckets.size() + bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     m_feerate_avg[bucketindex] += feerate;
@@ -210,14 +229,10 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
 void TxConfirmStats::UpdateMovingAverages()
 {
     assert(confAvg.size() == failAvg.size());
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++) {
-            confAvg[i][j] *= decay;
-            failAvg[i][j] *= decay;
-        }
-        m_feerate_avg[j] *= decay;
-        txCtAvg[j] *= decay;
-    }
+    for (double& avg : confAvg) avg *= decay;
+    for (double& avg : failAvg) avg *= decay;
+    for (double& avg : m_feerate_avg) avg *= decay;
+    for (double& avg : txCtAvg) avg *= decay;
 }
 
 // returns -1 on error conditions
@@ -244,7 +259,26 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = maxbucketindex;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    const unsigned int bins = GetMaxConfirms();
+    const double* conf_row = &confAvg[(periodTarget - 1) * buckets.size()];
+    const double* fail_row = &failAvg[(periodTarget - 1) * buckets.size()];
+
+    // The unconfirmed txs counted are those that entered between confTarget
+    // and bins - 1 blocks ago. Once the chain is longer than the circular
+    // buffer, their bins are [unconf_begin, unconf_end), wrapping around to
+    // [unconf_wrap_begin, bins) if needed.
+    const bool unconf_runs = nBlockHeight >= bins;
+    unsigned int unconf_begin = 0, unconf_end = 0, unconf_wrap_begin = bins;
+    if (unconf_runs && (unsigned int)confTarget < bins) {
+        const unsigned int count = bins - confTarget;
+        unconf_end = (nBlockHeight - confTarget) % bins + 1;
+        if (count <= unconf_end) {
+            unconf_begin = unconf_end - count;
+        } else {
+            unconf_wrap_begin = bins - (count - unconf_end);
+        }
+    }
+
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -257,11 +291,17 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += conf_row[bucket];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
+        failNum += fail_row[bucket];
+        const int* bucket_unconf = &unconfTxs[bucket * bins];
+        if (unconf_runs) {
+            extraNum = std::accumulate(bucket_unconf + unconf_begin, bucket_unconf + unconf_end, extraNum);
+            extraNum = std::accumulate(bucket_unconf + unconf_wrap_begin, bucket_unconf + bins, extraNum);
+        } else {
+            for (unsigned int confct = confTarget; confct < bins; confct++)
+                extraNum += bucket_unconf[(nBlockHeight - confct) % bins];
+        }
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -380,8 +420,8 @@ void TxConfirmStats::Write(CAutoFile& fileout) const
     fileout << scale;
     fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(m_feerate_avg);
     fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(txCtAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
+    WriteEncodedMatrix(fileout, confAvg, m_max_periods);
+    WriteEncodedMatrix(fileout, failAvg, m_max_periods);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -409,29 +449,39 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    maxPeriods = confAvg.size();
+    std::vector<std::vector<double>> fileConfAvg;
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(fileConfAvg);
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
-    if (maxPeriods != failAvg.size()) {
+    std::vector<std::vector<double>> fileFailAvg;
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(fileFailAvg);
+    if (maxPeriods != fileFailAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fileFailAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    m_max_periods = maxPeriods;
+    confAvg.clear();
+    failAvg.clear();
+    for (unsigned int i = 0; i < maxPeriods; i++) {
+        confAvg.insert(confAvg.end(), fileConfAvg[i].begin(), fileConfAvg[i].end());
+        failAvg.insert(failAvg.end(), fileFailAvg[i].begin(), fileFailAvg[i].end());
+    }
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -443,8 +493,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int blockIndex = nBlockHeight % GetMaxConfirms();
+    unconfTxs[bucketindex * GetMaxConfirms() + blockIndex]++;
     return bucketindex;
 }
 
@@ -459,7 +509,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    const unsigned int bins = GetMaxConfirms();
+    if (blocksAgo >= (int)bins) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -468,9 +519,10 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % bins;
+        int& unconf = unconfTxs[bucketindex * bins + blockIndex];
+        if (unconf > 0) {
+            unconf--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -479,8 +531,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < m_max_periods; i++) {
+            failAvg[i * buckets.size() + bucketindex]++;
         }
     }
 }
@@ -495,6 +547,9 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(m_cs_fee_estimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
+        // Estimates don't count txs that entered at the current height, so
+        // only removing older ones changes them.
+        if (pos->second.blockHeight != nBestSeenHeight) InvalidateEstimates();
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
@@ -618,6 +673,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    InvalidateEstimates();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -805,12 +861,30 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(m_cs_fee_estimator);
+    const bool cacheable = confTarget > 0 && (unsigned int)confTarget <= MAX_CACHED_TARGET;
+    if (cacheable) {
+        const std::shared_ptr<const CachedSmartFee> cached = std::atomic_load(&m_smart_fee_cache[SmartFeeCacheIndex(confTarget, conservative)]);
+        if (cached && cached->generation == m_stats_generation.load()) {
+            if (feeCalc) *feeCalc = cached->calc;
+            return cached->feerate;
+        }
+    }
 
-    if (feeCalc) {
-        feeCalc->desiredTarget = confTarget;
-        feeCalc->returnedTarget = confTarget;
+    LOCK(m_cs_fee_estimator);
+    FeeCalculation calc;
+    const CFeeRate feerate = estimateSmartFeeUncached(confTarget, calc, conservative);
+    if (cacheable) {
+        std::atomic_store(&m_smart_fee_cache[SmartFeeCacheIndex(confTarget, conservative)],
+                          std::make_shared<const CachedSmartFee>(CachedSmartFee{m_stats_generation.load(), feerate, calc}));
     }
+    if (feeCalc) *feeCalc = calc;
+    return feerate;
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation& feeCalc, bool conservative) const
+{
+    feeCalc.desiredTarget = confTarget;
+    feeCalc.returnedTarget = confTarget;
 
     double median = -1;
     EstimationResult tempResult;
@@ -827,7 +901,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     if ((unsigned int)confTarget > maxUsableEstimate) {
         confTarget = maxUsableEstimate;
     }
-    if (feeCalc) feeCalc->returnedTarget = confTarget;
+    feeCalc.returnedTarget = confTarget;
 
     if (confTarget <= 1) return CFeeRate(0); // error condition
 
@@ -843,36 +917,28 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * fluctuations lower our estimates by too much.
      */
     double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
-    if (feeCalc) {
-        feeCalc->est = tempResult;
-        feeCalc->reason = FeeReason::HALF_ESTIMATE;
-    }
+    feeCalc.est = tempResult;
+    feeCalc.reason = FeeReason::HALF_ESTIMATE;
     median = halfEst;
     double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::FULL_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::FULL_ESTIMATE;
     }
     double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::DOUBLE_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::DOUBLE_ESTIMATE;
     }
 
     if (conservative || median == -1) {
         double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
-            if (feeCalc) {
-                feeCalc->est = tempResult;
-                feeCalc->reason = FeeReason::CONSERVATIVE;
-            }
+            feeCalc.est = tempResult;
+            feeCalc.reason = FeeReason::CONSERVATIVE;
         }
     }
 
@@ -969,6 +1035,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            InvalidateEstimates();
         }
     }
     catch (const std::exception& e) {
@@ -1002,8 +1069,9 @@ FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
 
 CAmount FeeFilterRounder::round(CAmount currentMinFee)
 {
+    AssertLockNotHeld(m_insecure_rand_mutex);
     std::set<double>::iterator it = feeset.lower_bound(currentMinFee);
-    if ((it != feeset.begin() && insecure_rand.rand32() % 3 != 0) || it == feeset.end()) {
+    if ((it != feeset.begin() && WITH_LOCK(m_insecure_rand_mutex, return insecure_rand.rand32()) % 3 != 0) || it == feeset.end()) {
         it--;
     }
     return static_cast<CAmount>(*it);
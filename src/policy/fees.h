@@ -12,6 +12,7 @@
 #include <sync.h>
 
 #include <array>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -140,6 +141,8 @@ private:
     /** Track confirm delays up to 1008 blocks for long horizon */
     static constexpr unsigned int LONG_BLOCK_PERIODS = 42;
     static constexpr unsigned int LONG_SCALE = 24;
+    /** Highest target that estimates can be tracked for, and so cached */
+    static constexpr unsigned int MAX_CACHED_TARGET = LONG_BLOCK_PERIODS * LONG_SCALE;
     /** Historical estimates that are older than this aren't valid */
     static const unsigned int OLDEST_ESTIMATE_HISTORY = 6 * 1008;
 
@@ -201,6 +204,8 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Results are cached until the tracked stats change, and cached results
+     *  are returned without taking the estimator lock.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -254,9 +259,33 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    /** An estimateSmartFee result and the stats generation it was computed at */
+    struct CachedSmartFee
+    {
+        uint64_t generation;
+        CFeeRate feerate;
+        FeeCalculation calc;
+    };
+
+    /** Incremented, under m_cs_fee_estimator, whenever the stats that estimates are
+     * computed from change. Cached results from older generations are stale. */
+    std::atomic<uint64_t> m_stats_generation{0};
+
+    /** estimateSmartFee results by target and mode, see SmartFeeCacheIndex.
+     * Slots are only accessed with std::atomic_load and std::atomic_store, and
+     * only written while holding m_cs_fee_estimator. */
+    mutable std::array<std::shared_ptr<const CachedSmartFee>, 2 * (MAX_CACHED_TARGET + 1)> m_smart_fee_cache;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
+    /** Mark all cached estimates as stale */
+    void InvalidateEstimates() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) { ++m_stats_generation; }
+    /** Slot of m_smart_fee_cache for an estimate, confTarget must be in [1, MAX_CACHED_TARGET] */
+    static size_t SmartFeeCacheIndex(int confTarget, bool conservative) { return 2 * confTarget + conservative; }
+    /** estimateSmartFee without the cache */
+    CFeeRate estimateSmartFeeUncached(int confTarget, FeeCalculation& feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Helper for estimateSmartFee */
@@ -283,12 +312,13 @@ public:
     /** Create new FeeFilterRounder */
     explicit FeeFilterRounder(const CFeeRate& minIncrementalFee);
 
-    /** Quantize a minimum fee for privacy purpose before broadcast. Not thread-safe due to use of FastRandomContext */
-    CAmount round(CAmount currentMinFee);
+    /** Quantize a minimum fee for privacy purpose before broadcast. */
+    CAmount round(CAmount currentMinFee) EXCLUSIVE_LOCKS_REQUIRED(!m_insecure_rand_mutex);
 
 private:
     std::set<double> feeset;
-    FastRandomContext insecure_rand;
+    Mutex m_insecure_rand_mutex;
+    FastRandomContext insecure_rand GUARDED_BY(m_insecure_rand_mutex);
 };
 
 #endif // BITCOIN_POLICY_FEES_H
@@ -7,13 +7,16 @@
 #include <chainparams.h>
 #include <core_io.h>
 #include <httpserver.h>
+#include <index/scriptindex.h>
 #include <index/txindex.h>
 #include <node/blockstorage.h>
 #include <node/context.h>
+#include <node/transaction.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
+#include <rpc/rawtransaction_util.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
@@ -708,6 +711,118 @@ static bool rest_blockhash_by_height(const std::any& context, HTTPRequest* req,
     }
 }
 
+static bool rest_scripthistory(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2 && path.size() != 4) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/scripthistory/<count>/<scriptpubkey>[/<height>/<txid>-<n>].json.");
+    }
+
+    int32_t count = 0;
+    if (!ParseInt32(path[0], &count) || count < 1 || count > int32_t(MAX_SCRIPT_HISTORY_COUNT)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Output count out of range: " + SanitizeString(path[0]));
+    }
+    if (!IsHex(path[1])) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid scriptPubKey: " + SanitizeString(path[1]));
+    }
+    const std::vector<unsigned char> script_data{ParseHex(path[1])};
+    const CScript script(script_data.begin(), script_data.end());
+
+    // Continue after the given output, the last one of the previous page.
+    int32_t start_height = 0;
+    std::optional<COutPoint> start_after;
+    if (path.size() == 4) {
+        if (!ParseInt32(path[2], &start_height) || start_height < 0) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[2]));
+        }
+        const size_t sep{path[3].find('-')};
+        const std::string txid_str{path[3].substr(0, sep)};
+        int32_t n = -1;
+        if (sep == std::string::npos || !IsHex(txid_str) || txid_str.size() != 64 || !ParseInt32(path[3].substr(sep + 1), &n) || n < 0) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid output: " + SanitizeString(path[3]));
+        }
+        start_after = COutPoint{uint256S(txid_str), uint32_t(n)};
+    }
+
+    if (!g_script_index) {
+        return RESTERR(req, HTTP_NOT_FOUND, "Script index is not enabled");
+    }
+    if (!g_script_index->BlockUntilSyncedToCurrentChain()) {
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Script index is still syncing");
+    }
+    std::vector<ScriptIndexEntry> entries;
+    if (!g_script_index->LookupScript(script, start_height, start_after, count, /* unspent_only */ false, entries)) {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Unable to read script index");
+    }
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        UniValue result(UniValue::VARR);
+        for (const ScriptIndexEntry& entry : entries) {
+            result.push_back(ScriptIndexEntryToJSON(entry));
+        }
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, result.write() + "\n");
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+static bool rest_sendrawtransactions(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    NodeContext* node = GetNodeContext(context, req);
+    if (!node) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        return RESTERR(req, HTTP_BAD_METHOD, "Transactions must be submitted with POST");
+    }
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        // The request body is a JSON array of hex-encoded transactions
+        UniValue raw_transactions;
+        if (!raw_transactions.read(req->ReadBody()) || !raw_transactions.isArray()) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Request body must be a JSON array of hex-encoded transactions");
+        }
+        if (raw_transactions.size() > MAX_RAW_TX_BATCH_SIZE) {
+            return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Too many transactions: %u (maximum %u)", raw_transactions.size(), MAX_RAW_TX_BATCH_SIZE));
+        }
+        std::vector<CTransactionRef> txns;
+        txns.reserve(raw_transactions.size());
+        for (const UniValue& rawtx : raw_transactions.getValues()) {
+            if (!rawtx.isStr()) {
+                return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Transaction must be a hex string, got %s: %s", uvTypeName(rawtx.type()), rawtx.write()));
+            }
+            CMutableTransaction mtx;
+            if (!DecodeHexTx(mtx, rawtx.get_str())) {
+                return RESTERR(req, HTTP_BAD_REQUEST, "TX decode failed: " + rawtx.write());
+            }
+            txns.emplace_back(MakeTransactionRef(std::move(mtx)));
+        }
+
+        const std::vector<BroadcastResult> results = BroadcastTransactions(*node, txns, DEFAULT_MAX_RAW_TX_FEE_RATE, /*relay*/ true, /*wait_callback*/ true);
+        std::string strJSON = BroadcastResultsToJSON(txns, results).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(const std::any& context, HTTPRequest* req, const std::string& strReq);
@@ -721,6 +836,8 @@ static const struct {
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/scripthistory/", rest_scripthistory},
+      {"/rest/sendrawtransactions", rest_sendrawtransactions},
 };
 
 void StartREST(const std::any& context)
@@ -18,6 +18,8 @@
 #include <hash.h>
 #include <index/blockfilterindex.h>
 #include <index/coinstatsindex.h>
+#include <index/scriptindex.h>
+#include <index/spentindex.h>
 #include <node/blockstorage.h>
 #include <node/coinstats.h>
 #include <node/context.h>
@@ -2211,7 +2213,8 @@ static RPCHelpMan savemempool()
         throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
     }
 
-    if (!DumpMempool(mempool)) {
+    ChainstateManager& chainman = EnsureAnyChainman(request.context);
+    if (!DumpMempool(mempool, chainman.ActiveChainstate())) {
         throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
     }
 
@@ -2519,6 +2522,176 @@ static RPCHelpMan getblockfilter()
     };
 }
 
+UniValue ScriptIndexEntryToJSON(const ScriptIndexEntry& entry)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("height", entry.height);
+    result.pushKV("txid", entry.outpoint.hash.GetHex());
+    result.pushKV("vout", (int)entry.outpoint.n);
+    result.pushKV("amount", ValueFromAmount(entry.value));
+    if (entry.IsSpent()) {
+        UniValue spent(UniValue::VOBJ);
+        spent.pushKV("txid", entry.spending_txid.GetHex());
+        spent.pushKV("vin", (int)entry.spending_vin);
+        spent.pushKV("height", entry.spending_height);
+        result.pushKV("spent", spent);
+    }
+    return result;
+}
+
+static RPCHelpMan getscripthistory()
+{
+    return RPCHelpMan{"getscripthistory",
+                "\nReturn the outputs paying to a scriptPubKey in the active chain, and the inputs that spent them.\n"
+                "Requires -scriptindex. Outputs are ordered by the height of the block that created them, then\n"
+                "by txid and output number; pass the last output returned as after to get the next page.\n",
+                {
+                    {"scriptpubkey", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hex-encoded scriptPubKey"},
+                    {"from_height", RPCArg::Type::NUM, RPCArg::Default{0}, "Only return outputs created at or above this height"},
+                    {"count", RPCArg::Type::NUM, RPCArg::Default{int(MAX_SCRIPT_HISTORY_COUNT)}, strprintf("The number of outputs to return (at most %u)", MAX_SCRIPT_HISTORY_COUNT)},
+                    {"after", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED_NAMED_ARG, "Only return outputs ordered after this one",
+                        {
+                            {"height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the block that created the output"},
+                            {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The transaction id"},
+                            {"vout", RPCArg::Type::NUM, RPCArg::Optional::NO, "The output number"},
+                        },
+                    },
+                    {"unspent_only", RPCArg::Type::BOOL, RPCArg::Default{false}, "Only return outputs that are not spent in the active chain"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "height", "The height of the block that created the output"},
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                            {RPCResult::Type::NUM, "vout", "The output number"},
+                            {RPCResult::Type::STR_AMOUNT, "amount", "The output value in " + CURRENCY_UNIT},
+                            {RPCResult::Type::OBJ, "spent", /* optional */ true, "The input spending the output, if any",
+                            {
+                                {RPCResult::Type::STR_HEX, "txid", "The spending transaction id"},
+                                {RPCResult::Type::NUM, "vin", "The input number"},
+                                {RPCResult::Type::NUM, "height", "The height of the block that spent the output"},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getscripthistory", "\"0014d85c2b71d0060b09c9886aeb815e50991dda124d\"") +
+                    HelpExampleCli("getscripthistory", "\"0014d85c2b71d0060b09c9886aeb815e50991dda124d\" 700000 100 '{\"height\":700010,\"txid\":\"mytxid\",\"vout\":0}' true") +
+                    HelpExampleRpc("getscripthistory", "\"0014d85c2b71d0060b09c9886aeb815e50991dda124d\", 700000, 100")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const std::vector<unsigned char> script_data{ParseHexV(request.params[0], "scriptpubkey")};
+    const CScript script(script_data.begin(), script_data.end());
+    const int from_height{request.params[1].isNull() ? 0 : request.params[1].get_int()};
+    int start_height{request.params[1].isNull() ? 0 : request.params[1].get_int()};
+    const int count{request.params[2].isNull() ? int(MAX_SCRIPT_HISTORY_COUNT) : request.params[2].get_int()};
+    const bool unspent_only{request.params[4].isNull() ? false : request.params[4].get_bool()};
+    if (start_height < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from_height");
+    }
+    if (count < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    }
+    if (count > int(MAX_SCRIPT_HISTORY_COUNT)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be at most %u", MAX_SCRIPT_HISTORY_COUNT));
+    }
+    // Resume from the key of the given output, unless from_height is past it.
+    std::optional<COutPoint> start_after;
+    if (!request.params[3].isNull()) {
+        const UniValue& after{request.params[3].get_obj()};
+        RPCTypeCheckObj(after,
+            {
+                {"height", UniValueType(UniValue::VNUM)},
+                {"txid", UniValueType(UniValue::VSTR)},
+                {"vout", UniValueType(UniValue::VNUM)},
+            }, /* fAllowNull */ false, /* fStrict */ false);
+        const int after_height{find_value(after, "height").get_int()};
+        const int after_vout{find_value(after, "vout").get_int()};
+        if (after_vout < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, vout cannot be negative");
+        }
+        if (after_height >= start_height) {
+            start_height = after_height;
+            start_after = COutPoint{ParseHashO(after, "txid"), uint32_t(after_vout)};
+        }
+    }
+
+    if (!g_script_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Script index is not enabled. Use -scriptindex to enable it.");
+    }
+    if (!g_script_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Unable to get data because scriptindex is still syncing. Current height: %d",
+                                                     g_script_index->GetSummary().best_block_height));
+    }
+
+    std::vector<ScriptIndexEntry> entries;
+    if (!g_script_index->LookupScript(script, start_height, start_after, count, unspent_only, entries)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read script index");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const ScriptIndexEntry& entry : entries) {
+        result.push_back(ScriptIndexEntryToJSON(entry));
+    }
+    return result;
+},
+    };
+}
+
+static RPCHelpMan getspentinfo()
+{
+    return RPCHelpMan{"getspentinfo",
+                "\nReturn the input that spent an output in the active chain, and the value of the output.\n"
+                "Requires -spentindex.\n",
+                {
+                    {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The transaction id"},
+                    {"vout", RPCArg::Type::NUM, RPCArg::Optional::NO, "The output number"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_HEX, "txid", "The spending transaction id"},
+                        {RPCResult::Type::NUM, "vin", "The input number"},
+                        {RPCResult::Type::NUM, "height", "The height of the block that spent the output"},
+                        {RPCResult::Type::STR_AMOUNT, "value", "The value of the spent output in " + CURRENCY_UNIT},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getspentinfo", "\"mytxid\" 1") +
+                    HelpExampleRpc("getspentinfo", "\"mytxid\", 1")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const uint256 txid{ParseHashV(request.params[0], "txid")};
+    const int vout{request.params[1].get_int()};
+    if (vout < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, vout cannot be negative");
+    }
+
+    if (!g_spent_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index is not enabled. Use -spentindex to enable it.");
+    }
+    if (!g_spent_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Unable to get data because spentindex is still syncing. Current height: %d",
+                                                     g_spent_index->GetSummary().best_block_height));
+    }
+
+    SpentIndexEntry entry;
+    if (!g_spent_index->FindSpender(COutPoint{txid, static_cast<uint32_t>(vout)}, entry)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Output is not spent in the active chain");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", entry.spending_txid.GetHex());
+    result.pushKV("vin", (int)entry.spending_vin);
+    result.pushKV("height", entry.spending_height);
+    result.pushKV("value", ValueFromAmount(entry.value));
+    return result;
+},
+    };
+}
+
 /**
  * Serialize the UTXO set to a file for loading elsewhere.
  *
@@ -2665,6 +2838,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         &preciousblock,                      },
     { "blockchain",         &scantxoutset,                       },
     { "blockchain",         &getblockfilter,                     },
+    { "blockchain",         &getscripthistory,                   },
+    { "blockchain",         &getspentinfo,                       },
 
     /* Not shown in help */
     { "hidden",              &invalidateblock,                   },
@@ -24,6 +24,7 @@ class CTxMemPool;
 class ChainstateManager;
 class UniValue;
 struct NodeContext;
+struct ScriptIndexEntry;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
 
@@ -50,6 +51,9 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool includ
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
+/** Script index entry to JSON */
+UniValue ScriptIndexEntryToJSON(const ScriptIndexEntry& entry);
+
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
@@ -601,7 +601,7 @@ static RPCHelpMan getblocktemplate()
 {
     NodeContext& node = EnsureAnyNodeContext(request.context);
     ChainstateManager& chainman = EnsureChainman(node);
-    LOCK(cs_main);
+    WAIT_LOCK(cs_main, main_lock);
 
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
@@ -747,25 +747,43 @@ static RPCHelpMan getblocktemplate()
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != active_chain.Tip() ||
+    // Use the template kept up to date with the mempool, if there is one
+    std::unique_ptr<CBlockTemplate> cached_template;
+    if (node.block_template_cache && pindexPrev == active_chain.Tip()) {
+        cached_template = node.block_template_cache->GetBlockTemplate(active_chain.Tip());
+    }
+    if (cached_template) {
+        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        pblocktemplate = std::move(cached_template);
+    } else if (pindexPrev != active_chain.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
 
-        // Store the pindexBest used before CreateNewBlock, to avoid races
+        // Store the mempool state used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = active_chain.Tip();
         nStart = GetTime();
 
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(active_chainstate, mempool, Params()).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate)
+        // Create new block. Release cs_main meanwhile, so that transactions
+        // selected from a mempool snapshot don't hold up validation.
+        std::unique_ptr<CBlockTemplate> new_template;
+        {
+            REVERSE_LOCK(main_lock);
+            if (node.block_template_cache) {
+                new_template = node.block_template_cache->CreateNewBlock(active_chainstate);
+            } else {
+                CScript scriptDummy = CScript() << OP_TRUE;
+                new_template = BlockAssembler(active_chainstate, mempool, Params()).CreateNewBlock(scriptDummy);
+            }
+        }
+        if (!new_template)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
+        // Need to update only after we know CreateNewBlock succeeded. The tip
+        // may have moved while cs_main was released, so use the template's.
+        pindexPrev = chainman.m_blockman.LookupBlockIndex(new_template->block.hashPrevBlock);
+        pblocktemplate = std::move(new_template);
     }
     CHECK_NONFATAL(pindexPrev);
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
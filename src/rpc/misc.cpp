@@ -6,6 +6,8 @@
 #include <httpserver.h>
 #include <index/blockfilterindex.h>
 #include <index/coinstatsindex.h>
+#include <index/scriptindex.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <interfaces/echo.h>
@@ -19,6 +21,7 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/strencodings.h>
@@ -457,6 +460,18 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCSignatureCacheInfo()
+{
+    const SignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("shards", uint64_t(stats.shards));
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("erases", stats.erases);
+    obj.pushKV("inserts", stats.inserts);
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -501,6 +516,14 @@ static RPCHelpMan getmemoryinfo()
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
                             }},
+                            {RPCResult::Type::OBJ, "sigcache", "Information about the signature cache",
+                            {
+                                {RPCResult::Type::NUM, "shards", "Number of independently locked shards the cache is split into"},
+                                {RPCResult::Type::NUM, "hits", "Number of signature lookups found in the cache"},
+                                {RPCResult::Type::NUM, "misses", "Number of signature lookups not found in the cache"},
+                                {RPCResult::Type::NUM, "erases", "Number of hits that removed the entry, as done when connecting blocks"},
+                                {RPCResult::Type::NUM, "inserts", "Number of signatures added to the cache"},
+                            }},
                         }
                     },
                     RPCResult{"mode \"mallocinfo\"",
@@ -517,6 +540,7 @@ static RPCHelpMan getmemoryinfo()
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("sigcache", RPCSignatureCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -739,6 +763,14 @@ static RPCHelpMan getindexinfo()
         result.pushKVs(SummaryToJSON(g_coin_stats_index->GetSummary(), index_name));
     }
 
+    if (g_script_index) {
+        result.pushKVs(SummaryToJSON(g_script_index->GetSummary(), index_name));
+    }
+
+    if (g_spent_index) {
+        result.pushKVs(SummaryToJSON(g_spent_index->GetSummary(), index_name));
+    }
+
     ForEachBlockFilterIndex([&result, &index_name](const BlockFilterIndex& index) {
         result.pushKVs(SummaryToJSON(index.GetSummary(), index_name));
     });
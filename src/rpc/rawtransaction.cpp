@@ -7,6 +7,7 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <merkleblock.h>
@@ -30,6 +31,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <uint256.h>
+#include <undo.h>
 #include <util/bip32.h>
 #include <util/moneystr.h>
 #include <util/strencodings.h>
@@ -38,6 +40,7 @@
 #include <validationinterface.h>
 
 #include <numeric>
+#include <optional>
 #include <stdint.h>
 
 #include <univalue.h>
@@ -49,7 +52,20 @@ static void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue&
     // Blockchain contextual information (confirmations and blocktime) is not
     // available to code in bitcoin-common, so we query them here and push the
     // data into the returned UniValue.
-    TxToUniv(tx, uint256(), entry, true, RPCSerializationFlags());
+    //
+    // The fee of a confirmed transaction is reported if the spent index can
+    // value its inputs.
+    std::optional<CTxUndo> txundo;
+    if (!hashBlock.IsNull() && !tx.IsCoinBase() && g_spent_index && g_spent_index->BlockUntilSyncedToCurrentChain()) {
+        std::vector<CAmount> values;
+        if (g_spent_index->FindPrevoutValues(tx, values)) {
+            txundo.emplace();
+            for (const CAmount value : values) {
+                txundo->vprevout.emplace_back(CTxOut(value, CScript()), 0, false);
+            }
+        }
+    }
+    TxToUniv(tx, uint256(), entry, true, RPCSerializationFlags(), txundo ? &*txundo : nullptr);
 
     if (!hashBlock.IsNull()) {
         LOCK(cs_main);
@@ -141,6 +157,7 @@ static RPCHelpMan getrawtransaction()
                                      }},
                                  }},
                              }},
+                             {RPCResult::Type::STR_AMOUNT, "fee", /* optional */ true, "The transaction fee in " + CURRENCY_UNIT + ", only present for confirmed transactions if -spentindex is enabled"},
                              {RPCResult::Type::STR_HEX, "blockhash", "the block hash"},
                              {RPCResult::Type::NUM, "confirmations", "The confirmations"},
                              {RPCResult::Type::NUM_TIME, "blocktime", "The block time expressed in " + UNIX_EPOCH_TIME},
@@ -882,6 +899,78 @@ static RPCHelpMan sendrawtransaction()
     };
 }
 
+static RPCHelpMan sendrawtransactions()
+{
+    return RPCHelpMan{"sendrawtransactions",
+                "\nSubmit a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe scripts of all transactions are checked in parallel on the script verification threads (see -par)\n"
+                "before they are submitted to the mempool, parents in the batch before their children.\n"
+                "Unlike testmempoolaccept, the transactions are submitted individually, so some may be\n"
+                "accepted while others are rejected.\n"
+                "\nThe maximum number of transactions allowed is " + ToString(MAX_RAW_TX_BATCH_SIZE) + ".\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, RPCArg::Default{FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK())},
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kvB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The result for each raw transaction, in the same order they were passed in.",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                            {RPCResult::Type::STR_HEX, "wtxid", "The transaction witness hash in hex"},
+                            {RPCResult::Type::STR, "error", /* optional */ true, "Why the transaction was not submitted (only present if it wasn't)"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("sendrawtransactions", R"('["signedhex1", "signedhex2"]')") +
+                    HelpExampleRpc("sendrawtransactions", R"(["signedhex1", "signedhex2"])")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // VNUM or VSTR, checked inside AmountFromValue()
+    });
+    const UniValue& raw_transactions = request.params[0].get_array();
+    if (raw_transactions.size() > MAX_RAW_TX_BATCH_SIZE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Array must contain at most %u transactions.", MAX_RAW_TX_BATCH_SIZE));
+    }
+
+    const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ?
+                                             DEFAULT_MAX_RAW_TX_FEE_RATE :
+                                             CFeeRate(AmountFromValue(request.params[1]));
+
+    std::vector<CTransactionRef> txns;
+    txns.reserve(raw_transactions.size());
+    for (const auto& rawtx : raw_transactions.getValues()) {
+        if (!rawtx.isStr()) {
+            throw JSONRPCError(RPC_TYPE_ERROR, strprintf("Transaction must be a hex string, got %s: %s", uvTypeName(rawtx.type()), rawtx.write()));
+        }
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtx.get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                               "TX decode failed: " + rawtx.get_str() + " Make sure the tx has at least one input.");
+        }
+        txns.emplace_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    AssertLockNotHeld(cs_main);
+    NodeContext& node = EnsureAnyNodeContext(request.context);
+    const std::vector<BroadcastResult> results = BroadcastTransactions(node, txns, max_raw_tx_fee_rate, /*relay*/ true, /*wait_callback*/ true);
+    return BroadcastResultsToJSON(txns, results);
+},
+    };
+}
+
 static RPCHelpMan testmempoolaccept()
 {
     return RPCHelpMan{"testmempoolaccept",
@@ -1903,6 +1992,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",     &decoderawtransaction,       },
     { "rawtransactions",     &decodescript,               },
     { "rawtransactions",     &sendrawtransaction,         },
+    { "rawtransactions",     &sendrawtransactions,        },
     { "rawtransactions",     &combinerawtransaction,      },
     { "rawtransactions",     &signrawtransactionwithkey,  },
     { "rawtransactions",     &testmempoolaccept,          },
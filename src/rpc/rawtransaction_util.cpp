@@ -8,6 +8,7 @@
 #include <coins.h>
 #include <core_io.h>
 #include <key_io.h>
+#include <node/transaction.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/request.h>
@@ -308,3 +309,19 @@ void SignTransactionResultToJSON(CMutableTransaction& mtx, bool complete, const
         result.pushKV("errors", vErrors);
     }
 }
+
+UniValue BroadcastResultsToJSON(const std::vector<CTransactionRef>& txs, const std::vector<BroadcastResult>& results)
+{
+    CHECK_NONFATAL(txs.size() == results.size());
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", txs[i]->GetHash().GetHex());
+        entry.pushKV("wtxid", txs[i]->GetWitnessHash().GetHex());
+        if (results[i].error != TransactionError::OK) {
+            entry.pushKV("error", results[i].err_string.empty() ? TransactionErrorString(results[i].error).original : results[i].err_string);
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
@@ -5,9 +5,13 @@
 #ifndef BITCOIN_RPC_RAWTRANSACTION_UTIL_H
 #define BITCOIN_RPC_RAWTRANSACTION_UTIL_H
 
+#include <primitives/transaction.h>
+
 #include <map>
 #include <string>
+#include <vector>
 
+struct BroadcastResult;
 struct bilingual_str;
 class FillableSigningProvider;
 class UniValue;
@@ -40,4 +44,7 @@ void ParsePrevouts(const UniValue& prevTxsUnival, FillableSigningProvider* keyst
 /** Create a transaction from univalue parameters */
 CMutableTransaction ConstructTransaction(const UniValue& inputs_in, const UniValue& outputs_in, const UniValue& locktime, bool rbf);
 
+/** Describe the outcome of broadcasting each of txs, as returned by BroadcastTransactions */
+UniValue BroadcastResultsToJSON(const std::vector<CTransactionRef>& txs, const std::vector<BroadcastResult>& results);
+
 #endif // BITCOIN_RPC_RAWTRANSACTION_UTIL_H
@@ -13,15 +13,37 @@
 #include <cuckoocache.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <shared_mutex>
 #include <vector>
 
 namespace {
+/**
+ * One independently locked part of the signature cache. Shards are aligned to
+ * a cache line so that the locks and counters of different shards don't
+ * share one.
+ */
+struct alignas(64) SignatureCacheShard
+{
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    std::shared_mutex cs_sigcache;
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_erases{0};
+    std::atomic<uint64_t> m_inserts{0};
+};
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * The cache is split into SIGNATURE_CACHE_SHARDS shards selected by the
+ * entry, so that script check threads looking up or erasing entries during
+ * block validation rarely contend on the same lock.
  */
 class CSignatureCache
 {
@@ -29,9 +51,16 @@ private:
      //! Entries are SHA256(nonce || 'E' or 'S' || 31 zero bytes || signature hash || public key || signature):
     CSHA256 m_salted_hasher_ecdsa;
     CSHA256 m_salted_hasher_schnorr;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    std::shared_mutex cs_sigcache;
+    std::array<SignatureCacheShard, SIGNATURE_CACHE_SHARDS> m_shards;
+
+    SignatureCacheShard& GetShard(const uint256& entry)
+    {
+        // The cuckoo cache maps the hashes of an entry to buckets by their
+        // high bits, so the low bits of the first hash word are free to
+        // select the shard.
+        static_assert((SIGNATURE_CACHE_SHARDS & (SIGNATURE_CACHE_SHARDS - 1)) == 0, "SIGNATURE_CACHE_SHARDS must be a power of two");
+        return m_shards[*entry.begin() & (SIGNATURE_CACHE_SHARDS - 1)];
+    }
 
 public:
     CSignatureCache()
@@ -66,18 +95,53 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        SignatureCacheShard& shard = GetShard(entry);
+        bool found;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.cs_sigcache);
+            found = shard.setValid.contains(entry, erase);
+        }
+        if (!found) {
+            shard.m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        shard.m_hits.fetch_add(1, std::memory_order_relaxed);
+        if (erase) shard.m_erases.fetch_add(1, std::memory_order_relaxed);
+        return true;
     }
 
     void Set(const uint256& entry)
     {
-        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        SignatureCacheShard& shard = GetShard(entry);
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.cs_sigcache);
+            shard.setValid.insert(entry);
+        }
+        shard.m_inserts.fetch_add(1, std::memory_order_relaxed);
     }
-    uint32_t setup_bytes(size_t n)
+
+    //! Split n bytes evenly among the shards, returning the total number of elements.
+    size_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        size_t elems = 0;
+        for (SignatureCacheShard& shard : m_shards) {
+            std::unique_lock<std::shared_mutex> lock(shard.cs_sigcache);
+            elems += shard.setValid.setup_bytes(n / SIGNATURE_CACHE_SHARDS);
+        }
+        return elems;
+    }
+
+    SignatureCacheStats GetStats() const
+    {
+        SignatureCacheStats stats;
+        stats.shards = SIGNATURE_CACHE_SHARDS;
+        for (const SignatureCacheShard& shard : m_shards) {
+            stats.hits += shard.m_hits.load(std::memory_order_relaxed);
+            stats.misses += shard.m_misses.load(std::memory_order_relaxed);
+            stats.erases += shard.m_erases.load(std::memory_order_relaxed);
+            stats.inserts += shard.m_inserts.load(std::memory_order_relaxed);
+        }
+        return stats;
     }
 };
 
@@ -102,6 +166,11 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifyECDSASignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
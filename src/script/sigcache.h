@@ -10,6 +10,7 @@
 #include <span.h>
 #include <util/hasher.h>
 
+#include <cstdint>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -18,6 +19,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+// Number of independently locked shards the signature cache is split into
+static const size_t SIGNATURE_CACHE_SHARDS = 16;
 
 class CPubKey;
 
@@ -35,4 +38,17 @@ public:
 
 void InitSignatureCache();
 
+/** Signature cache lookup counters, summed over all shards since startup. */
+struct SignatureCacheStats
+{
+    size_t shards{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    //! Hits that also erased the entry, as done when connecting blocks.
+    uint64_t erases{0};
+    uint64_t inserts{0};
+};
+
+SignatureCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
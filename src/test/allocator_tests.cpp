@@ -2,12 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <memusage.h>
+#include <support/allocators/pool.h>
 #include <support/lockedpool.h>
 #include <util/system.h>
 
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -235,4 +238,61 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_reuse)
+{
+    PoolResource<128, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Blocks of the same rounded size are served from the same freelist.
+    void* a = resource.Allocate(8, 8);
+    void* b = resource.Allocate(16, 8);
+    BOOST_CHECK(a != b);
+    resource.Deallocate(a, 8, 8);
+    BOOST_CHECK_EQUAL(resource.Allocate(5, 8), a);
+    resource.Deallocate(b, 16, 8);
+    BOOST_CHECK_EQUAL(resource.Allocate(16, 8), b);
+
+    // Too large blocks bypass the pool.
+    void* large = resource.Allocate(256, 8);
+    resource.Deallocate(large, 256, 8);
+
+    // Exhausting the chunk allocates another one.
+    for (int i = 0; i < 1024 / 128; ++i) {
+        resource.Allocate(128, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_unordered_map)
+{
+    using Map = std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                   PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>) + sizeof(void*) * 4>>;
+    Map::allocator_type::ResourceType resource;
+    size_t usage_empty;
+    {
+        Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+        usage_empty = memusage::DynamicUsage(map);
+        for (uint64_t i = 0; i < 100000; ++i) {
+            map[i] = i;
+        }
+        BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+        // Memory usage is accounted in whole chunks.
+        BOOST_CHECK(memusage::DynamicUsage(map) >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes());
+        for (uint64_t i = 0; i < 100000; ++i) {
+            BOOST_CHECK_EQUAL(map.at(i), i);
+        }
+    }
+    BOOST_CHECK(usage_empty > 0);
+
+    // Nodes freed by the first map are reused by the next one, without
+    // allocating more chunks.
+    const size_t chunks = resource.NumAllocatedChunks();
+    Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+    for (uint64_t i = 0; i < 100000; ++i) {
+        map[i] = i;
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -300,6 +300,65 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(LargeBlockRoundTripTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+    block.vtx.resize(1);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    std::vector<CTransactionRef> missing;
+    LOCK2(cs_main, pool.cs);
+    for (int i = 0; i < 3000; i++) {
+        tx.vin[0].prevout.hash = InsecureRand256();
+        const CTransactionRef ptx = MakeTransactionRef(tx);
+        // Half of the mempool is in the block, and every tenth tx of the block isn't in the mempool
+        if (i % 20 != 1) pool.addUnchecked(entry.FromTx(ptx));
+        if (i % 2 == 1) block.vtx.push_back(ptx);
+        if (i % 20 == 1) missing.push_back(ptx);
+    }
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())) ++block.nNonce;
+
+    CBlockHeaderAndShortTxIDs shortIDs(block, true);
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), i % 10 != 1);
+    }
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2, &mutated).ToString());
+}
+
+BOOST_AUTO_TEST_CASE(ShortIDCollisionTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    // Two transactions in the block with the same short ID can't be told apart
+    TestHeaderAndShortIDs shortIDs(block);
+    BOOST_REQUIRE_EQUAL(shortIDs.shorttxids.size(), 2U);
+    shortIDs.shorttxids[1] = shortIDs.shorttxids[0];
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_FAILED);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -36,20 +36,27 @@ static bool CheckFilterLookups(BlockFilterIndex& filter_index, const CBlockIndex
     uint256 filter_header;
     std::vector<BlockFilter> filters;
     std::vector<uint256> filter_hashes;
+    std::vector<BlockFilterIndex::SerializedFilter> serialized_filters;
 
     BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
     BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
     BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
     BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight, block_index,
                                                    filter_hashes));
+    BOOST_CHECK(filter_index.LookupSerializedFilterRange(block_index->nHeight, block_index,
+                                                         serialized_filters));
 
     BOOST_CHECK_EQUAL(filters.size(), 1U);
+    BOOST_CHECK_EQUAL(serialized_filters.size(), 1U);
     BOOST_CHECK_EQUAL(filter_hashes.size(), 1U);
 
     BOOST_CHECK_EQUAL(filter.GetHash(), expected_filter.GetHash());
     BOOST_CHECK_EQUAL(filter_header, expected_filter.ComputeHeader(last_header));
     BOOST_CHECK_EQUAL(filters[0].GetHash(), expected_filter.GetHash());
     BOOST_CHECK_EQUAL(filter_hashes[0], expected_filter.GetHash());
+    CDataStream expected_serialized(SER_NETWORK, PROTOCOL_VERSION);
+    expected_serialized << expected_filter;
+    BOOST_CHECK(MakeUCharSpan(expected_serialized) == MakeUCharSpan(*serialized_filters[0]));
 
     filters.clear();
     filter_hashes.clear();
@@ -259,6 +266,21 @@ BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, BuildChainTestingSetup)
     BOOST_CHECK_EQUAL(filters.size(), tip->nHeight + 1U);
     BOOST_CHECK_EQUAL(filter_hashes.size(), tip->nHeight + 1U);
 
+    // Test serialized range lookups, both from disk and from the cache, which
+    // by now holds some of the filters of the range.
+    for (int i = 0; i < 2; ++i) {
+        std::vector<BlockFilterIndex::SerializedFilter> serialized_filters;
+        BOOST_CHECK(filter_index.LookupSerializedFilterRange(0, tip, serialized_filters));
+        BOOST_REQUIRE_EQUAL(serialized_filters.size(), filters.size());
+        for (size_t j = 0; j < filters.size(); ++j) {
+            CDataStream expected_serialized(SER_NETWORK, PROTOCOL_VERSION);
+            expected_serialized << filters[j];
+            BOOST_CHECK(MakeUCharSpan(expected_serialized) == MakeUCharSpan(*serialized_filters[j]));
+        }
+    }
+    std::vector<BlockFilterIndex::SerializedFilter> serialized_filters;
+    BOOST_CHECK(!filter_index.LookupSerializedFilterRange(tip->nHeight + 1, tip, serialized_filters));
+
     filters.clear();
     filter_hashes.clear();
 
@@ -266,6 +288,32 @@ BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, BuildChainTestingSetup)
     filter_index.Stop();
 }
 
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_parallel_sync, BuildChainTestingSetup)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+    BOOST_REQUIRE(filter_index.Start(m_node.chainman->ActiveChainstate(), /* sync_threads */ 4));
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // Filters built on the sync threads are chained into the same headers.
+    uint256 last_header;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* block_index = m_node.chainman->ActiveChain().Genesis();
+             block_index != nullptr;
+             block_index = m_node.chainman->ActiveChain().Next(block_index)) {
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+    }
+
+    filter_index.Stop();
+}
+
 BOOST_FIXTURE_TEST_CASE(blockfilter_index_init_destroy, BasicTestingSetup)
 {
     BlockFilterIndex* filter_index;
@@ -7,15 +7,28 @@
 
 #include <blockfilter.h>
 #include <core_io.h>
+#include <crypto/siphash.h>
 #include <serialize.h>
 #include <streams.h>
 #include <univalue.h>
+#include <util/golombrice.h>
 #include <util/strencodings.h>
 
+#include <tuple>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_AUTO_TEST_SUITE(blockfilter_tests)
 
+// Upper 64 bits of x * n, computed on 32-bit halves.
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+    const uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    const uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    const uint64_t mid34 = ((x_lo * n_lo) >> 32) + ((x_lo * n_hi) & 0xFFFFFFFF) + ((x_hi * n_lo) & 0xFFFFFFFF);
+    return x_hi * n_hi + ((x_lo * n_hi) >> 32) + ((x_hi * n_lo) >> 32) + (mid34 >> 32);
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_test)
 {
     GCSFilter::ElementSet included_elements, excluded_elements;
@@ -39,6 +52,56 @@ BOOST_AUTO_TEST_CASE(gcsfilter_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(gcsfilter_encoding)
+{
+    // Check the filter encoding against one built with CSipHasher, std::sort
+    // and the bit-at-a-time Golomb-Rice coder, for sets sorted both with and
+    // without a radix sort, and quotients longer than a word.
+    FastRandomContext rng(/* fDeterministic */ true);
+    for (const auto& [n, P, M] : std::vector<std::tuple<int, uint8_t, uint32_t>>{
+             {1, BASIC_FILTER_P, BASIC_FILTER_M}, {100, BASIC_FILTER_P, BASIC_FILTER_M},
+             {3000, BASIC_FILTER_P, BASIC_FILTER_M}, {1000, 0, 1 << 6}, {1000, 2, 1 << 12}, {1000, 40, 1U << 31}}) {
+        GCSFilter::ElementSet elements;
+        while (elements.size() < static_cast<size_t>(n)) {
+            elements.insert(rng.randbytes(rng.randrange(40)));
+        }
+        const GCSFilter::Params params(rng.rand64(), rng.rand64(), P, M);
+        const uint64_t F = static_cast<uint64_t>(n) * M;
+
+        std::vector<uint64_t> hashes;
+        for (const auto& element : elements) {
+            const uint64_t hash = CSipHasher(params.m_siphash_k0, params.m_siphash_k1).Write(element.data(), element.size()).Finalize();
+            hashes.push_back(MapIntoRange(hash, F));
+        }
+        std::sort(hashes.begin(), hashes.end());
+        std::vector<unsigned char> expected;
+        {
+            CVectorWriter stream(SER_NETWORK, 0, expected, 0);
+            WriteCompactSize(stream, n);
+            BitStreamWriter<CVectorWriter> bitwriter(stream);
+            uint64_t last_value = 0;
+            for (uint64_t value : hashes) {
+                GolombRiceEncode(bitwriter, P, value - last_value);
+                last_value = value;
+            }
+        }
+
+        const GCSFilter filter(params, elements);
+        BOOST_CHECK(filter.GetEncoded() == expected);
+        BOOST_CHECK(GCSFilter(params, expected).GetEncoded() == expected);
+        for (const auto& element : elements) {
+            BOOST_CHECK(filter.Match(element));
+        }
+
+        // A truncated or padded encoding is rejected.
+        std::vector<unsigned char> truncated(expected.begin(), expected.end() - 1);
+        BOOST_CHECK_THROW(GCSFilter(params, truncated), std::ios_base::failure);
+        std::vector<unsigned char> padded(expected);
+        padded.push_back(0);
+        BOOST_CHECK_THROW(GCSFilter(params, padded), std::ios_base::failure);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
 {
     GCSFilter filter;
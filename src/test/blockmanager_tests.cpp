@@ -0,0 +1,79 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <flatfile.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmanager_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockmanager_read_mmap)
+{
+    const CChainParams& params = Params();
+    std::vector<const CBlockIndex*> indexes;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = m_node.chainman->ActiveChain().Tip(); pindex->pprev; pindex = pindex->pprev) {
+            indexes.push_back(pindex);
+        }
+    }
+
+    for (const CBlockIndex* pindex : indexes) {
+        g_mmap_blocks = false;
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, params.GetConsensus()));
+        std::vector<uint8_t> raw_block;
+        BOOST_REQUIRE(ReadRawBlockFromDisk(raw_block, pindex, params.MessageStart()));
+        CBlockUndo blockundo;
+        BOOST_REQUIRE(UndoReadFromDisk(blockundo, pindex));
+        std::shared_ptr<const MappedFlatFile> map;
+        Span<const uint8_t> mapped_block;
+        BOOST_CHECK(!ReadRawBlockFromDisk(mapped_block, map, pindex->GetBlockPos(), params.MessageStart()));
+        BOOST_CHECK(!map);
+
+        g_mmap_blocks = true;
+        CBlock block_mmap;
+        BOOST_REQUIRE(ReadBlockFromDisk(block_mmap, pindex, params.GetConsensus()));
+        BOOST_CHECK_EQUAL(block_mmap.GetHash(), block.GetHash());
+        std::vector<uint8_t> raw_block_mmap;
+        BOOST_REQUIRE(ReadRawBlockFromDisk(raw_block_mmap, pindex, params.MessageStart()));
+        BOOST_CHECK(raw_block_mmap == raw_block);
+        CBlockUndo blockundo_mmap;
+        BOOST_REQUIRE(UndoReadFromDisk(blockundo_mmap, pindex));
+        BOOST_CHECK(SerializeHash(blockundo_mmap) == SerializeHash(blockundo));
+
+        // The zero-copy read points into the mapping of the block file.
+        BOOST_REQUIRE(ReadRawBlockFromDisk(mapped_block, map, pindex->GetBlockPos(), params.MessageStart()));
+        BOOST_REQUIRE(map);
+        BOOST_CHECK(mapped_block.data() >= map->Data().data());
+        BOOST_CHECK(mapped_block.data() + mapped_block.size() <= map->Data().data() + map->Data().size());
+        BOOST_CHECK(std::equal(mapped_block.begin(), mapped_block.end(), raw_block.begin(), raw_block.end()));
+
+        // A wrong network magic is detected.
+        CMessageHeader::MessageStartChars bad_start;
+        std::copy(params.MessageStart(), params.MessageStart() + CMessageHeader::MESSAGE_START_SIZE, bad_start);
+        bad_start[0] ^= 1;
+        BOOST_CHECK(!ReadRawBlockFromDisk(mapped_block, map, pindex->GetBlockPos(), bad_start));
+        BOOST_CHECK(!map);
+    }
+
+    // Blocks written after their file was mapped can be read as well.
+    g_mmap_blocks = true;
+    const CBlock new_block = CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    CBlock block_mmap;
+    BOOST_REQUIRE(ReadBlockFromDisk(block_mmap, WITH_LOCK(cs_main, return m_node.chainman->ActiveChain().Tip()), params.GetConsensus()));
+    BOOST_CHECK_EQUAL(block_mmap.GetHash(), new_block.GetHash());
+    g_mmap_blocks = DEFAULT_MMAP_BLOCKS;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
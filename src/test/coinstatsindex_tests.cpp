@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <script/standard.h>
 #include <test/util/setup_common.h>
 #include <util/time.h>
 #include <validation.h>
@@ -76,4 +78,43 @@ BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
     // Rest of shutdown sequence and destructors happen in ~TestingSetup()
 }
 
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_parallel_sync, TestChain100Setup)
+{
+    // Spend some coinbases, so that the index has to hash spent coins from the undo data.
+    std::vector<CMutableTransaction> spends;
+    const CScript script_pub_key{GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()))};
+    for (int i = 0; i < 5; ++i) {
+        spends.push_back(CreateValidMempoolTransaction(m_coinbase_txns[i], 0, i + 1, coinbaseKey, script_pub_key, CAmount(10 * COIN), /* submit */ false));
+    }
+    CreateAndProcessBlock(spends, script_pub_key);
+
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+    CCoinsStats expected_stats{CoinStatsHashType::MUHASH};
+    expected_stats.index_requested = false;
+    {
+        LOCK(cs_main);
+        chainstate.ForceFlushStateToDisk();
+        BOOST_REQUIRE(GetUTXOStats(&chainstate.CoinsDB(), m_node.chainman->m_blockman, expected_stats, [] {}));
+    }
+
+    // The index reads and hashes blocks on several threads, and combines them in chain order.
+    CoinStatsIndex coin_stats_index{1 << 20, true};
+    BOOST_REQUIRE(coin_stats_index.Start(chainstate, /* sync_threads */ 4));
+
+    const auto timeout = GetTime<std::chrono::seconds>() + 120s;
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(timeout > GetTime<std::chrono::milliseconds>());
+        UninterruptibleSleep(100ms);
+    }
+
+    CCoinsStats coin_stats{CoinStatsHashType::MUHASH};
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(tip, coin_stats));
+    BOOST_CHECK_EQUAL(coin_stats.hashSerialized, expected_stats.hashSerialized);
+    BOOST_CHECK_EQUAL(coin_stats.nTransactionOutputs, expected_stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(coin_stats.nTotalAmount, expected_stats.nTotalAmount);
+
+    coin_stats_index.Stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
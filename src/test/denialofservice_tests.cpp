@@ -419,12 +419,99 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    orphanage.LimitOrphans(40);
+    const size_t max_usage = std::numeric_limits<size_t>::max();
+    orphanage.LimitOrphans(40, max_usage);
     BOOST_CHECK(orphanage.CountOrphans() <= 40);
-    orphanage.LimitOrphans(10);
+    const size_t usage = orphanage.DynamicMemoryUsage();
+    orphanage.LimitOrphans(40, usage / 2);
+    BOOST_CHECK(orphanage.DynamicMemoryUsage() <= usage / 2);
+    orphanage.LimitOrphans(10, max_usage);
     BOOST_CHECK(orphanage.CountOrphans() <= 10);
-    orphanage.LimitOrphans(0);
+    orphanage.LimitOrphans(0, max_usage);
     BOOST_CHECK(orphanage.CountOrphans() == 0);
+    BOOST_CHECK_EQUAL(orphanage.DynamicMemoryUsage(), 0U);
+}
+
+static CTransactionRef MakeOrphan(const std::vector<COutPoint>& prevouts)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptSig << OP_1;
+    }
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(orphan_parent_index)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    const CTransactionRef parent = MakeOrphan({COutPoint(InsecureRand256(), 0)});
+    const CTransactionRef other_parent = MakeOrphan({COutPoint(InsecureRand256(), 0)});
+    // Spends two outputs of parent, and one of other_parent
+    const CTransactionRef child_a = MakeOrphan({COutPoint(parent->GetHash(), 0), COutPoint(other_parent->GetHash(), 0), COutPoint(parent->GetHash(), 1)});
+    const CTransactionRef child_b = MakeOrphan({COutPoint(parent->GetHash(), 2)});
+    const CTransactionRef unrelated = MakeOrphan({COutPoint(InsecureRand256(), 0)});
+    BOOST_CHECK(orphanage.AddTx(child_a, 0));
+    BOOST_CHECK(orphanage.AddTx(child_b, 1));
+    BOOST_CHECK(orphanage.AddTx(unrelated, 1));
+
+    // A transaction resolves exactly the orphans listing it as a parent
+    std::set<uint256> work_set;
+    orphanage.AddChildrenToWorkSet(*parent, work_set);
+    BOOST_CHECK(work_set == std::set<uint256>({child_a->GetHash(), child_b->GetHash()}));
+    work_set.clear();
+    orphanage.AddChildrenToWorkSet(*other_parent, work_set);
+    BOOST_CHECK(work_set == std::set<uint256>({child_a->GetHash()}));
+    work_set.clear();
+    orphanage.AddChildrenToWorkSet(*child_a, work_set);
+    BOOST_CHECK(work_set.empty());
+
+    // A block spending parent:2 conflicts with child_b only
+    CBlock block;
+    block.vtx.push_back(MakeOrphan({COutPoint(parent->GetHash(), 2)}));
+    orphanage.EraseForBlock(block);
+    BOOST_CHECK(orphanage.HaveTx(GenTxid(false, child_a->GetHash())));
+    BOOST_CHECK(!orphanage.HaveTx(GenTxid(false, child_b->GetHash())));
+    BOOST_CHECK(orphanage.HaveTx(GenTxid(true, unrelated->GetWitnessHash())));
+
+    // Erasing child_a removes it from the index of both its parents
+    orphanage.EraseTx(child_a->GetHash());
+    orphanage.AddChildrenToWorkSet(*parent, work_set);
+    orphanage.AddChildrenToWorkSet(*other_parent, work_set);
+    BOOST_CHECK(work_set.empty());
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(orphan_eviction_by_peer)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    // Peer 0 announces a few orphans, and peer 1 floods the orphanage
+    std::vector<CTransactionRef> honest;
+    for (int i = 0; i < 5; i++) {
+        honest.push_back(MakeOrphan({COutPoint(InsecureRand256(), 0)}));
+        BOOST_CHECK(orphanage.AddTx(honest.back(), 0));
+    }
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK(orphanage.AddTx(MakeOrphan({COutPoint(InsecureRand256(), 0)}), 1));
+        orphanage.LimitOrphans(50, std::numeric_limits<size_t>::max());
+    }
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 50U);
+    for (const CTransactionRef& tx : honest) {
+        BOOST_CHECK(orphanage.HaveTx(GenTxid(false, tx->GetHash())));
+    }
+
+    orphanage.EraseForPeer(1);
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), honest.size());
+    orphanage.EraseForPeer(0);
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.DynamicMemoryUsage(), 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -123,4 +123,63 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1U);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(flatfile_map_cache)
+{
+    const auto data_dir = m_args.GetDataDirBase();
+    FlatFileSeq seq(data_dir, "a", 100);
+    FlatFileMapCache maps(2);
+
+    // A file that doesn't exist can't be mapped.
+    BOOST_CHECK(!maps.Get(seq.FileName(FlatFilePos(0, 0)), 1));
+
+    const std::string line("A purely peer-to-peer version of electronic cash");
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line, 256);
+    }
+    const size_t size = GetSerializeSize(line, CLIENT_VERSION);
+
+    auto map = maps.Get(seq.FileName(FlatFilePos(0, 0)), size);
+    BOOST_REQUIRE(map);
+    BOOST_CHECK_EQUAL(map->Data().size(), size);
+    std::string text;
+    SpanReader{SER_DISK, CLIENT_VERSION, map->Data()} >> LIMITED_STRING(text, 256);
+    BOOST_CHECK_EQUAL(text, line);
+
+    // The mapping is reused while it is large enough.
+    BOOST_CHECK_EQUAL(maps.Get(seq.FileName(FlatFilePos(0, 0)), 1), map);
+    BOOST_CHECK(!maps.Get(seq.FileName(FlatFilePos(0, 0)), size + 1));
+
+    // The file is mapped again once it has grown.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, size)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line, 256);
+    }
+    auto grown_map = maps.Get(seq.FileName(FlatFilePos(0, 0)), size * 2);
+    BOOST_REQUIRE(grown_map);
+    BOOST_CHECK(grown_map != map);
+    BOOST_CHECK_EQUAL(grown_map->Data().size(), size * 2);
+    // The old mapping stays valid for its holder.
+    BOOST_CHECK(std::equal(map->Data().begin(), map->Data().end(), grown_map->Data().begin()));
+
+    // Least recently used mappings are evicted, and can be erased explicitly.
+    for (int n = 1; n <= 2; ++n) {
+        CAutoFile file(seq.Open(FlatFilePos(n, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line, 256);
+    }
+    auto map1 = maps.Get(seq.FileName(FlatFilePos(1, 0)), size);
+    BOOST_REQUIRE(map1);
+    BOOST_CHECK_EQUAL(maps.Get(seq.FileName(FlatFilePos(0, 0)), size), grown_map);
+    BOOST_REQUIRE(maps.Get(seq.FileName(FlatFilePos(2, 0)), size));
+    BOOST_CHECK_EQUAL(maps.Get(seq.FileName(FlatFilePos(0, 0)), size), grown_map);
+    const auto remapped1 = maps.Get(seq.FileName(FlatFilePos(1, 0)), size);
+    BOOST_CHECK(remapped1 != map1);
+    map1 = remapped1;
+    BOOST_CHECK_EQUAL(maps.Get(seq.FileName(FlatFilePos(1, 0)), size), map1);
+    maps.Erase(seq.FileName(FlatFilePos(1, 0)));
+    BOOST_CHECK(maps.Get(seq.FileName(FlatFilePos(1, 0)), size) != map1);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
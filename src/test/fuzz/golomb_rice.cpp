@@ -15,6 +15,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iosfwd>
+#include <optional>
 #include <unordered_set>
 #include <vector>
 
@@ -92,6 +93,26 @@ FUZZ_TARGET(golomb_rice)
 
     assert(encoded_deltas == decoded_deltas);
 
+    {
+        // The word-at-a-time coder must match the bit-at-a-time one.
+        std::vector<uint8_t> encoded;
+        {
+            CVectorWriter stream(SER_NETWORK, 0, encoded, 0);
+            WriteCompactSize(stream, static_cast<uint32_t>(encoded_deltas.size()));
+            GolombRiceWriter writer(encoded, BASIC_FILTER_P);
+            for (const uint64_t delta : encoded_deltas) {
+                writer.Encode(delta);
+            }
+        }
+        assert(encoded == golomb_rice_data);
+
+        GolombRiceReader reader(MakeSpan(golomb_rice_data).subspan(GetSizeOfCompactSize(encoded_deltas.size())), BASIC_FILTER_P);
+        for (const uint64_t delta : encoded_deltas) {
+            assert(reader.Decode() == delta);
+        }
+        assert(reader.BytesRemaining() == 0);
+    }
+
     {
         const std::vector<uint8_t> random_bytes = ConsumeRandomLengthByteVector(fuzzed_data_provider, 1024);
         VectorReader stream{SER_NETWORK, 0, random_bytes, 0};
@@ -101,12 +122,21 @@ FUZZ_TARGET(golomb_rice)
         } catch (const std::ios_base::failure&) {
             return;
         }
+        const Span<const uint8_t> bits{MakeSpan(random_bytes).last(stream.size())};
         BitStreamReader<VectorReader> bitreader(stream);
+        GolombRiceReader reader(bits, BASIC_FILTER_P);
         for (uint32_t i = 0; i < std::min<uint32_t>(n, 1024); ++i) {
+            std::optional<uint64_t> decoded, decoded_by_word;
+            try {
+                decoded = GolombRiceDecode(bitreader, BASIC_FILTER_P);
+            } catch (const std::ios_base::failure&) {
+            }
             try {
-                (void)GolombRiceDecode(bitreader, BASIC_FILTER_P);
+                decoded_by_word = reader.Decode();
             } catch (const std::ios_base::failure&) {
             }
+            assert(decoded == decoded_by_word);
+            if (!decoded) break;
         }
     }
 }
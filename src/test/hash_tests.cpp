@@ -147,4 +147,49 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(siphash_batch)
+{
+    // Check consistency between SipHashUint256[Extra] and their batch versions,
+    // for batches that don't fill the multi-lane implementation's lanes too.
+    FastRandomContext ctx;
+    std::vector<uint256> vals(41);
+    std::vector<uint32_t> extras(vals.size());
+    for (size_t i = 0; i < vals.size(); ++i) {
+        vals[i] = InsecureRand256();
+        extras[i] = ctx.rand32();
+    }
+    const uint64_t k1 = ctx.rand64();
+    const uint64_t k2 = ctx.rand64();
+    for (size_t count = 0; count < vals.size(); ++count) {
+        // Start at an odd offset so that the batch isn't aligned either
+        std::vector<uint64_t> out(count), out_extra(count);
+        SipHashUint256Batch(k1, k2, vals.data() + 1, out.data(), count);
+        SipHashUint256ExtraBatch(k1, k2, vals.data() + 1, extras.data() + 1, out_extra.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(k1, k2, vals[i + 1]));
+            BOOST_CHECK_EQUAL(out_extra[i], SipHashUint256Extra(k1, k2, vals[i + 1], extras[i + 1]));
+        }
+    }
+
+    // Check consistency between CSipHasher and SipHashBatch, for inputs of
+    // differing lengths hashed in the same lanes.
+    std::vector<std::vector<unsigned char>> inputs;
+    std::vector<const unsigned char*> data;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < 83; ++i) {
+        inputs.push_back(ctx.randbytes(i % 4 == 0 ? i / 2 : ctx.randrange(40)));
+    }
+    for (const auto& input : inputs) {
+        data.push_back(input.data());
+        sizes.push_back(input.size());
+    }
+    for (size_t count : {0, 1, 3, 4, 5, 8, 83}) {
+        std::vector<uint64_t> out(count);
+        SipHashBatch(k1, k2, data.data(), sizes.data(), out.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], CSipHasher(k1, k2).Write(inputs[i].data(), inputs[i].size()).Finalize());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -543,6 +543,17 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     BOOST_CHECK(pool.exists(tx6.GetHash()));
     BOOST_CHECK(!pool.exists(tx7.GetHash()));
 
+    // tx4 and tx6 stay, without the evicted descendants in their descendant state
+    const auto tx4_it = pool.mapTx.find(tx4.GetHash());
+    BOOST_CHECK_EQUAL(tx4_it->GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(tx4_it->GetSizeWithDescendants(), GetVirtualTransactionSize(CTransaction(tx4)) + GetVirtualTransactionSize(CTransaction(tx6)));
+    BOOST_CHECK_EQUAL(tx4_it->GetModFeesWithDescendants(), 7000 + 1100);
+    BOOST_CHECK_EQUAL(tx4_it->GetMemPoolChildrenConst().size(), 1U);
+    const auto tx6_it = pool.mapTx.find(tx6.GetHash());
+    BOOST_CHECK_EQUAL(tx6_it->GetCountWithDescendants(), 1U);
+    BOOST_CHECK_EQUAL(tx6_it->GetModFeesWithDescendants(), 1100);
+    BOOST_CHECK(tx6_it->GetMemPoolChildrenConst().empty());
+
     pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
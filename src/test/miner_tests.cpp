@@ -20,19 +20,20 @@
 
 #include <test/util/setup_common.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
 
 namespace miner_tests {
 struct MinerTestingSetup : public TestingSetup {
-    void TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
+    void TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst, int selection_threads) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
     bool TestSequenceLocks(const CTransaction& tx, int flags) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs)
     {
         CCoinsViewMemPool view_mempool(&m_node.chainman->ActiveChainstate().CoinsTip(), *m_node.mempool);
         return CheckSequenceLocks(m_node.chainman->ActiveChain().Tip(), view_mempool, tx, flags);
     }
-    BlockAssembler AssemblerForTest(const CChainParams& params);
+    BlockAssembler AssemblerForTest(const CChainParams& params, int selection_threads = 0);
 };
 } // namespace miner_tests
 
@@ -40,12 +41,13 @@ BOOST_FIXTURE_TEST_SUITE(miner_tests, MinerTestingSetup)
 
 static CFeeRate blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
 
-BlockAssembler MinerTestingSetup::AssemblerForTest(const CChainParams& params)
+BlockAssembler MinerTestingSetup::AssemblerForTest(const CChainParams& params, int selection_threads)
 {
     BlockAssembler::Options options;
 
     options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
     options.blockMinFeeRate = blockMinFeeRate;
+    options.selection_threads = selection_threads;
     return BlockAssembler(m_node.chainman->ActiveChainstate(), *m_node.mempool, params, options);
 }
 
@@ -83,7 +85,7 @@ static CBlockIndex CreateBlockIndex(int nHeight, CBlockIndex* active_chain_tip)
 // Test suite for ancestor feerate transaction selection.
 // Implemented as an additional function, rather than a separate test case,
 // to allow reusing the blockchain created in CreateNewBlock_validity.
-void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst)
+void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst, int selection_threads)
 {
     // Test the ancestor feerate transaction selection.
     TestMemPoolEntryHelper entry;
@@ -113,7 +115,7 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     uint256 hashHighFeeTx = tx.GetHash();
     m_node.mempool->addUnchecked(entry.Fee(50000).Time(GetTime()).SpendsCoinbase(false).FromTx(tx));
 
-    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams, selection_threads).CreateNewBlock(scriptPubKey);
     BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 4U);
     BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
     BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashHighFeeTx);
@@ -134,7 +136,7 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     tx.vout[0].nValue = 5000000000LL - 1000 - 50000 - feeToUse;
     uint256 hashLowFeeTx = tx.GetHash();
     m_node.mempool->addUnchecked(entry.Fee(feeToUse).FromTx(tx));
-    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    pblocktemplate = AssemblerForTest(chainparams, selection_threads).CreateNewBlock(scriptPubKey);
     // Verify that the free tx and the low fee tx didn't get selected
     for (size_t i=0; i<pblocktemplate->block.vtx.size(); ++i) {
         BOOST_CHECK(pblocktemplate->block.vtx[i]->GetHash() != hashFreeTx);
@@ -148,7 +150,7 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     tx.vout[0].nValue -= 2; // Now we should be just over the min relay fee
     hashLowFeeTx = tx.GetHash();
     m_node.mempool->addUnchecked(entry.Fee(feeToUse+2).FromTx(tx));
-    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    pblocktemplate = AssemblerForTest(chainparams, selection_threads).CreateNewBlock(scriptPubKey);
     BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 6U);
     BOOST_CHECK(pblocktemplate->block.vtx[4]->GetHash() == hashFreeTx);
     BOOST_CHECK(pblocktemplate->block.vtx[5]->GetHash() == hashLowFeeTx);
@@ -170,7 +172,7 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     tx.vout[0].nValue = 5000000000LL - 100000000 - feeToUse;
     uint256 hashLowFeeTx2 = tx.GetHash();
     m_node.mempool->addUnchecked(entry.Fee(feeToUse).SpendsCoinbase(false).FromTx(tx));
-    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    pblocktemplate = AssemblerForTest(chainparams, selection_threads).CreateNewBlock(scriptPubKey);
 
     // Verify that this tx isn't selected.
     for (size_t i=0; i<pblocktemplate->block.vtx.size(); ++i) {
@@ -183,7 +185,7 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     tx.vin[0].prevout.n = 1;
     tx.vout[0].nValue = 100000000 - 10000; // 10k satoshi fee
     m_node.mempool->addUnchecked(entry.Fee(10000).FromTx(tx));
-    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    pblocktemplate = AssemblerForTest(chainparams, selection_threads).CreateNewBlock(scriptPubKey);
     BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 9U);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
@@ -510,9 +512,107 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     SetMockTime(0);
     m_node.mempool->clear();
 
-    TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    TestPackageSelection(chainparams, scriptPubKey, txFirst, 0);
+
+    // Selecting from a mempool snapshot gives the same templates, whether
+    // one or several candidates are compared.
+    m_node.mempool->clear();
+    TestPackageSelection(chainparams, scriptPubKey, txFirst, 1);
+    m_node.mempool->clear();
+    TestPackageSelection(chainparams, scriptPubKey, txFirst, MAX_BLOCK_SELECTION_CANDIDATES);
 
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(snapshot_selection_unlocked, TestChain100Setup)
+{
+    CTxMemPool& mempool = *m_node.mempool;
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    const CScript script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Mature the second coinbase too.
+    CreateAndProcessBlock({}, script);
+
+    const CTransactionRef parent = MakeTransactionRef(CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, script, 49 * COIN));
+    const CTransactionRef child = MakeTransactionRef(CreateValidMempoolTransaction(parent, 0, 101, coinbaseKey, script, 48 * COIN));
+    const CTransactionRef other = MakeTransactionRef(CreateValidMempoolTransaction(m_coinbase_txns[1], 0, 2, coinbaseKey, script, 49 * COIN));
+
+    // Assemble as getblocktemplate does, without holding cs_main, so that it
+    // is actually released while the block selection threads pick candidates.
+    AssertLockNotHeld(::cs_main);
+    BlockAssembler::Options options;
+    options.selection_threads = MAX_BLOCK_SELECTION_CANDIDATES;
+    const std::unique_ptr<CBlockTemplate> block_template = BlockAssembler{chainstate, mempool, Params(), options}.CreateNewBlock(script);
+    BOOST_REQUIRE(block_template);
+    const std::vector<CTransactionRef>& vtx = block_template->block.vtx;
+    BOOST_REQUIRE_EQUAL(vtx.size(), 4U);
+    const auto position = [&](const CTransactionRef& tx) {
+        return std::find_if(vtx.begin(), vtx.end(), [&](const CTransactionRef& t) { return t->GetHash() == tx->GetHash(); }) - vtx.begin();
+    };
+    BOOST_CHECK_LT(position(parent), position(child));
+    BOOST_CHECK_LT(position(other), 4);
+    BOOST_CHECK_EQUAL(block_template->vTxFees[0], -3 * COIN);
+    BOOST_CHECK(block_template->block.hashPrevBlock == WITH_LOCK(::cs_main, return chainstate.m_chain.Tip()->GetBlockHash()));
+}
+
+BOOST_FIXTURE_TEST_CASE(block_template_cache, TestChain100Setup)
+{
+    CTxMemPool& mempool = *m_node.mempool;
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    const CScript script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    BlockTemplateCache cache{mempool, Params(), CScript() << OP_TRUE};
+    RegisterValidationInterface(&cache);
+    const auto tip = [&] { return WITH_LOCK(::cs_main, return chainstate.m_chain.Tip()); };
+    // Mature the second coinbase too.
+    CreateAndProcessBlock({}, script);
+    const auto check_valid = [&](const CBlockTemplate& block_template) {
+        LOCK(::cs_main);
+        BlockValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, Params(), chainstate, block_template.block, chainstate.m_chain.Tip(), false, false));
+        CAmount fees = 0;
+        for (size_t i = 1; i < block_template.vTxFees.size(); ++i) fees += block_template.vTxFees[i];
+        BOOST_CHECK_EQUAL(block_template.vTxFees[0], -fees);
+    };
+
+    const CTransactionRef tx1 = MakeTransactionRef(CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, script, 49 * COIN));
+    SyncWithValidationInterfaceQueue();
+    // Nothing is cached before the first template is assembled.
+    BOOST_CHECK(!cache.GetBlockTemplate(tip()));
+    std::unique_ptr<CBlockTemplate> block_template = WITH_LOCK(::cs_main, return cache.CreateNewBlock(chainstate));
+    BOOST_REQUIRE_EQUAL(block_template->block.vtx.size(), 2U);
+    BOOST_REQUIRE(block_template = cache.GetBlockTemplate(tip()));
+    BOOST_CHECK_EQUAL(block_template->block.vtx.size(), 2U);
+
+    // A child of a tx in the template and a tx without in-mempool parents are appended.
+    const CTransactionRef tx2 = MakeTransactionRef(CreateValidMempoolTransaction(tx1, 0, 101, coinbaseKey, script, 48 * COIN));
+    const CTransactionRef tx3 = MakeTransactionRef(CreateValidMempoolTransaction(m_coinbase_txns[1], 0, 2, coinbaseKey, script, 49 * COIN));
+    SyncWithValidationInterfaceQueue();
+    BOOST_REQUIRE(block_template = cache.GetBlockTemplate(tip()));
+    BOOST_REQUIRE_EQUAL(block_template->block.vtx.size(), 4U);
+    BOOST_CHECK(block_template->block.vtx[2]->GetHash() == tx2->GetHash());
+    BOOST_CHECK(block_template->block.vtx[3]->GetHash() == tx3->GetHash());
+    BOOST_CHECK_EQUAL(block_template->vTxFees[0], -3 * COIN);
+    check_valid(*block_template);
+
+    // Fee prioritisation isn't notified, so the template is dropped.
+    mempool.PrioritiseTransaction(tx3->GetHash(), COIN);
+    BOOST_CHECK(!cache.GetBlockTemplate(tip()));
+
+    // Removal of a tx in the template drops it too.
+    BOOST_REQUIRE(WITH_LOCK(::cs_main, return cache.CreateNewBlock(chainstate)));
+    BOOST_CHECK(cache.GetBlockTemplate(tip()));
+    WITH_LOCK(mempool.cs, mempool.removeRecursive(*tx2, MemPoolRemovalReason::CONFLICT));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(!cache.GetBlockTemplate(tip()));
+
+    // As does a new block.
+    BOOST_REQUIRE(block_template = WITH_LOCK(::cs_main, return cache.CreateNewBlock(chainstate)));
+    BOOST_CHECK_EQUAL(block_template->block.vtx.size(), 3U);
+    BOOST_CHECK(cache.GetBlockTemplate(tip()));
+    CreateAndProcessBlock({}, script);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(!cache.GetBlockTemplate(tip()));
+
+    UnregisterValidationInterface(&cache);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
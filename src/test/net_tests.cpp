@@ -8,11 +8,14 @@
 #include <clientversion.h>
 #include <cstdint>
 #include <net.h>
+#include <net_processing.h>
 #include <netaddress.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
 #include <util/string.h>
@@ -25,6 +28,7 @@
 #include <ios>
 #include <memory>
 #include <optional>
+#include <set>
 #include <string>
 
 using namespace std::literals;
@@ -830,4 +834,104 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_FIXTURE_TEST_CASE(message_handler_workers, TestingSetup)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337, *m_node.addrman};
+    const auto peerman = PeerManager::make(Params(), connman, *m_node.addrman, /* banman */ nullptr,
+                                           *m_node.chainman, *m_node.mempool, /* ignore_incoming_txs */ false);
+    CConnman::Options options;
+    options.m_msgproc = peerman.get();
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    connman.Init(options);
+    connman.StartTestMessageHandlerWorkers(3);
+
+    std::vector<CNode*> peers;
+    for (int i = 0; i < 20; ++i) {
+        CNode* peer = new CNode{/* id */ i, NODE_NETWORK, INVALID_SOCKET, CAddress(), /* nKeyedNetGroupIn */ 0,
+                                /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "", ConnectionType::INBOUND,
+                                /* inbound_onion */ false};
+        peerman->InitializeNode(peer);
+        peer->nVersion = PROTOCOL_VERSION;
+        peer->SetCommonVersion(PROTOCOL_VERSION);
+        peer->fSuccessfullyConnected = true;
+        connman.AddTestNode(*peer);
+        peers.push_back(peer);
+        for (uint64_t nonce : {1, 2}) {
+            CSerializedNetMsg msg{CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, nonce)};
+            BOOST_CHECK(connman.ReceiveMsgFrom(*peer, msg));
+        }
+    }
+
+    // Each round processes one message of every peer.
+    BOOST_CHECK(connman.HandleMessagesOnce(peers));
+    BOOST_CHECK(!connman.HandleMessagesOnce(peers));
+    for (CNode* peer : peers) {
+        CNodeStats stats;
+        peer->copyStats(stats, /* m_asmap */ {});
+        BOOST_CHECK_EQUAL(stats.mapSendBytesPerMsgCmd[NetMsgType::PONG], 2 * (CMessageHeader::HEADER_SIZE + sizeof(uint64_t)));
+    }
+
+    connman.StopTestMessageHandlerWorkers();
+    for (CNode* peer : peers) {
+        peerman->FinalizeNode(*peer);
+    }
+    connman.ClearTestNodes();
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socket_events_epoll)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337, *m_node.addrman};
+    connman.Init(CConnman::Options{});
+    connman.InitTestSocketEvents();
+
+    int sockets[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    const SOCKET local{static_cast<SOCKET>(sockets[0])};
+    SOCKET remote{static_cast<SOCKET>(sockets[1])};
+    CNode* node = new CNode{/* id */ 0, NODE_NETWORK, local, CAddress(), /* nKeyedNetGroupIn */ 0,
+                            /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "", ConnectionType::INBOUND,
+                            /* inbound_onion */ false};
+    connman.AddTestNodeWithSocket(*node);
+
+    std::set<SOCKET> recv_set, send_set, error_set;
+    const auto wait = [&] {
+        recv_set.clear();
+        send_set.clear();
+        error_set.clear();
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+    };
+
+    // A new socket is reported as writable once.
+    wait();
+    BOOST_CHECK(recv_set.empty());
+    BOOST_CHECK_EQUAL(send_set.count(local), 1U);
+    wait();
+    BOOST_CHECK(recv_set.empty() && send_set.empty());
+
+    // Incoming data is reported once, even if it isn't read.
+    const uint8_t byte{0};
+    BOOST_REQUIRE_EQUAL(send(remote, &byte, 1, 0), 1);
+    wait();
+    BOOST_CHECK_EQUAL(recv_set.count(local), 1U);
+    wait();
+    BOOST_CHECK(recv_set.empty());
+
+    // The socket handler reads everything once more data arrives.
+    BOOST_REQUIRE_EQUAL(send(remote, &byte, 1, 0), 1);
+    connman.SocketHandlerOnce();
+    BOOST_CHECK_EQUAL(connman.GetTotalBytesRecv(), 2U);
+    connman.SocketHandlerOnce();
+    BOOST_CHECK_EQUAL(connman.GetTotalBytesRecv(), 2U);
+
+    // Closing the other end is reported as an error.
+    CloseSocket(remote);
+    wait();
+    BOOST_CHECK_EQUAL(error_set.count(local), 1U);
+
+    connman.ClearTestNodes();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
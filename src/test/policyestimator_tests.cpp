@@ -2,8 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <clientversion.h>
+#include <fs.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util/time.h>
@@ -180,4 +183,91 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(SmartFeeEstimateCache, TestingSetup)
+{
+    // Feed two estimators the same history, querying one of them for every
+    // target after each block and after txs leave the mempool, so that stale
+    // cached estimates would show up as a mismatch with the other.
+    CBlockPolicyEstimator cachedEst;
+    CBlockPolicyEstimator freshEst;
+    CTxMemPool cachedPool(&cachedEst);
+    CTxMemPool freshPool(&freshEst);
+    LOCK(cs_main);
+    TestMemPoolEntryHelper entry;
+
+    const auto check_estimates = [&] {
+        for (int target = 1; target <= 50; ++target) {
+            for (bool conservative : {false, true}) {
+                FeeCalculation cachedCalc;
+                FeeCalculation freshCalc;
+                const CFeeRate cachedRate = cachedEst.estimateSmartFee(target, &cachedCalc, conservative);
+                BOOST_CHECK(cachedRate == freshEst.estimateSmartFee(target, &freshCalc, conservative));
+                BOOST_CHECK(cachedCalc.reason == freshCalc.reason);
+                BOOST_CHECK_EQUAL(cachedCalc.returnedTarget, freshCalc.returnedTarget);
+                BOOST_CHECK_EQUAL(cachedCalc.est.pass.totalConfirmed, freshCalc.est.pass.totalConfirmed);
+            }
+        }
+    };
+    const auto query_all = [&] {
+        for (int target = 1; target <= 50; ++target) {
+            cachedEst.estimateSmartFee(target, nullptr, false);
+            cachedEst.estimateSmartFee(target, nullptr, true);
+        }
+    };
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0;
+    std::vector<CTransactionRef> unmined;
+    for (int blocknum = 0; blocknum < 120; ++blocknum) {
+        std::vector<CTransactionRef> block;
+        for (int j = 0; j < 20; ++j) {
+            tx.vin[0].prevout.n = 100 * blocknum + j;
+            const CTransactionRef ptx = MakeTransactionRef(tx);
+            LOCK2(cachedPool.cs, freshPool.cs);
+            cachedPool.addUnchecked(entry.Fee(1000 * (j + 1)).Time(GetTime()).Height(blocknum).FromTx(ptx));
+            freshPool.addUnchecked(entry.Fee(1000 * (j + 1)).Time(GetTime()).Height(blocknum).FromTx(ptx));
+            // Higher feerates confirm sooner, the lowest ones never do
+            if (j >= 4 && (blocknum + j) % 3 != 0) {
+                block.push_back(ptx);
+            } else {
+                unmined.push_back(ptx);
+            }
+        }
+        // Txs that entered in earlier blocks leave the mempool unconfirmed
+        if (blocknum % 10 == 9) {
+            LOCK2(cachedPool.cs, freshPool.cs);
+            for (const CTransactionRef& ptx : unmined) {
+                cachedPool.removeRecursive(*ptx, MemPoolRemovalReason::EXPIRY);
+                freshPool.removeRecursive(*ptx, MemPoolRemovalReason::EXPIRY);
+            }
+            unmined.clear();
+            check_estimates();
+        }
+        query_all();
+        {
+            LOCK2(cachedPool.cs, freshPool.cs);
+            cachedPool.removeForBlock(block, blocknum + 1);
+            freshPool.removeForBlock(block, blocknum + 1);
+        }
+        if (blocknum % 10 == 4) check_estimates();
+        query_all();
+    }
+    check_estimates();
+
+    // The flat in-memory layout still round trips through the estimates file
+    const fs::path path = m_path_root / "fee_estimates_test.dat";
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(cachedEst.Write(file));
+    }
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(freshEst.Read(file));
+    for (int target = 1; target <= 50; ++target) {
+        BOOST_CHECK(cachedEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::SHORT_HALFLIFE) == freshEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::SHORT_HALFLIFE));
+        BOOST_CHECK(cachedEst.estimateRawFee(target, 0.95, FeeEstimateHorizon::LONG_HALFLIFE) == freshEst.estimateRawFee(target, 0.95, FeeEstimateHorizon::LONG_HALFLIFE));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1714,6 +1714,52 @@ static void AssetTest(const UniValue& test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sigcache_sharded_stats)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const XOnlyPubKey pubkey{key.GetPubKey()};
+    const CTransaction tx{CMutableTransaction{}};
+    PrecomputedTransactionData txdata;
+    CachingTransactionSignatureChecker checker_nostore(&tx, 0, 0, false, txdata);
+    CachingTransactionSignatureChecker checker_store(&tx, 0, 0, true, txdata);
+
+    // Sign a message per shard, so that every shard is likely to be used.
+    std::vector<uint256> sighashes;
+    std::vector<std::vector<unsigned char>> sigs;
+    for (size_t i = 0; i < 4 * SIGNATURE_CACHE_SHARDS; ++i) {
+        sighashes.push_back(InsecureRand256());
+        sigs.emplace_back(64);
+        BOOST_REQUIRE(key.SignSchnorr(sighashes.back(), sigs.back(), nullptr, nullptr));
+    }
+
+    const SignatureCacheStats before = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(before.shards, SIGNATURE_CACHE_SHARDS);
+    for (size_t i = 0; i < sigs.size(); ++i) {
+        // A lookup without storing misses and doesn't add the entry...
+        BOOST_CHECK(checker_nostore.VerifySchnorrSignature(sigs[i], pubkey, sighashes[i]));
+        // ...so the first store misses again and inserts it...
+        BOOST_CHECK(checker_store.VerifySchnorrSignature(sigs[i], pubkey, sighashes[i]));
+        // ...a storing lookup hits and keeps it...
+        BOOST_CHECK(checker_store.VerifySchnorrSignature(sigs[i], pubkey, sighashes[i]));
+        // ...and a block validation lookup hits and erases it.
+        BOOST_CHECK(checker_nostore.VerifySchnorrSignature(sigs[i], pubkey, sighashes[i]));
+    }
+    const SignatureCacheStats after = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(after.misses - before.misses, 2 * sigs.size());
+    BOOST_CHECK_EQUAL(after.inserts - before.inserts, sigs.size());
+    BOOST_CHECK_EQUAL(after.hits - before.hits, 2 * sigs.size());
+    BOOST_CHECK_EQUAL(after.erases - before.erases, sigs.size());
+
+    // An invalid signature is neither found nor stored.
+    std::vector<unsigned char> bad_sig{sigs[0]};
+    bad_sig[0] ^= 1;
+    BOOST_CHECK(!checker_store.VerifySchnorrSignature(bad_sig, pubkey, sighashes[0]));
+    const SignatureCacheStats bad = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(bad.misses - after.misses, 1U);
+    BOOST_CHECK_EQUAL(bad.inserts, after.inserts);
+}
+
 BOOST_AUTO_TEST_CASE(script_assets_test)
 {
     // See src/test/fuzz/script_assets_test_minimizer.cpp for information on how to generate
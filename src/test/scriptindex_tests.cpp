@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/scriptindex.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(scriptindex_tests)
+
+static std::vector<ScriptIndexEntry> Lookup(const ScriptIndex& index, const CScript& script, int start_height = 0,
+                                            const std::optional<COutPoint>& start_after = std::nullopt, size_t count = 1000, bool unspent_only = false)
+{
+    std::vector<ScriptIndexEntry> entries;
+    BOOST_REQUIRE(index.LookupScript(script, start_height, start_after, count, unspent_only, entries));
+    return entries;
+}
+
+BOOST_FIXTURE_TEST_CASE(scriptindex_initial_sync, TestChain100Setup)
+{
+    ScriptIndex script_index(1 << 20, true);
+    const CScript coinbase_script{CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG};
+
+    BOOST_REQUIRE(script_index.Start(m_node.chainman->ActiveChainstate()));
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!script_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // Every coinbase of the test chain pays to the same script, in height order.
+    std::vector<ScriptIndexEntry> entries{Lookup(script_index, coinbase_script)};
+    BOOST_REQUIRE_EQUAL(entries.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        BOOST_CHECK_EQUAL(entries[i].height, int(i + 1));
+        BOOST_CHECK(entries[i].outpoint == COutPoint(m_coinbase_txns[i]->GetHash(), 0));
+        BOOST_CHECK_EQUAL(entries[i].value, m_coinbase_txns[i]->vout[0].nValue);
+        BOOST_CHECK(!entries[i].IsSpent());
+    }
+
+    // Range queries by height and after a given output.
+    entries = Lookup(script_index, coinbase_script, /* start_height */ 95);
+    BOOST_REQUIRE_EQUAL(entries.size(), 6U);
+    BOOST_CHECK_EQUAL(entries.front().height, 95);
+    entries = Lookup(script_index, coinbase_script, 10, /* start_after */ COutPoint(m_coinbase_txns[9]->GetHash(), 0), /* count */ 5);
+    BOOST_REQUIRE_EQUAL(entries.size(), 5U);
+    BOOST_CHECK_EQUAL(entries.front().height, 11);
+    BOOST_CHECK_EQUAL(entries.back().height, 15);
+    BOOST_CHECK(Lookup(script_index, CScript() << OP_TRUE).empty());
+
+    // Spending a coinbase marks its entry spent and adds an entry for the new script.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript dest_script{GetScriptForDestination(PKHash(key.GetPubKey()))};
+    const CMutableTransaction spend{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, dest_script, CAmount(30 * COIN), /* submit */ false)};
+    CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_CHECK(script_index.BlockUntilSyncedToCurrentChain());
+
+    entries = Lookup(script_index, coinbase_script);
+    BOOST_REQUIRE_EQUAL(entries.size(), m_coinbase_txns.size() + 1);
+    BOOST_CHECK(entries[0].IsSpent());
+    BOOST_CHECK_EQUAL(entries[0].spending_txid, spend.GetHash());
+    BOOST_CHECK_EQUAL(entries[0].spending_vin, 0U);
+    BOOST_CHECK_EQUAL(entries[0].spending_height, 101);
+    BOOST_CHECK_EQUAL(Lookup(script_index, coinbase_script, 0, std::nullopt, 1000, /* unspent_only */ true).size(), m_coinbase_txns.size());
+    entries = Lookup(script_index, dest_script);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0].outpoint == COutPoint(spend.GetHash(), 0));
+    BOOST_CHECK_EQUAL(entries[0].value, 30 * COIN);
+
+    // Replacing the block with one without the spend rewinds both changes.
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    {
+        BlockValidationState state;
+        CBlockIndex* tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+        BOOST_REQUIRE(chainstate.InvalidateBlock(state, tip));
+    }
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(script_index.BlockUntilSyncedToCurrentChain());
+
+    entries = Lookup(script_index, coinbase_script);
+    BOOST_REQUIRE_EQUAL(entries.size(), m_coinbase_txns.size() + 1);
+    for (const ScriptIndexEntry& entry : entries) {
+        BOOST_CHECK(!entry.IsSpent());
+    }
+    BOOST_CHECK(Lookup(script_index, dest_script).empty());
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    script_index.Stop();
+
+    // Let scheduler events finish running to avoid accessing any memory related to the index after it is destructed
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/spentindex.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(spentindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(spentindex_initial_sync, TestChain100Setup)
+{
+    // Spend two coinbase outputs before the index starts, so that the initial
+    // sync has to index them. Mine a block first so that both are mature.
+    const CScript coinbase_script{CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG};
+    CreateAndProcessBlock({}, coinbase_script);
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript dest_script{GetScriptForDestination(PKHash(key.GetPubKey()))};
+    const CMutableTransaction spend1{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, dest_script, CAmount(30 * COIN), /* submit */ false)};
+    const CMutableTransaction spend2{CreateValidMempoolTransaction(m_coinbase_txns[1], 0, 2, coinbaseKey, dest_script, CAmount(40 * COIN), /* submit */ false)};
+    CreateAndProcessBlock({spend1, spend2}, coinbase_script);
+
+    SpentIndex spent_index(1 << 20, true);
+    SpentIndexEntry entry;
+    std::vector<CAmount> values;
+
+    // Spends should not be found before the index is started.
+    BOOST_CHECK(!spent_index.FindSpender(spend1.vin[0].prevout, entry));
+
+    BOOST_REQUIRE(spent_index.Start(m_node.chainman->ActiveChainstate(), /* sync_threads */ 2));
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!spent_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // Check that the spends and the values they spent are found.
+    BOOST_REQUIRE(spent_index.FindSpender(spend2.vin[0].prevout, entry));
+    BOOST_CHECK_EQUAL(entry.spending_txid, spend2.GetHash());
+    BOOST_CHECK_EQUAL(entry.spending_vin, 0U);
+    BOOST_CHECK_EQUAL(entry.spending_height, 102);
+    BOOST_CHECK_EQUAL(entry.value, m_coinbase_txns[1]->vout[0].nValue);
+    BOOST_REQUIRE(spent_index.FindPrevoutValues(CTransaction(spend1), values));
+    BOOST_CHECK(values == std::vector<CAmount>{m_coinbase_txns[0]->vout[0].nValue});
+
+    // Unspent outputs, coinbase transactions and transactions spending a
+    // prevout that the index attributes to a different spender are not found.
+    BOOST_CHECK(!spent_index.FindSpender(COutPoint(m_coinbase_txns[2]->GetHash(), 0), entry));
+    BOOST_CHECK(!spent_index.FindSpender(COutPoint(spend1.GetHash(), 0), entry));
+    BOOST_CHECK(!spent_index.FindPrevoutValues(*m_coinbase_txns[2], values));
+    CMutableTransaction double_spend{spend1};
+    double_spend.vout[0].nValue -= 1;
+    BOOST_CHECK(!spent_index.FindPrevoutValues(CTransaction(double_spend), values));
+
+    // Check that new blocks get indexed, and that a reorg erases the spends
+    // of the disconnected block.
+    const CMutableTransaction spend3{CreateValidMempoolTransaction(MakeTransactionRef(spend1), 0, 102, key, coinbase_script, CAmount(20 * COIN), /* submit */ false)};
+    CreateAndProcessBlock({spend3}, coinbase_script);
+    BOOST_CHECK(spent_index.BlockUntilSyncedToCurrentChain());
+    BOOST_REQUIRE(spent_index.FindSpender(COutPoint(spend1.GetHash(), 0), entry));
+    BOOST_CHECK_EQUAL(entry.spending_txid, spend3.GetHash());
+    BOOST_CHECK_EQUAL(entry.value, 30 * COIN);
+
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    {
+        BlockValidationState state;
+        CBlockIndex* tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+        BOOST_REQUIRE(chainstate.InvalidateBlock(state, tip));
+    }
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(spent_index.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(!spent_index.FindSpender(COutPoint(spend1.GetHash(), 0), entry));
+    BOOST_CHECK(spent_index.FindSpender(spend1.vin[0].prevout, entry));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    spent_index.Stop();
+
+    // Let scheduler events finish running to avoid accessing any memory related to the index after it is destructed
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
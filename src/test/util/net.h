@@ -13,7 +13,14 @@
 #include <array>
 #include <cassert>
 #include <cstring>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
@@ -31,7 +38,41 @@ struct ConnmanTestMsg : public CConnman {
         vNodes.clear();
     }
 
+    void InitTestSocketEvents() { InitSocketEvents(); }
+    void CloseTestSocketEvents() { CloseSocketEvents(); }
+    /** Add a node whose socket is watched by SocketEventsOnce(). */
+    void AddTestNodeWithSocket(CNode& node)
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&node);
+        RegisterSocketEvents(node);
+    }
+    void SocketEventsOnce(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+    {
+#ifdef USE_EPOLL
+        if (m_epoll_fd != -1) {
+            std::vector<const ListenSocket*> listen_ready;
+            std::map<CNode*, uint32_t> nodes_ready;
+            SocketEventsEpoll(listen_ready, nodes_ready);
+            for (const auto& [node, events] : nodes_ready) {
+                const SOCKET socket{WITH_LOCK(node->cs_hSocket, return node->hSocket)};
+                if (events & EPOLLIN) recv_set.insert(socket);
+                if (events & EPOLLOUT) send_set.insert(socket);
+                if (events & (EPOLLERR | EPOLLHUP)) error_set.insert(socket);
+            }
+            return;
+        }
+#endif
+        SocketEvents(recv_set, send_set, error_set);
+    }
+    /** Run one iteration of the socket handler thread, without disconnecting nodes. */
+    void SocketHandlerOnce() { SocketHandler(); }
+
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
+    /** Handle the messages of each node once, as done by one iteration of the message handler thread. */
+    bool HandleMessagesOnce(const std::vector<CNode*>& nodes) { return HandleMessagesRound(nodes); }
+    void StartTestMessageHandlerWorkers(int threads_num) { StartMessageHandlerWorkers(threads_num); }
+    void StopTestMessageHandlerWorkers() { StopMessageHandlerWorkers(); }
 
     void NodeReceiveMsgBytes(CNode& node, Span<const uint8_t> msg_bytes, bool& complete) const;
 
@@ -4,6 +4,7 @@
 //
 #include <sync.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -52,7 +53,16 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         BOOST_TEST_MESSAGE("CCoinsViewCache memory usage: " << view.DynamicMemoryUsage());
     };
 
-    constexpr size_t MAX_COINS_CACHE_BYTES = 1024;
+    // The coins map allocates its nodes from a PoolResource, which holds a
+    // 256 KiB chunk from the start and is accounted for in whole chunks. The
+    // nodes of the coins added here are carved from that chunk, so each coin
+    // only grows the usage by COIN_SIZE and the bucket array. Budget for the
+    // chunk on top of the 1024 bytes this test used to allow, and leave enough
+    // room that the empty cache is below the 90% LARGE threshold. The 10% band
+    // between LARGE and CRITICAL then spans a few hundred coins.
+    const size_t POOL_USAGE{memusage::MallocUsage(262144) + memusage::MallocUsage(sizeof(void*) * 3)};
+    const size_t MAX_COINS_CACHE_BYTES{(POOL_USAGE + 1024) * 10 / 9};
+    const size_t MAX_MEMPOOL_BYTES{MAX_COINS_CACHE_BYTES / 4};
 
     // Without any coins in the cache, we shouldn't need to flush.
     BOOST_CHECK_EQUAL(
@@ -62,10 +72,10 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     // If the initial memory allocations of cacheCoins don't match these common
     // cases, we can't really continue to make assertions about memory usage.
     // End the test early.
-    if (view.DynamicMemoryUsage() != 32 && view.DynamicMemoryUsage() != 16) {
+    if (view.DynamicMemoryUsage() != POOL_USAGE + 32 && view.DynamicMemoryUsage() != POOL_USAGE + 16) {
         // Add a bunch of coins to see that we at least flip over to CRITICAL.
 
-        for (int i{0}; i < 1000; ++i) {
+        for (int i{0}; i < 5000; ++i) {
             COutPoint res = add_coin(view);
             BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
         }
@@ -79,15 +89,15 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     }
 
     print_view_mem_usage(view);
-    BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), is_64_bit ? 32U : 16U);
+    BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), POOL_USAGE + (is_64_bit ? 32U : 16U));
 
-    // We should be able to add COINS_UNTIL_CRITICAL coins to the cache before going CRITICAL.
+    // We should be able to add COINS_UNTIL_LARGE coins to the cache before going LARGE.
     // This is contingent not only on the dynamic memory usage of the Coins
     // that we're adding (COIN_SIZE bytes per), but also on how much memory the
     // cacheCoins (unordered_map) preallocates.
-    constexpr int COINS_UNTIL_CRITICAL{3};
+    constexpr int COINS_UNTIL_LARGE{11};
 
-    for (int i{0}; i < COINS_UNTIL_CRITICAL; ++i) {
+    for (int i{0}; i < COINS_UNTIL_LARGE; ++i) {
         COutPoint res = add_coin(view);
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
@@ -96,15 +106,29 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
             CoinsCacheSizeState::OK);
     }
 
-    // Adding some additional coins will push us over the edge to CRITICAL.
+    // Adding some additional coins will push us over 90%, and then over the
+    // edge to CRITICAL.
     for (int i{0}; i < 4; ++i) {
         add_coin(view);
         print_view_mem_usage(view);
+        if (chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0) ==
+            CoinsCacheSizeState::LARGE) {
+            break;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::LARGE);
+
+    for (int i{0}; i < 400; ++i) {
+        add_coin(view);
         if (chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0) ==
             CoinsCacheSizeState::CRITICAL) {
             break;
         }
     }
+    print_view_mem_usage(view);
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
@@ -112,30 +136,36 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
 
     // Passing non-zero max mempool usage should allow us more headroom.
     BOOST_CHECK_EQUAL(
-        chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+        chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, MAX_MEMPOOL_BYTES),
         CoinsCacheSizeState::OK);
 
     for (int i{0}; i < 3; ++i) {
         add_coin(view);
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+            chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, MAX_MEMPOOL_BYTES),
             CoinsCacheSizeState::OK);
     }
 
-    // Adding another coin with the additional mempool room will put us >90%
+    // Adding more coins with the additional mempool room will put us >90%
     // but not yet critical.
-    add_coin(view);
+    for (int i{0}; i < 500; ++i) {
+        add_coin(view);
+        if (chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, MAX_MEMPOOL_BYTES) !=
+            CoinsCacheSizeState::OK) {
+            break;
+        }
+    }
     print_view_mem_usage(view);
 
     // Only perform these checks on 64 bit hosts; I haven't done the math for 32.
     if (is_64_bit) {
-        float usage_percentage = (float)view.DynamicMemoryUsage() / (MAX_COINS_CACHE_BYTES + (1 << 10));
+        float usage_percentage = (float)view.DynamicMemoryUsage() / (MAX_COINS_CACHE_BYTES + MAX_MEMPOOL_BYTES);
         BOOST_TEST_MESSAGE("CoinsTip usage percentage: " << usage_percentage);
         BOOST_CHECK(usage_percentage >= 0.9);
         BOOST_CHECK(usage_percentage < 1);
         BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, 1 << 10),
+            chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, MAX_MEMPOOL_BYTES),
             CoinsCacheSizeState::LARGE);
     }
 
@@ -147,8 +177,10 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
             CoinsCacheSizeState::OK);
     }
 
-    // Flushing the view doesn't take us back to OK because cacheCoins has
-    // preallocated memory that doesn't get reclaimed even after flush.
+    // Flushing the view doesn't take us back to OK because the memory
+    // resource of cacheCoins keeps its chunks and cacheCoins its buckets even
+    // after flush. Only the coins' scripts are freed, which is enough to drop
+    // us from CRITICAL to LARGE.
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, 0),
@@ -160,7 +192,54 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, 0),
-        CoinsCacheSizeState::CRITICAL);
+        CoinsCacheSizeState::LARGE);
+}
+
+//! Test that coins handed to the background writer stay visible until they
+//! have been written, and end up in the database.
+BOOST_AUTO_TEST_CASE(background_flush)
+{
+    CCoinsViewDB db("", 1 << 20, /* fMemory */ true, /* fWipe */ false);
+    CCoinsViewBackgroundWriter writer(db, /* background */ true);
+    BOOST_CHECK(writer.IsBackground());
+    CCoinsViewCache cache(&writer);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+    }
+    const uint256 block1 = InsecureRand256();
+    cache.SetBestBlock(block1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    // Whether or not the write has completed yet, the coins are visible.
+    BOOST_CHECK(writer.GetBestBlock() == block1);
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, i + 1);
+    }
+
+    // Spend half of the coins and flush again; this waits for the first write.
+    // A cache on top merges into its parent rather than handing its map over.
+    CCoinsViewCache child(&cache);
+    BOOST_CHECK(!child.CanTakeCache());
+    for (int i = 0; i < 50; ++i) {
+        BOOST_CHECK(child.SpendCoin(outpoints[i]));
+    }
+    BOOST_CHECK(child.Flush());
+    const uint256 block2 = InsecureRand256();
+    cache.SetBestBlock(block2);
+    BOOST_CHECK(cache.Flush());
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(writer.HaveCoin(outpoints[i]), i >= 50);
+    }
+
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(outpoints[i]), i >= 50);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
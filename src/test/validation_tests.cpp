@@ -3,8 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <checkqueue.h>
+#include <coins.h>
 #include <net.h>
+#include <random.h>
 #include <signet.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <validation.h>
 
@@ -143,4 +147,57 @@ BOOST_AUTO_TEST_CASE(test_assumeutxo)
     BOOST_CHECK_EQUAL(out210.nChainTx, 200U);
 }
 
+BOOST_AUTO_TEST_CASE(prefetch_block_inputs)
+{
+    CCoinsViewDB db("", 1 << 20, true, true);
+    const CScript script = CScript() << OP_TRUE;
+    std::vector<COutPoint> db_outpoints;
+    {
+        CCoinsViewCache writer(&db);
+        for (int i = 0; i < 4; ++i) {
+            db_outpoints.emplace_back(InsecureRand256(), i);
+            writer.AddCoin(db_outpoints.back(), Coin(CTxOut(i + 1, script), 1, false), false);
+        }
+        writer.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(writer.Flush());
+    }
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(1, script);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(db_outpoints[0]);
+    tx1.vin.emplace_back(db_outpoints[1]);
+    tx1.vin.emplace_back(COutPoint(InsecureRand256(), 0)); // missing from the database
+    tx1.vout.emplace_back(1, script);
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    CMutableTransaction tx2;
+    tx2.vin.emplace_back(block.vtx[1]->GetHash(), 0); // created in the block
+    tx2.vin.emplace_back(db_outpoints[2]);
+    tx2.vin.emplace_back(db_outpoints[3]);
+    block.vtx.push_back(MakeTransactionRef(tx2));
+
+    for (bool parallel : {false, true}) {
+        CCheckQueue<CCoinPrefetch> queue{2};
+        if (parallel) queue.StartWorkerThreads(2);
+        CCoinsViewCache cache(&db);
+        // An entry already in the cache (here: spent but not yet flushed)
+        // must not be overwritten with the database's view of it.
+        cache.AccessCoin(db_outpoints[3]);
+        BOOST_CHECK(cache.SpendCoin(db_outpoints[3]));
+
+        BOOST_CHECK_EQUAL(PrefetchBlockInputs(block, cache, db, parallel ? &queue : nullptr), 3U);
+        for (int i = 0; i < 3; ++i) {
+            BOOST_CHECK(cache.HaveCoinInCache(db_outpoints[i]));
+            BOOST_CHECK_EQUAL(cache.AccessCoin(db_outpoints[i]).out.nValue, i + 1);
+        }
+        BOOST_CHECK(!cache.HaveCoinInCache(db_outpoints[3]));
+        BOOST_CHECK(!cache.HaveEntryInCache(tx1.vin[2].prevout));
+        BOOST_CHECK(!cache.HaveEntryInCache(tx2.vin[0].prevout));
+        if (parallel) queue.StopWorkerThreads();
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
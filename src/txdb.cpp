@@ -5,12 +5,14 @@
 
 #include <txdb.h>
 
+#include <logging/timer.h>
 #include <node/ui_interface.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
@@ -81,6 +83,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, /* erase */ true);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) {
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -116,7 +122,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -146,6 +152,130 @@ size_t CCoinsViewDB::EstimateSize() const
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
 }
 
+CCoinsViewBackgroundWriter::CCoinsViewBackgroundWriter(CCoinsViewDB& db, bool background) : CCoinsViewBacked(&db), m_db(db)
+{
+    if (background) {
+        m_thread = std::thread(&util::TraceThread, "coinsflush", [this] { ThreadWrite(); });
+    }
+}
+
+CCoinsViewBackgroundWriter::~CCoinsViewBackgroundWriter()
+{
+    if (m_thread.joinable()) {
+        WITH_LOCK(m_mutex, m_request_stop = true);
+        m_cond.notify_all();
+        // The thread finishes the write in progress before exiting.
+        m_thread.join();
+    }
+}
+
+void CCoinsViewBackgroundWriter::ThreadWrite()
+{
+    while (true) {
+        PendingWrite* pending;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            while ((!m_pending || m_write_failed) && !m_request_stop) {
+                m_cond.wait(lock);
+            }
+            if (!m_pending || m_write_failed) return;
+            pending = m_pending.get();
+        }
+
+        // Readers may look up coins in the pending map concurrently, so it
+        // must not be modified until the write has finished.
+        bool ok;
+        try {
+            LOG_TIME_SECONDS(strprintf("write coins to disk in the background (%d coins)", pending->coins.size()));
+            ok = m_db.WriteCoins(pending->coins, pending->best_block, /* erase */ false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: error writing coins: %s\n", __func__, e.what());
+            ok = false;
+        }
+
+        std::unique_ptr<PendingWrite> done;
+        {
+            LOCK(m_mutex);
+            if (ok) {
+                done = std::move(m_pending);
+            } else {
+                // Keep the coins around to answer lookups; they are not in
+                // the database.
+                m_write_failed = true;
+            }
+        }
+        m_cond.notify_all();
+        // Free the map outside of the lock.
+        done.reset();
+    }
+}
+
+bool CCoinsViewBackgroundWriter::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->coins.find(outpoint);
+            if (it != m_pending->coins.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    // Coins that are not pending are unchanged by the write in progress, so
+    // the database is up to date for them.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundWriter::HaveCoin(const COutPoint &outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewBackgroundWriter::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) return m_pending->best_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundWriter::TakeCache(std::unique_ptr<CCoinsMapMemoryResource>& resource, CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (!m_thread.joinable()) return false;
+
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (m_pending && !m_write_failed) {
+            m_cond.wait(lock);
+        }
+        if (m_write_failed) return false;
+        // Moving the map keeps its entries where they are, in the memory
+        // resource that moves along with it.
+        m_pending.reset(new PendingWrite{std::move(resource), std::move(mapCoins), hashBlock});
+        mapCoins.clear();
+    }
+    m_cond.notify_all();
+    return true;
+}
+
+std::unique_ptr<CCoinsViewCursor> CCoinsViewBackgroundWriter::Cursor() const
+{
+    Sync();
+    return base->Cursor();
+}
+
+bool CCoinsViewBackgroundWriter::Sync() const
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (m_pending && !m_write_failed) {
+        m_cond.wait(lock);
+    }
+    return !m_write_failed;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.GetDataDirNet() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
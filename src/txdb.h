@@ -10,9 +10,12 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -24,6 +27,8 @@ class uint256;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -backgroundflush default
+static constexpr bool DEFAULT_BACKGROUND_FLUSH{false};
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -36,6 +41,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
+//! Max memory allocated to the script index cache in MiB.
+static const int64_t max_script_index_cache = 1024;
+//! Max memory allocated to the spent index cache in MiB.
+static const int64_t max_spent_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -62,6 +71,15 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
 
+    /**
+     * Write the DIRTY entries of mapCoins to the database, in batches of at
+     * most -dbbatchsize bytes, with the same crash consistency guarantees as
+     * BatchWrite(). Unlike BatchWrite(), written entries are only removed
+     * from mapCoins if erase is true, so that the map can keep being read by
+     * other threads while it is written.
+     */
+    bool WriteCoins(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -70,6 +88,74 @@ public:
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
+/**
+ * CCoinsView that writes flushes to the coin database on a background thread.
+ *
+ * TakeCache() takes over the flushing cache's whole map, together with its
+ * memory resource, and returns immediately; a dedicated thread then writes
+ * the DIRTY entries with CCoinsViewDB::WriteCoins() and frees the map. Until
+ * that write has completed, lookups are answered from the pending map first,
+ * so the layers above keep seeing a consistent UTXO set. At most one write is
+ * in flight: a second TakeCache() waits for the previous one to finish.
+ *
+ * If a write fails, the pending map is kept so lookups stay correct, and
+ * later TakeCache() calls return false without taking anything, so the
+ * caller aborts with its cache intact.
+ *
+ * If a crash happens while writing, the head blocks markers written by the
+ * database let ReplayBlocks() recover on restart, exactly as for a crash
+ * during a synchronous flush.
+ *
+ * Without a background thread (background=false), CanTakeCache() is false
+ * and BatchWrite() writes synchronously.
+ */
+class CCoinsViewBackgroundWriter final : public CCoinsViewBacked
+{
+private:
+    //! A cache handed over by TakeCache() that may not be in the database yet.
+    struct PendingWrite {
+        //! Owns the memory of the entries in coins, so must outlive it.
+        std::unique_ptr<CCoinsMapMemoryResource> resource;
+        CCoinsMap coins;
+        uint256 best_block;
+    };
+
+    CCoinsViewDB& m_db;
+
+    mutable Mutex m_mutex;
+    mutable std::condition_variable m_cond;
+    //! The write in progress, if any. Not modified while it is being written,
+    //! and kept to serve reads if the write fails.
+    std::unique_ptr<PendingWrite> m_pending GUARDED_BY(m_mutex);
+    //! Whether a background write has failed. No later write is accepted.
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+
+    std::thread m_thread;
+
+    void ThreadWrite();
+
+public:
+    CCoinsViewBackgroundWriter(CCoinsViewDB& db, bool background);
+    ~CCoinsViewBackgroundWriter();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool CanTakeCache() const override { return IsBackground(); }
+    bool TakeCache(std::unique_ptr<CCoinsMapMemoryResource>& resource, CCoinsMap& mapCoins, const uint256& hashBlock) override;
+    std::unique_ptr<CCoinsViewCursor> Cursor() const override;
+
+    //! Whether TakeCache() hands writes over to a background thread.
+    bool IsBackground() const { return m_thread.joinable(); }
+
+    /**
+     * Wait until the write in progress, if any, has reached the database.
+     * @returns false if any background write failed.
+     */
+    bool Sync() const;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -61,25 +61,34 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
-
-    while (!stageEntries.empty()) {
-        const CTxMemPoolEntry& descendant = *stageEntries.begin();
-        descendants.insert(descendant);
-        stageEntries.erase(descendant);
-        const CTxMemPoolEntry::Children& children = descendant.GetMemPoolChildrenConst();
-        for (const CTxMemPoolEntry& childEntry : children) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(mapTx.iterator_to(childEntry));
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (txiter cacheEntry : cacheIt->second) {
-                    descendants.insert(*cacheEntry);
+    std::vector<txiter>& stage = m_walk_stage;
+    std::vector<txiter>& descendants = m_walk_result;
+    stage.clear();
+    descendants.clear();
+    {
+        WITH_FRESH_EPOCH(m_epoch);
+        for (const CTxMemPoolEntry& child : updateIt->GetMemPoolChildrenConst()) {
+            txiter childIt = mapTx.iterator_to(child);
+            if (!visited(childIt)) stage.push_back(childIt);
+        }
+        while (!stage.empty()) {
+            txiter descendantIt = stage.back();
+            stage.pop_back();
+            descendants.push_back(descendantIt);
+            const CTxMemPoolEntry::Children& children = descendantIt->GetMemPoolChildrenConst();
+            for (const CTxMemPoolEntry& childEntry : children) {
+                txiter childIt = mapTx.iterator_to(childEntry);
+                cacheMap::iterator cacheIt = cachedDescendants.find(childIt);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (txiter cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) descendants.push_back(cacheEntry);
+                    }
+                } else if (!visited(childIt)) {
+                    // Schedule for later processing
+                    stage.push_back(childIt);
                 }
-            } else if (!descendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
             }
         }
     }
@@ -88,14 +97,15 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const CTxMemPoolEntry& descendant : descendants) {
-        if (!setExclude.count(descendant.GetTx().GetHash())) {
-            modifySize += descendant.GetTxSize();
-            modifyFee += descendant.GetModifiedFee();
+    std::vector<txiter>& cached = cachedDescendants[updateIt];
+    for (txiter descendantIt : descendants) {
+        if (!setExclude.count(descendantIt->GetTx().GetHash())) {
+            modifySize += descendantIt->GetTxSize();
+            modifyFee += descendantIt->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
+            cached.push_back(descendantIt);
             // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(descendantIt, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -153,8 +163,8 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
                                                   size_t entry_count,
-                                                  setEntries& setAncestors,
-                                                  CTxMemPoolEntry::Parents& staged_ancestors,
+                                                  std::vector<txiter>& ancestors,
+                                                  std::vector<txiter>& staged_ancestors,
                                                   uint64_t limitAncestorCount,
                                                   uint64_t limitAncestorSize,
                                                   uint64_t limitDescendantCount,
@@ -164,11 +174,10 @@ bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
     size_t totalSizeWithAncestors = entry_size;
 
     while (!staged_ancestors.empty()) {
-        const CTxMemPoolEntry& stage = staged_ancestors.begin()->get();
-        txiter stageit = mapTx.iterator_to(stage);
+        txiter stageit = staged_ancestors.back();
+        staged_ancestors.pop_back();
 
-        setAncestors.insert(stageit);
-        staged_ancestors.erase(stage);
+        ancestors.push_back(stageit);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry_size > limitDescendantSize) {
@@ -187,10 +196,10 @@ bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
             txiter parent_it = mapTx.iterator_to(parent);
 
             // If this is a new ancestor, add it.
-            if (setAncestors.count(parent_it) == 0) {
-                staged_ancestors.insert(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
             }
-            if (staged_ancestors.size() + setAncestors.size() + entry_count > limitAncestorCount) {
+            if (staged_ancestors.size() + ancestors.size() + entry_count > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -207,14 +216,18 @@ bool CTxMemPool::CheckPackageLimits(const Package& package,
                                     uint64_t limitDescendantSize,
                                     std::string &errString) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    std::vector<txiter>& staged_ancestors = m_walk_stage;
+    std::vector<txiter>& ancestors = m_walk_result;
+    staged_ancestors.clear();
+    ancestors.clear();
+    WITH_FRESH_EPOCH(m_epoch);
     size_t total_size = 0;
     for (const auto& tx : package) {
         total_size += GetVirtualTransactionSize(*tx);
         for (const auto& input : tx->vin) {
             std::optional<txiter> piter = GetIter(input.prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (!visited(piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + package.size() > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -225,9 +238,8 @@ bool CTxMemPool::CheckPackageLimits(const Package& package,
     // When multiple transactions are passed in, the ancestors and descendants of all transactions
     // considered together must be within limits even if they are not interdependent. This may be
     // stricter than the limits for each individual transaction.
-    setEntries setAncestors;
     const auto ret = CalculateAncestorsAndCheckLimits(total_size, package.size(),
-                                                      setAncestors, staged_ancestors,
+                                                      ancestors, staged_ancestors,
                                                       limitAncestorCount, limitAncestorSize,
                                                       limitDescendantCount, limitDescendantSize, errString);
     // It's possible to overestimate the ancestor/descendant totals.
@@ -244,7 +256,11 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                                            std::string &errString,
                                            bool fSearchForParents /* = true */) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    std::vector<txiter>& staged_ancestors = m_walk_stage;
+    std::vector<txiter>& ancestors = m_walk_result;
+    staged_ancestors.clear();
+    ancestors.clear();
+    WITH_FRESH_EPOCH(m_epoch);
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -253,8 +269,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             std::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (!visited(piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -265,16 +281,42 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
         // If we're not searching for parents, we require this to already be an
         // entry in the mempool and use the entry's cached parents.
         txiter it = mapTx.iterator_to(entry);
-        staged_ancestors = it->GetMemPoolParentsConst();
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) staged_ancestors.push_back(parent_it);
+        }
     }
 
-    return CalculateAncestorsAndCheckLimits(entry.GetTxSize(), /* entry_count */ 1,
-                                            setAncestors, staged_ancestors,
-                                            limitAncestorCount, limitAncestorSize,
-                                            limitDescendantCount, limitDescendantSize, errString);
+    const bool ret = CalculateAncestorsAndCheckLimits(entry.GetTxSize(), /* entry_count */ 1,
+                                                      ancestors, staged_ancestors,
+                                                      limitAncestorCount, limitAncestorSize,
+                                                      limitDescendantCount, limitDescendantSize, errString);
+    setAncestors.insert(ancestors.begin(), ancestors.end());
+    return ret;
+}
+
+void CTxMemPool::CalculateAncestors(txiter entryit, std::vector<txiter>& ancestors) const
+{
+    std::vector<txiter>& stage = m_walk_stage;
+    stage.clear();
+    WITH_FRESH_EPOCH(m_epoch);
+    for (const CTxMemPoolEntry& parent : entryit->GetMemPoolParentsConst()) {
+        txiter parent_it = mapTx.iterator_to(parent);
+        if (!visited(parent_it)) stage.push_back(parent_it);
+    }
+    while (!stage.empty()) {
+        txiter it = stage.back();
+        stage.pop_back();
+        ancestors.push_back(it);
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) stage.push_back(parent_it);
+        }
+    }
 }
 
-void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+template <typename Entries>
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, const Entries& setAncestors)
 {
     CTxMemPoolEntry::Parents parents = it->GetMemPoolParents();
     // add or remove this tx as a child of each parent
@@ -313,36 +355,39 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
+    if (!updateDescendants) {
+        // All in-mempool descendants of the entries are being removed as
+        // well, e.g. when evicting the package of an entry.
+        UpdateForRemovePackage(entriesToRemove);
+        return;
+    }
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-    if (updateDescendants) {
-        // updateDescendants should be true whenever we're not recursively
-        // removing a tx and all its descendants, eg when a transaction is
-        // confirmed in a block.
-        // Here we only update statistics and not data in CTxMemPool::Parents
-        // and CTxMemPoolEntry::Children (which we need to preserve until we're
-        // finished with all operations that need to traverse the mempool).
-        for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
-            }
+    // updateDescendants should be true whenever we're not recursively
+    // removing a tx and all its descendants, eg when a transaction is
+    // confirmed in a block.
+    // Here we only update statistics and not data in CTxMemPool::Parents
+    // and CTxMemPoolEntry::Children (which we need to preserve until we're
+    // finished with all operations that need to traverse the mempool).
+    for (txiter removeIt : entriesToRemove) {
+        std::vector<txiter>& descendants = m_walk_result;
+        descendants.clear();
+        CalculateDescendants(removeIt, descendants);
+        int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+        CAmount modifyFee = -removeIt->GetModifiedFee();
+        int modifySigOps = -removeIt->GetSigOpCost();
+        for (txiter dit : descendants) {
+            if (dit == removeIt) continue; // don't update state for self
+            mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
         }
     }
     for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
+        std::vector<txiter>& ancestors = m_walk_result;
+        ancestors.clear();
+        // Since this is a tx that is already in the mempool, we can walk its
+        // cached parents rather than search for them in mapTx.  If the mempool
+        // is in a consistent state, then both should give the same result,
+        // though walking the cached parents is faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
         // of ancestors reachable via GetMemPoolParents()/GetMemPoolChildren()
@@ -358,10 +403,10 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // mempool parents we'd calculate by searching, and it's important that
         // we use the cached notion of ancestor transactions as the set of
         // things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        CalculateAncestors(removeIt, ancestors);
         // Note that UpdateAncestorsOf severs the child links that point to
         // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        UpdateAncestorsOf(false, removeIt, ancestors);
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update CTxMemPoolEntry::m_parents
@@ -371,6 +416,45 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
     }
 }
 
+void CTxMemPool::UpdateForRemovePackage(const setEntries& package)
+{
+    // Links and state within the package go away with its entries, so only
+    // the ancestors outside the package need updating. Each of them is
+    // modified once, with the totals of its descendants in the package,
+    // rather than once for every one of them.
+    std::vector<std::pair<txiter, txiter>> updates; // ancestor, removed descendant
+    for (txiter removeIt : package) {
+        for (const CTxMemPoolEntry& parent : removeIt->GetMemPoolParentsConst()) {
+            const txiter parent_it = mapTx.iterator_to(parent);
+            if (!package.count(parent_it)) UpdateChild(parent_it, removeIt, false);
+        }
+        std::vector<txiter>& ancestors = m_walk_result;
+        ancestors.clear();
+        // Walk the cached parents, as the mempool may be in the middle of a
+        // reorg (see UpdateForRemoveFromMempool).
+        CalculateAncestors(removeIt, ancestors);
+        for (txiter ancestor_it : ancestors) {
+            if (package.count(ancestor_it)) continue;
+            updates.emplace_back(ancestor_it, removeIt);
+        }
+    }
+    std::sort(updates.begin(), updates.end(), [](const auto& a, const auto& b) {
+        return &*a.first < &*b.first;
+    });
+    for (auto it = updates.begin(); it != updates.end();) {
+        const txiter ancestor_it = it->first;
+        int64_t size = 0;
+        CAmount fee = 0;
+        int64_t count = 0;
+        for (; it != updates.end() && it->first == ancestor_it; ++it) {
+            size += it->second->GetTxSize();
+            fee += it->second->GetModifiedFee();
+            ++count;
+        }
+        mapTx.modify(ancestor_it, update_descendant_state(-size, -fee, -count));
+    }
+}
+
 void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
 {
     nSizeWithDescendants += modifySize;
@@ -511,28 +595,48 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
-    }
+    if (setDescendants.count(entryit)) return;
+    std::vector<txiter>& stage = m_walk_stage;
+    stage.clear();
+    WITH_FRESH_EPOCH(m_epoch);
+    visited(entryit);
+    stage.push_back(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& child : children) {
             txiter childiter = mapTx.iterator_to(child);
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
 }
 
+void CTxMemPool::CalculateDescendants(txiter entryit, std::vector<txiter>& descendants) const
+{
+    std::vector<txiter>& stage = m_walk_stage;
+    stage.clear();
+    WITH_FRESH_EPOCH(m_epoch);
+    visited(entryit);
+    stage.push_back(entryit);
+    while (!stage.empty()) {
+        txiter it = stage.back();
+        stage.pop_back();
+        descendants.push_back(it);
+        for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+            txiter childiter = mapTx.iterator_to(child);
+            if (!visited(childiter)) stage.push_back(childiter);
+        }
+    }
+}
+
 void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -1130,16 +1234,16 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
-        std::vector<CTransaction> txn;
+        std::vector<CTransactionRef> txn;
         if (pvNoSpendsRemaining) {
             txn.reserve(stage.size());
             for (txiter iter : stage)
-                txn.push_back(iter->GetTx());
+                txn.push_back(iter->GetSharedTx());
         }
         RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
         if (pvNoSpendsRemaining) {
-            for (const CTransaction& tx : txn) {
-                for (const CTxIn& txin : tx.vin) {
+            for (const CTransactionRef& tx : txn) {
+                for (const CTxIn& txin : tx->vin) {
                     if (exists(txin.prevout.hash)) continue;
                     pvNoSpendsRemaining->push_back(txin.prevout);
                 }
@@ -5,10 +5,13 @@
 #include <txorphanage.h>
 
 #include <consensus/validation.h>
+#include <core_memusage.h>
 #include <logging.h>
 #include <policy/policy.h>
 
+#include <algorithm>
 #include <cassert>
+#include <unordered_set>
 
 /** Expiration time for orphan transactions in seconds */
 static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
@@ -17,7 +20,25 @@ static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 
 RecursiveMutex g_cs_orphans;
 
+/** The txids of a transaction's parents, each listed once */
+static std::vector<uint256> GetParentTxids(const CTransaction& tx)
+{
+    std::vector<uint256> parents;
+    parents.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        parents.push_back(txin.prevout.hash);
+    }
+    std::sort(parents.begin(), parents.end());
+    parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+    return parents;
+}
+
 bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    return AddTx(tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME);
+}
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer, int64_t time_expire)
 {
     AssertLockHeld(g_cs_orphans);
 
@@ -30,8 +51,8 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The total size of all orphans is limited by LimitOrphans, and this
+    // keeps a single orphan from taking up a large part of it.
     unsigned int sz = GetTransactionWeight(*tx);
     if (sz > MAX_STANDARD_TX_WEIGHT)
     {
@@ -39,17 +60,21 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
         return false;
     }
 
-    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, m_orphan_list.size()});
+    PeerOrphans& peer_orphans = m_peer_orphans[peer];
+    const size_t usage = RecursiveDynamicUsage(tx);
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, time_expire, peer_orphans.orphans.size(), usage});
     assert(ret.second);
-    m_orphan_list.push_back(ret.first);
+    peer_orphans.orphans.push_back(ret.first);
+    peer_orphans.usage += usage;
+    m_total_usage += usage;
     // Allow for lookups in the orphan pool by wtxid, as well as txid
     m_wtxid_to_orphan_it.emplace(tx->GetWitnessHash(), ret.first);
-    for (const CTxIn& txin : tx->vin) {
-        m_outpoint_to_orphan_it[txin.prevout].insert(ret.first);
+    for (const uint256& parent : GetParentTxids(*tx)) {
+        m_parent_to_children[parent].insert(ret.first);
     }
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             m_orphans.size(), m_outpoint_to_orphan_it.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u parentsz %u)\n", hash.ToString(),
+             m_orphans.size(), m_parent_to_children.size());
     return true;
 }
 
@@ -59,26 +84,32 @@ int TxOrphanage::EraseTx(const uint256& txid)
     std::map<uint256, OrphanTx>::iterator it = m_orphans.find(txid);
     if (it == m_orphans.end())
         return 0;
-    for (const CTxIn& txin : it->second.tx->vin)
+    for (const uint256& parent : GetParentTxids(*it->second.tx))
     {
-        auto itPrev = m_outpoint_to_orphan_it.find(txin.prevout);
-        if (itPrev == m_outpoint_to_orphan_it.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            m_outpoint_to_orphan_it.erase(itPrev);
+        auto itParent = m_parent_to_children.find(parent);
+        assert(itParent != m_parent_to_children.end());
+        const size_t erased = itParent->second.erase(it);
+        assert(erased == 1);
+        if (itParent->second.empty())
+            m_parent_to_children.erase(itParent);
     }
 
+    auto itPeer = m_peer_orphans.find(it->second.fromPeer);
+    assert(itPeer != m_peer_orphans.end());
+    std::vector<OrphanMap::iterator>& peer_list = itPeer->second.orphans;
     size_t old_pos = it->second.list_pos;
-    assert(m_orphan_list[old_pos] == it);
-    if (old_pos + 1 != m_orphan_list.size()) {
-        // Unless we're deleting the last entry in m_orphan_list, move the last
+    assert(peer_list[old_pos] == it);
+    if (old_pos + 1 != peer_list.size()) {
+        // Unless we're deleting the last entry in the peer's list, move the last
         // entry to the position we're deleting.
-        auto it_last = m_orphan_list.back();
-        m_orphan_list[old_pos] = it_last;
+        auto it_last = peer_list.back();
+        peer_list[old_pos] = it_last;
         it_last->second.list_pos = old_pos;
     }
-    m_orphan_list.pop_back();
+    peer_list.pop_back();
+    itPeer->second.usage -= it->second.usage;
+    m_total_usage -= it->second.usage;
+    if (peer_list.empty()) m_peer_orphans.erase(itPeer);
     m_wtxid_to_orphan_it.erase(it->second.tx->GetWitnessHash());
 
     m_orphans.erase(it);
@@ -89,20 +120,20 @@ void TxOrphanage::EraseForPeer(NodeId peer)
 {
     AssertLockHeld(g_cs_orphans);
 
+    auto itPeer = m_peer_orphans.find(peer);
+    if (itPeer == m_peer_orphans.end()) return;
+    std::vector<uint256> vOrphanErase;
+    for (const auto& it : itPeer->second.orphans) {
+        vOrphanErase.push_back(it->first);
+    }
     int nErased = 0;
-    std::map<uint256, OrphanTx>::iterator iter = m_orphans.begin();
-    while (iter != m_orphans.end())
-    {
-        std::map<uint256, OrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseTx(maybeErase->second.tx->GetHash());
-        }
+    for (const uint256& orphanHash : vOrphanErase) {
+        nErased += EraseTx(orphanHash);
     }
     if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
-unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
+unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans, size_t max_usage)
 {
     AssertLockHeld(g_cs_orphans);
 
@@ -128,11 +159,16 @@ unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
     FastRandomContext rng;
-    while (m_orphans.size() > max_orphans)
+    while (m_orphans.size() > max_orphans || m_total_usage > max_usage)
     {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(m_orphan_list.size());
-        EraseTx(m_orphan_list[randompos]->first);
+        // Evict a random orphan of the peer whose orphans use the most
+        // memory, so that a peer flooding us with orphans mostly pushes out
+        // its own:
+        const auto itPeer = std::max_element(m_peer_orphans.begin(), m_peer_orphans.end(),
+            [](const auto& a, const auto& b) { return a.second.usage < b.second.usage; });
+        const std::vector<OrphanMap::iterator>& peer_list = itPeer->second.orphans;
+        size_t randompos = rng.randrange(peer_list.size());
+        EraseTx(peer_list[randompos]->first);
         ++nEvicted;
     }
     return nEvicted;
@@ -141,16 +177,25 @@ unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
 void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const
 {
     AssertLockHeld(g_cs_orphans);
-    for (unsigned int i = 0; i < tx.vout.size(); i++) {
-        const auto it_by_prev = m_outpoint_to_orphan_it.find(COutPoint(tx.GetHash(), i));
-        if (it_by_prev != m_outpoint_to_orphan_it.end()) {
-            for (const auto& elem : it_by_prev->second) {
-                orphan_work_set.insert(elem->first);
-            }
+    const auto it_by_parent = m_parent_to_children.find(tx.GetHash());
+    if (it_by_parent != m_parent_to_children.end()) {
+        for (const auto& elem : it_by_parent->second) {
+            orphan_work_set.insert(elem->first);
         }
     }
 }
 
+std::vector<std::pair<CTransactionRef, int64_t>> TxOrphanage::GetOrphanTxs() const
+{
+    AssertLockHeld(g_cs_orphans);
+    std::vector<std::pair<CTransactionRef, int64_t>> ret;
+    ret.reserve(m_orphans.size());
+    for (const auto& [txid, orphan] : m_orphans) {
+        ret.emplace_back(orphan.tx, orphan.nTimeExpire);
+    }
+    return ret;
+}
+
 bool TxOrphanage::HaveTx(const GenTxid& gtxid) const
 {
     LOCK(g_cs_orphans);
@@ -174,23 +219,37 @@ void TxOrphanage::EraseForBlock(const CBlock& block)
 {
     LOCK(g_cs_orphans);
 
-    std::vector<uint256> vOrphanErase;
-
+    // Collect the outputs the block spends and their distinct parents, then
+    // each orphan spending from those parents once, so that the work is
+    // linear in the number of block inputs plus the inputs of those orphans.
+    std::unordered_set<COutPoint, SaltedOutpointHasher> block_spends;
+    std::unordered_set<uint256, SaltedTxidHasher> block_parents;
     for (const CTransactionRef& ptx : block.vtx) {
-        const CTransaction& tx = *ptx;
-
-        // Which orphan pool entries must we evict?
-        for (const auto& txin : tx.vin) {
-            auto itByPrev = m_outpoint_to_orphan_it.find(txin.prevout);
-            if (itByPrev == m_outpoint_to_orphan_it.end()) continue;
-            for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                const CTransaction& orphanTx = *(*mi)->second.tx;
-                const uint256& orphanHash = orphanTx.GetHash();
-                vOrphanErase.push_back(orphanHash);
-            }
+        for (const auto& txin : ptx->vin) {
+            block_spends.insert(txin.prevout);
+            block_parents.insert(txin.prevout.hash);
+        }
+    }
+    std::unordered_set<uint256, SaltedTxidHasher> candidate_txids;
+    std::vector<OrphanMap::iterator> candidates;
+    for (const uint256& parent : block_parents) {
+        auto itByParent = m_parent_to_children.find(parent);
+        if (itByParent == m_parent_to_children.end()) continue;
+        for (const auto& mi : itByParent->second) {
+            if (candidate_txids.insert(mi->first).second) candidates.push_back(mi);
         }
     }
 
+    // Which orphan pool entries must we evict? Only the orphans spending an
+    // output the block spends conflict with it.
+    std::vector<uint256> vOrphanErase;
+    for (const auto& mi : candidates) {
+        const CTransaction& orphanTx = *mi->second.tx;
+        const bool conflicts = std::any_of(orphanTx.vin.begin(), orphanTx.vin.end(),
+            [&](const CTxIn& orphan_txin) { return block_spends.count(orphan_txin.prevout) > 0; });
+        if (conflicts) vOrphanErase.push_back(orphanTx.GetHash());
+    }
+
     // Erase orphan transactions included or precluded by this block
     if (vOrphanErase.size()) {
         int nErased = 0;
@@ -9,20 +9,27 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <sync.h>
+#include <util/hasher.h>
+
+#include <unordered_map>
+#include <unordered_set>
 
 /** Guards orphan transactions and extra txs for compact blocks */
 extern RecursiveMutex g_cs_orphans;
 
 /** A class to track orphan transactions (failed on TX_MISSING_INPUTS)
  * Since we cannot distinguish orphans from bad transactions with
- * non-existent inputs, we heavily limit the number of orphans
- * we keep and the duration we keep them for.
+ * non-existent inputs, we heavily limit the number and memory usage of
+ * orphans we keep and the duration we keep them for.
  */
 class TxOrphanage {
 public:
     /** Add a new orphan transaction */
     bool AddTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
+    /** Add a new orphan transaction that expires at the given time (eg, one loaded from disk) */
+    bool AddTx(const CTransactionRef& tx, NodeId peer, int64_t time_expire) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
     /** Check if we already have an orphan transaction (by txid or wtxid) */
     bool HaveTx(const GenTxid& gtxid) const LOCKS_EXCLUDED(::g_cs_orphans);
 
@@ -40,13 +47,17 @@ public:
     /** Erase all orphans included in or invalidated by a new block */
     void EraseForBlock(const CBlock& block) LOCKS_EXCLUDED(::g_cs_orphans);
 
-    /** Limit the orphanage to the given maximum */
-    unsigned int LimitOrphans(unsigned int max_orphans) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Limit the orphanage to the given number of orphans and memory usage in bytes.
+     * Orphans are evicted from the peer whose orphans use the most memory. */
+    unsigned int LimitOrphans(unsigned int max_orphans, size_t max_usage) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
     /** Add any orphans that list a particular tx as a parent into a peer's work set
      * (ie orphans that may have found their final missing parent, and so should be reconsidered for the mempool) */
     void AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
+    /** Get all orphan transactions with their expiry time */
+    std::vector<std::pair<CTransactionRef, int64_t>> GetOrphanTxs() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
     /** Return how many entries exist in the orphange */
     size_t Size() LOCKS_EXCLUDED(::g_cs_orphans)
     {
@@ -54,35 +65,52 @@ public:
         return m_orphans.size();
     }
 
+    /** Return the memory usage of the orphans' transactions */
+    size_t DynamicMemoryUsage() LOCKS_EXCLUDED(::g_cs_orphans)
+    {
+        LOCK(::g_cs_orphans);
+        return m_total_usage;
+    }
+
 protected:
     struct OrphanTx {
         CTransactionRef tx;
         NodeId fromPeer;
         int64_t nTimeExpire;
+        //! Position in the orphan list of fromPeer
         size_t list_pos;
+        //! Memory usage of tx
+        size_t usage;
     };
 
     /** Map from txid to orphan transaction record. Limited by
-     *  -maxorphantx/DEFAULT_MAX_ORPHAN_TRANSACTIONS */
+     *  -maxorphantx/DEFAULT_MAX_ORPHAN_TRANSACTIONS and
+     *  -maxorphansize/DEFAULT_MAX_ORPHAN_SIZE */
     std::map<uint256, OrphanTx> m_orphans GUARDED_BY(g_cs_orphans);
 
     using OrphanMap = decltype(m_orphans);
 
-    struct IteratorComparator
-    {
-        template<typename I>
-        bool operator()(const I& a, const I& b) const
-        {
-            return &(*a) < &(*b);
-        }
+    struct IteratorHasher {
+        size_t operator()(const OrphanMap::iterator& it) const { return std::hash<const void*>{}(&*it); }
+    };
+
+    /** Index from the txid of each of their parents to the orphans. Used
+     *  to find the orphans an arriving transaction may resolve, and to
+     *  remove orphans that a block conflicts with */
+    std::unordered_map<uint256, std::unordered_set<OrphanMap::iterator, IteratorHasher>, SaltedTxidHasher> m_parent_to_children GUARDED_BY(g_cs_orphans);
+
+    struct PeerOrphans {
+        /** The peer's orphans, in a vector for quick random eviction */
+        std::vector<OrphanMap::iterator> orphans;
+        /** Memory usage of the peer's orphans */
+        size_t usage{0};
     };
 
-    /** Index from the parents' COutPoint into the m_orphans. Used
-     *  to remove orphan transactions from the m_orphans */
-    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> m_outpoint_to_orphan_it GUARDED_BY(g_cs_orphans);
+    /** Orphans by the peer that announced them */
+    std::map<NodeId, PeerOrphans> m_peer_orphans GUARDED_BY(g_cs_orphans);
 
-    /** Orphan transactions in vector for quick random eviction */
-    std::vector<OrphanMap::iterator> m_orphan_list GUARDED_BY(g_cs_orphans);
+    /** Memory usage of all orphans */
+    size_t m_total_usage GUARDED_BY(g_cs_orphans){0};
 
     /** Index from wtxid into the m_orphans to lookup orphan
      *  transactions using their witness ids. */
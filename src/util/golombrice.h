@@ -5,9 +5,13 @@
 #ifndef BITCOIN_UTIL_GOLOMBRICE_H
 #define BITCOIN_UTIL_GOLOMBRICE_H
 
+#include <crypto/common.h>
+#include <span.h>
 #include <streams.h>
 
 #include <cstdint>
+#include <ios>
+#include <vector>
 
 template <typename OStream>
 void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t P, uint64_t x)
@@ -40,4 +44,162 @@ uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t P)
     return (q << P) + r;
 }
 
+/**
+ * Golomb-Rice encoder appending to a byte vector. Bits are collected in a
+ * 64-bit word and written out a byte at a time, so each value costs a few
+ * shifts instead of a loop over its bits. The output is identical to that of
+ * GolombRiceEncode through a BitStreamWriter.
+ */
+class GolombRiceWriter
+{
+private:
+    std::vector<unsigned char>& m_out;
+    const uint8_t m_P;
+
+    //! Bits not yet written out, in the low m_bits bits
+    uint64_t m_buffer{0};
+    int m_bits{0};
+
+    //! Append the low nbits bits of data, for nbits <= 32.
+    void Write(uint64_t data, int nbits)
+    {
+        m_buffer = (m_buffer << nbits) | (data & ((uint64_t{1} << nbits) - 1));
+        m_bits += nbits;
+        while (m_bits >= 8) {
+            m_bits -= 8;
+            m_out.push_back(static_cast<unsigned char>(m_buffer >> m_bits));
+        }
+    }
+
+public:
+    GolombRiceWriter(std::vector<unsigned char>& out, uint8_t P) : m_out(out), m_P(P) {}
+
+    ~GolombRiceWriter()
+    {
+        Flush();
+    }
+
+    void Encode(uint64_t x)
+    {
+        // Write quotient as unary-encoded: q 1's followed by one 0.
+        uint64_t q = x >> m_P;
+        for (; q >= 32; q -= 32) {
+            Write(~0ULL, 32);
+        }
+        Write(((uint64_t{1} << q) - 1) << 1, static_cast<int>(q) + 1);
+
+        // Write the remainder in P bits.
+        if (m_P > 32) {
+            Write(x >> 32, m_P - 32);
+            Write(x, 32);
+        } else {
+            Write(x, m_P);
+        }
+    }
+
+    /** Write out the buffered bits, padding the last byte with zeros. */
+    void Flush()
+    {
+        if (m_bits > 0) {
+            m_out.push_back(static_cast<unsigned char>(m_buffer << (8 - m_bits)));
+            m_bits = 0;
+        }
+    }
+};
+
+/**
+ * Golomb-Rice decoder over a byte span. The stream is read into a 64-bit
+ * word up to eight bytes at a time, and a unary-encoded quotient is counted
+ * with a single leading-ones count rather than bit by bit. Decodes the output
+ * of GolombRiceEncode and GolombRiceWriter, and like GolombRiceDecode throws a
+ * std::ios_base::failure on reading past the end of the data.
+ */
+class GolombRiceReader
+{
+private:
+    const Span<const unsigned char> m_data;
+    const uint8_t m_P;
+    size_t m_pos{0};
+
+    //! Unread bits, in the high m_bits bits
+    uint64_t m_buffer{0};
+    int m_bits{0};
+
+    void Refill()
+    {
+        if (m_bits > 56) return;
+        if (m_pos + 8 <= m_data.size()) {
+            // Any bits past the whole bytes taken are the stream's next bits,
+            // so the next refill ORs the same bits over them.
+            const int bytes = (64 - m_bits) / 8;
+            m_buffer |= ReadBE64(m_data.data() + m_pos) >> m_bits;
+            m_pos += bytes;
+            m_bits += 8 * bytes;
+        } else {
+            for (; m_bits <= 56 && m_pos < m_data.size(); ++m_pos, m_bits += 8) {
+                m_buffer |= uint64_t{m_data[m_pos]} << (56 - m_bits);
+            }
+        }
+    }
+
+    void Skip(int nbits)
+    {
+        m_buffer = nbits < 64 ? m_buffer << nbits : 0;
+        m_bits -= nbits;
+    }
+
+    //! Read nbits bits, for nbits <= 32.
+    uint64_t Read(int nbits)
+    {
+        if (m_bits < nbits) {
+            Refill();
+            if (m_bits < nbits) {
+                throw std::ios_base::failure("GolombRiceReader::Read(): end of data");
+            }
+        }
+        if (nbits == 0) return 0;
+        const uint64_t ret = m_buffer >> (64 - nbits);
+        Skip(nbits);
+        return ret;
+    }
+
+public:
+    GolombRiceReader(Span<const unsigned char> data, uint8_t P) : m_data(data), m_P(P) {}
+
+    uint64_t Decode()
+    {
+        // Read unary-encoded quotient: q 1's followed by one 0.
+        uint64_t q = 0;
+        while (true) {
+            Refill();
+            if (m_bits == 0) {
+                throw std::ios_base::failure("GolombRiceReader::Decode(): end of data");
+            }
+            const int ones = 64 - CountBits(~m_buffer);
+            if (ones < m_bits) {
+                q += ones;
+                Skip(ones + 1);
+                break;
+            }
+            q += m_bits;
+            Skip(m_bits);
+        }
+
+        uint64_t r;
+        if (m_P > 32) {
+            r = Read(m_P - 32) << 32;
+            r |= Read(32);
+        } else {
+            r = Read(m_P);
+        }
+        return (q << m_P) + r;
+    }
+
+    /** Number of bytes no decoded bit has been read from. */
+    size_t BytesRemaining() const
+    {
+        return ((m_data.size() - m_pos) * 8 + m_bits) / 8;
+    }
+};
+
 #endif // BITCOIN_UTIL_GOLOMBRICE_H
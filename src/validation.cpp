@@ -14,6 +14,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/hmac_sha256.h>
 #include <cuckoocache.h>
 #include <deploymentstatus.h>
 #include <flatfile.h>
@@ -448,6 +449,10 @@ public:
          * any transaction spending the same inputs as a transaction in the mempool is considered
          * a conflict. */
         const bool m_allow_bip125_replacement{true};
+        /** Whether the transaction's scripts are already known to pass the standard script
+         * verification flags, so that the policy script checks needn't be run again. The consensus
+         * script checks are always run. */
+        const bool m_skip_policy_script_checks{false};
     };
 
     // Single transaction acceptance
@@ -1031,7 +1036,7 @@ MempoolAcceptResult MemPoolAccept::AcceptSingleTransaction(const CTransactionRef
     // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
     PrecomputedTransactionData txdata;
 
-    if (!PolicyScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
+    if (!args.m_skip_policy_script_checks && !PolicyScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
 
     if (!ConsensusScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
 
@@ -1117,12 +1122,13 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptMultipleTransactions(const std::
 static MempoolAcceptResult AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool,
                                                       CChainState& active_chainstate,
                                                       const CTransactionRef &tx, int64_t nAcceptTime,
-                                                      bool bypass_limits, bool test_accept)
+                                                      bool bypass_limits, bool test_accept,
+                                                      bool skip_policy_script_checks = false)
                                                       EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
     MemPoolAccept::ATMPArgs args { chainparams, nAcceptTime, bypass_limits, coins_to_uncache,
-                                   test_accept, /* m_allow_bip125_replacement */ true };
+                                   test_accept, /* m_allow_bip125_replacement */ true, skip_policy_script_checks };
 
     const MempoolAcceptResult result = MemPoolAccept(pool, active_chainstate).AcceptSingleTransaction(tx, args);
     if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
@@ -1186,7 +1192,8 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             gArgs.GetDataDirNet() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_writerview(m_dbview, gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH)),
+                        m_catcherview(&m_writerview) {}
 
 void CoinsViews::InitCache()
 {
@@ -1345,6 +1352,58 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+bool CCoinPrefetch::operator()() {
+    // A missing coin leaves *m_coin spent; the block will be rejected when
+    // ConnectBlock() looks it up again.
+    m_view->GetCoin(*m_outpoint, *m_coin);
+    return true;
+}
+
+size_t PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& view, CCheckQueue<CCoinPrefetch>* queue)
+{
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    block_txids.reserve(block.vtx.size());
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                // Outputs created in this block can't be in the database yet.
+                if (block_txids.count(txin.prevout.hash)) continue;
+                if (cache.HaveEntryInCache(txin.prevout)) continue;
+                outpoints.push_back(txin.prevout);
+            }
+        }
+        block_txids.insert(tx->GetHash());
+    }
+    if (outpoints.empty()) return 0;
+
+    // The closures point into outpoints and coins, neither of which may be
+    // resized until control has finished.
+    std::vector<Coin> coins(outpoints.size());
+    {
+        CCheckQueueControl<CCoinPrefetch> control(queue);
+        std::vector<CCoinPrefetch> prefetches;
+        prefetches.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); ++i) {
+            prefetches.emplace_back(view, outpoints[i], coins[i]);
+        }
+        if (queue != nullptr) {
+            control.Add(prefetches);
+        } else {
+            for (CCoinPrefetch& prefetch : prefetches) prefetch();
+        }
+        control.Wait();
+    }
+
+    size_t fetched = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (coins[i].IsSpent()) continue;
+        cache.InsertFetchedCoin(outpoints[i], std::move(coins[i]));
+        ++fetched;
+    }
+    return fetched;
+}
+
 int BlockManager::GetSpendHeight(const CCoinsViewCache& inputs)
 {
     AssertLockHeld(cs_main);
@@ -1580,15 +1639,88 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 }
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/** Database lookups are much slower than script checks, so hand them out in small batches. */
+static CCheckQueue<CCoinPrefetch> coinprefetchqueue(16);
+/** Prechecks of transactions about to be submitted to the mempool get their own queue, so that
+ * a large batch doesn't hold up ConnectBlock's script checks. */
+static CCheckQueue<CScriptCheck> precheckqueue(128);
 
 void StartScriptCheckWorkerThreads(int threads_num)
 {
     scriptcheckqueue.StartWorkerThreads(threads_num);
+    coinprefetchqueue.StartWorkerThreads(threads_num, "coinfetch");
+    precheckqueue.StartWorkerThreads(threads_num, "precheck");
 }
 
 void StopScriptCheckWorkerThreads()
 {
     scriptcheckqueue.StopWorkerThreads();
+    coinprefetchqueue.StopWorkerThreads();
+    precheckqueue.StopWorkerThreads();
+}
+
+bool PrecheckTransactionScripts(const std::vector<CTransactionRef>& txns, std::vector<std::vector<CTxOut>>& spent_outputs)
+{
+    assert(txns.size() == spent_outputs.size());
+
+    // The checks refer to txsdata, which must outlive control.
+    std::vector<PrecomputedTransactionData> txsdata(txns.size());
+    CCheckQueueControl<CScriptCheck> control(g_parallel_script_checks ? &precheckqueue : nullptr);
+    std::vector<CScriptCheck> checks;
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const CTransaction& tx = *txns[i];
+        if (spent_outputs[i].size() != tx.vin.size()) continue;
+        txsdata[i].Init(tx, std::move(spent_outputs[i]));
+        for (unsigned int j = 0; j < tx.vin.size(); ++j) {
+            // Store valid signatures for the checks made on submission.
+            checks.emplace_back(txsdata[i].m_spent_outputs[j], tx, j, STANDARD_SCRIPT_VERIFY_FLAGS, /* cacheIn */ true, &txsdata[i]);
+        }
+    }
+
+    if (!g_parallel_script_checks) {
+        bool all_valid = true;
+        for (CScriptCheck& check : checks) {
+            all_valid = check() && all_valid;
+        }
+        return all_valid;
+    }
+    control.Add(checks);
+    return control.Wait();
+}
+
+void LookupSpentOutputs(CChainState& active_chainstate, const CTxMemPool& pool, const std::vector<CTransactionRef>& txns,
+                        std::vector<std::vector<CTxOut>>& spent_outputs, std::vector<std::vector<COutPoint>>* coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+    assert(txns.size() == spent_outputs.size());
+    assert(!coins_to_uncache || coins_to_uncache->size() == txns.size());
+
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> batch_txids;
+    for (size_t i = 0; i < txns.size(); ++i) {
+        batch_txids.emplace(txns[i]->GetHash(), i);
+    }
+    CCoinsViewCache& coins_tip = active_chainstate.CoinsTip();
+    CCoinsViewMemPool view_mempool(&coins_tip, pool);
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const CTransaction& tx = *txns[i];
+        TxValidationState state;
+        if (!CheckTransaction(tx, state) || tx.IsCoinBase()) continue;
+        std::vector<CTxOut>& outputs = spent_outputs[i];
+        for (const CTxIn& txin : tx.vin) {
+            const auto it = batch_txids.find(txin.prevout.hash);
+            if (it != batch_txids.end()) {
+                if (txin.prevout.n >= txns[it->second]->vout.size()) break;
+                outputs.push_back(txns[it->second]->vout[txin.prevout.n]);
+                continue;
+            }
+            if (coins_to_uncache && !coins_tip.HaveCoinInCache(txin.prevout)) (*coins_to_uncache)[i].push_back(txin.prevout);
+            Coin coin;
+            if (!view_mempool.GetCoin(txin.prevout, coin)) break;
+            outputs.push_back(coin.out);
+        }
+        if (outputs.size() != tx.vin.size()) outputs.clear();
+    }
 }
 
 /**
@@ -1858,6 +1990,16 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
+    // Read the inputs that are not cached yet from the database on the
+    // prefetch workers, so that cache misses are served concurrently instead
+    // of one at a time by the serial loop below. Only the chainstate's own
+    // cache can be warmed this way, as its backing view is the one that is
+    // safe for concurrent reads.
+    if (g_parallel_script_checks) {
+        const size_t fetched = PrefetchBlockInputs(block, CoinsTip(), CoinsErrorCatcher(), &coinprefetchqueue);
+        LogPrint(BCLog::BENCH, "    - Prefetched %u inputs: %.2fms\n", (unsigned)fetched, MILLI * (GetTimeMicros() - nTime2));
+    }
+
     CBlockUndo blockundo;
 
     // Precomputed transaction data pointers must not be invalidated
@@ -2122,6 +2264,12 @@ bool CChainState::FlushStateToDisk(
             }
             // Finally remove any pruned files
             if (fFlushForPrune) {
+                // A coins flush still being written in the background may
+                // need the blocks in these files to be replayed after a crash.
+                if (!WaitForCoinsFlush()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
+
                 LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files", BCLog::BENCH);
 
                 UnlinkPrunedFiles(setFilesToPrune);
@@ -2144,6 +2292,12 @@ bool CChainState::FlushStateToDisk(
             // Flush the chainstate (which may refer to block index entries).
             if (!CoinsTip().Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // With -backgroundflush the coins are now being written by a
+            // separate thread. Explicit flushes and pruning need them to
+            // actually be on disk before returning.
+            if ((mode == FlushStateMode::ALWAYS || fFlushForPrune) && !WaitForCoinsFlush()) {
+                return AbortNode(state, "Failed to write to coin database");
+            }
             nLastFlush = nNow;
             full_flush_completed = true;
         }
@@ -4463,6 +4617,10 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // The database is reopened, which can't happen while it is being written to.
+    if (!WaitForCoinsFlush()) {
+        return false;
+    }
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -4484,7 +4642,54 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     return ret;
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHECKPOINT = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** Number of mempool.dat entries that are authenticated, checked and accepted together */
+static const uint64_t MEMPOOL_DUMP_BATCH_SIZE = 1000;
+
+/**
+ * Get the node's key for authenticating the checkpoints in mempool.dat,
+ * creating it if asked to. The key stays in the datadir, so a mempool.dat
+ * from elsewhere or one that was edited doesn't authenticate.
+ */
+static std::optional<uint256> GetMempoolKey(FopenFn mockable_fopen_function, bool create)
+{
+    const fs::path path{gArgs.GetDataDirNet() / "mempool.key"};
+    try {
+        CAutoFile file(mockable_fopen_function(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (!file.IsNull()) {
+            uint256 key;
+            file >> key;
+            return key;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to read mempool key: %s\n", e.what());
+    }
+    if (!create) return std::nullopt;
+
+    uint256 key;
+    GetStrongRandBytes(key.begin(), key.size());
+    try {
+        CAutoFile file(mockable_fopen_function(path, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) return std::nullopt;
+        file << key;
+        if (!FileCommit(file.Get())) return std::nullopt;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write mempool key: %s\n", e.what());
+        return std::nullopt;
+    }
+    return key;
+}
+
+/** MAC of a batch of mempool.dat entries, given their hash, in the file with the given salt and checkpoint */
+static uint256 MempoolBatchMac(const uint256& key, const uint256& salt, const uint256& tip_hash, uint32_t script_flags, uint64_t batch_index, const uint256& batch_hash)
+{
+    CDataStream data(SER_DISK, CLIENT_VERSION);
+    data << salt << tip_hash << script_flags << batch_index << batch_hash;
+    uint256 mac;
+    CHMAC_SHA256(key.begin(), key.size()).Write(reinterpret_cast<const unsigned char*>(data.data()), data.size()).Finalize(mac.begin());
+    return mac;
+}
 
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function)
 {
@@ -4502,34 +4707,108 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
     int64_t failed = 0;
     int64_t already_there = 0;
     int64_t unbroadcast = 0;
+    int64_t skipped_checks = 0;
     int64_t nNow = GetTime();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        // The transactions' scripts were valid under the recorded flags at the
+        // recorded tip, so the policy script checks needn't be run again if
+        // neither changed, for the batches that authenticate with this node's
+        // key. The consensus script checks are always run.
+        bool checkpoint_valid = false;
+        std::optional<uint256> key;
+        uint256 salt;
+        uint256 tip_hash;
+        uint32_t script_flags{0};
+        if (version == MEMPOOL_DUMP_VERSION) {
+            file >> salt;
+            file >> tip_hash;
+            file >> script_flags;
+            key = GetMempoolKey(mockable_fopen_function, /* create */ false);
+            if (!key) LogPrintf("No key to authenticate the mempool file, checking the scripts of all transactions\n");
+            checkpoint_valid = key && script_flags == STANDARD_SCRIPT_VERIFY_FLAGS &&
+                               WITH_LOCK(cs_main, return active_chainstate.m_chain.Tip() && active_chainstate.m_chain.Tip()->GetBlockHash() == tip_hash);
+        } else if (version != MEMPOOL_DUMP_VERSION_NO_CHECKPOINT) {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        while (num--) {
+
+        std::vector<CTransactionRef> txns;
+        std::vector<int64_t> times;
+        auto read_entry = [&](auto& stream) {
             CTransactionRef tx;
             int64_t nTime;
             int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
+            stream >> tx;
+            stream >> nTime;
+            stream >> nFeeDelta;
 
             CAmount amountdelta = nFeeDelta;
             if (amountdelta) {
                 pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
             if (nTime > nNow - nExpiryTimeout) {
+                txns.push_back(std::move(tx));
+                times.push_back(nTime);
+            } else {
+                ++expired;
+            }
+        };
+
+        uint64_t num;
+        file >> num;
+        for (uint64_t batch_index = 0; num; ++batch_index) {
+            const uint64_t batch_size = std::min(num, MEMPOOL_DUMP_BATCH_SIZE);
+            num -= batch_size;
+            txns.clear();
+            times.clear();
+
+            bool skip_policy_script_checks = false;
+            if (version == MEMPOOL_DUMP_VERSION) {
+                CHashVerifier<CAutoFile> verifier(&file);
+                for (uint64_t i = 0; i < batch_size; ++i) {
+                    read_entry(verifier);
+                }
+                uint256 mac;
+                file >> mac;
+                if (checkpoint_valid) {
+                    skip_policy_script_checks = mac == MempoolBatchMac(*key, salt, tip_hash, script_flags, batch_index, verifier.GetHash());
+                    if (!skip_policy_script_checks) {
+                        LogPrintf("Mempool file failed authentication, checking the scripts of the affected transactions\n");
+                    }
+                }
+            } else {
+                for (uint64_t i = 0; i < batch_size; ++i) {
+                    read_entry(file);
+                }
+            }
+
+            // Otherwise check the batch's scripts in parallel, leaving the
+            // signatures in the cache for the checks on acceptance.
+            std::vector<std::vector<COutPoint>> coins_to_uncache(txns.size());
+            if (!skip_policy_script_checks) {
+                std::vector<std::vector<CTxOut>> spent_outputs(txns.size());
+                {
+                    LOCK2(cs_main, pool.cs);
+                    LookupSpentOutputs(active_chainstate, pool, txns, spent_outputs, &coins_to_uncache);
+                }
+                PrecheckTransactionScripts(txns, spent_outputs);
+            }
+
+            {
                 LOCK(cs_main);
-                if (AcceptToMemoryPoolWithTime(chainparams, pool, active_chainstate, tx, nTime, false /* bypass_limits */,
-                                               false /* test_accept */).m_result_type == MempoolAcceptResult::ResultType::VALID) {
-                    ++count;
-                } else {
+                for (size_t i = 0; i < txns.size(); ++i) {
+                    const CTransactionRef& tx = txns[i];
+                    if (AcceptToMemoryPoolWithTime(chainparams, pool, active_chainstate, tx, times[i], false /* bypass_limits */,
+                                                   false /* test_accept */, skip_policy_script_checks).m_result_type == MempoolAcceptResult::ResultType::VALID) {
+                        ++count;
+                        if (skip_policy_script_checks) ++skipped_checks;
+                        continue;
+                    }
+                    for (const COutPoint& outpoint : coins_to_uncache[i]) {
+                        active_chainstate.CoinsTip().Uncache(outpoint);
+                    }
                     // mempool may contain the transaction already, e.g. from
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
@@ -4540,8 +4819,6 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
@@ -4566,28 +4843,32 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i waiting for initial broadcast\n", count, failed, expired, already_there, unbroadcast);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i without policy script checks), %i failed, %i expired, %i already there, %i waiting for initial broadcast\n", count, skipped_checks, failed, expired, already_there, unbroadcast);
     return true;
 }
 
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool skip_file_commit)
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function, bool skip_file_commit)
 {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
     std::set<uint256> unbroadcast_txids;
+    uint256 tip_hash;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        // Take the tip together with the mempool snapshot, as the
+        // transactions' scripts were checked against it.
+        LOCK2(cs_main, pool.cs);
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
         vinfo = pool.infoAll();
         unbroadcast_txids = pool.GetUnbroadcastTxs();
+        if (active_chainstate.m_chain.Tip()) tip_hash = active_chainstate.m_chain.Tip()->GetBlockHash();
     }
 
     int64_t mid = GetTimeMicros();
@@ -4600,15 +4881,40 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
+        std::optional<uint256> key;
+        if (!gArgs.GetBoolArg("-persistmempoolv1", DEFAULT_PERSIST_V1_DAT)) {
+            key = GetMempoolKey(mockable_fopen_function, /* create */ true);
+            if (!key) LogPrintf("Failed to get the mempool key, writing the mempool without a checkpoint\n");
+        }
+        const bool use_checkpoint{key.has_value()};
+        uint64_t version = use_checkpoint ? MEMPOOL_DUMP_VERSION : MEMPOOL_DUMP_VERSION_NO_CHECKPOINT;
         file << version;
+        // A fresh salt ties each batch's MAC to this file.
+        const uint256 salt{GetRandHash()};
+        const uint32_t script_flags{STANDARD_SCRIPT_VERIFY_FLAGS};
+        if (use_checkpoint) {
+            file << salt;
+            file << tip_hash;
+            file << script_flags;
+        }
 
+        // infoAll() sorts parents before children, so that the transactions
+        // can be accepted back in the order they were written.
         file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
+        CDataStream batch(SER_DISK, CLIENT_VERSION);
+        uint64_t batch_index = 0;
+        for (size_t n = 0; n < vinfo.size(); ++n) {
+            const TxMempoolInfo& i = vinfo[n];
+            batch << *(i.tx);
+            batch << int64_t{count_seconds(i.m_time)};
+            batch << int64_t{i.nFeeDelta};
             mapDeltas.erase(i.tx->GetHash());
+            if ((n + 1) % MEMPOOL_DUMP_BATCH_SIZE == 0 || n + 1 == vinfo.size()) {
+                file.write(CharCast(batch.data()), batch.size());
+                if (use_checkpoint) file << MempoolBatchMac(*key, salt, tip_hash, script_flags, batch_index, Hash(batch));
+                ++batch_index;
+                batch.clear();
+            }
         }
 
         file << mapDeltas;
@@ -4919,6 +5225,11 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
     LogPrintf("[snapshot] flushing snapshot chainstate to disk\n");
     // No need to acquire cs_main since this chainstate isn't being used yet.
     coins_cache.Flush(); // TODO: if #17487 is merged, add erase=false here for better performance.
+    // The coins database is read directly below.
+    if (!WITH_LOCK(::cs_main, return snapshot_chainstate.WaitForCoinsFlush())) {
+        LogPrintf("[snapshot] failed to write coins to disk\n");
+        return false;
+    }
 
     assert(coins_cache.GetBestBlock() == base_blockhash);
 
@@ -51,6 +51,8 @@ class CInv;
 class CConnman;
 class CScriptCheck;
 class CTxMemPool;
+template <typename T>
+class CCheckQueue;
 class ChainstateManager;
 struct ChainTxData;
 
@@ -79,9 +81,13 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static constexpr bool DEFAULT_COINSTATSINDEX{false};
+static constexpr bool DEFAULT_SCRIPTINDEX{false};
+static constexpr bool DEFAULT_SPENTINDEX{false};
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempoolv1 */
+static const bool DEFAULT_PERSIST_V1_DAT = false;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
@@ -141,6 +147,34 @@ void StartScriptCheckWorkerThreads(int threads_num);
 /** Stop all of the script checking worker threads */
 void StopScriptCheckWorkerThreads();
 
+/**
+ * Check the scripts of transactions about to be submitted to the mempool on
+ * their own script checking worker threads, against standard script verification
+ * flags, so that their signatures are in the signature cache when the
+ * transactions are validated one by one.
+ *
+ * @param[in]  txns           The transactions to check
+ * @param[in]  spent_outputs  For each transaction, the outputs spent by its inputs, or an
+ *                            empty vector to skip it. Moved from.
+ * @returns whether all scripts checked were valid. With worker threads, checks may be skipped
+ *          after the first invalid one.
+ */
+bool PrecheckTransactionScripts(const std::vector<CTransactionRef>& txns, std::vector<std::vector<CTxOut>>& spent_outputs);
+
+/**
+ * Look up the outputs spent by a batch of transactions, from the UTXO set, the mempool or
+ * earlier transactions in the batch, for use with PrecheckTransactionScripts().
+ *
+ * @param[in]  txns              The transactions, parents before children
+ * @param[out] spent_outputs     For each transaction, the outputs spent by its inputs, or an
+ *                               empty vector if it's invalid or some inputs are missing
+ * @param[out] coins_to_uncache  If not nullptr, for each transaction, the coins that were
+ *                               added to the coins cache by the lookup
+ */
+void LookupSpentOutputs(CChainState& active_chainstate, const CTxMemPool& pool, const std::vector<CTransactionRef>& txns,
+                        std::vector<std::vector<CTxOut>>& spent_outputs, std::vector<std::vector<COutPoint>>* coins_to_uncache)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs);
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
 bool AbortNode(BlockValidationState& state, const std::string& strMessage, const bilingual_str& userMessage = bilingual_str{});
@@ -317,6 +351,44 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing one lookup of a spent coin in the coins database.
+ * Used to fetch the inputs of a block from disk in parallel before
+ * ConnectBlock() walks them serially.
+ */
+class CCoinPrefetch
+{
+private:
+    const CCoinsView* m_view{nullptr};
+    const COutPoint* m_outpoint{nullptr};
+    Coin* m_coin{nullptr};
+
+public:
+    CCoinPrefetch() = default;
+    CCoinPrefetch(const CCoinsView& view, const COutPoint& outpoint, Coin& coin) :
+        m_view(&view), m_outpoint(&outpoint), m_coin(&coin) { }
+
+    bool operator()();
+
+    void swap(CCoinPrefetch& prefetch) {
+        std::swap(m_view, prefetch.m_view);
+        std::swap(m_outpoint, prefetch.m_outpoint);
+        std::swap(m_coin, prefetch.m_coin);
+    }
+};
+
+/**
+ * Load the coins spent by a block into a cache before connecting it.
+ *
+ * Outpoints created by transactions of the same block, and outpoints the
+ * cache already has an entry for, are skipped. The remaining ones are read
+ * from view (which must be the view directly backing cache, and safe for
+ * concurrent reads), spread over the workers of queue if non-null.
+ *
+ * @returns the number of coins that were added to cache.
+ */
+size_t PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& view, CCheckQueue<CCoinPrefetch>* queue);
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -506,9 +578,15 @@ class CoinsViews {
 
 public:
     //! The lowest level of the CoinsViews cache hierarchy sits in a leveldb database on disk.
-    //! All unspent coins reside in this store.
+    //! All unspent coins reside in this store. With -backgroundflush, m_writerview's
+    //! thread also writes to it without cs_main; see WaitForCoinsFlush().
     CCoinsViewDB m_dbview GUARDED_BY(cs_main);
 
+    //! This view writes flushes to the leveldb instance, on a background thread if
+    //! -backgroundflush is set. Not guarded by cs_main: that thread uses it too, and
+    //! it synchronizes internally.
+    CCoinsViewBackgroundWriter m_writerview;
+
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
@@ -522,6 +600,7 @@ public:
     //! state to disk, which should not be done until the health of the database is verified.
     //!
     //! All arguments forwarded onto CCoinsViewDB.
+    //! Starts the background flush thread if -backgroundflush is set.
     CoinsViews(std::string ldb_name, size_t cache_size_bytes, bool in_memory, bool should_wipe);
 
     //! Initialize the CCoinsViewCache member.
@@ -659,6 +738,17 @@ public:
         return m_coins_views->m_catcherview;
     }
 
+    /**
+     * Wait until a coins flush that is being written in the background (see
+     * -backgroundflush) has reached the database.
+     *
+     * @returns false if writing it failed.
+     */
+    bool WaitForCoinsFlush() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        return m_coins_views->m_writerview.Sync();
+    }
+
     //! Destructs all objects related to accessing the UTXO set.
     void ResetCoinsViews() { m_coins_views.reset(); }
 
@@ -1040,8 +1130,12 @@ public:
 
 using FopenFn = std::function<FILE*(const fs::path&, const char*)>;
 
-/** Dump the mempool to disk. */
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
+/**
+ * Dump the mempool to disk, parents before children. The file records the chain tip and the
+ * script verification flags the transactions were accepted under, so that LoadMempool() can
+ * skip their script checks if neither changed.
+ */
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
 
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen);
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test recovery from a crash during a background chainstate write.
+
+- 2 nodes, not connected to each other
+  * node0 runs with -backgroundflush and a -dbcrashratio, so that it
+    crashes in the middle of coins flushes written by the background thread.
+  * node1 is a regular node that mines the chain, including transactions
+    that create and spend coins.
+
+- node0 is made to flush on (almost) every block by moving its mocktime past
+  the periodic flush interval before each block is submitted.
+
+- Whenever node0 crashes, it is restarted until recovery succeeds and the
+  missing blocks are submitted again.
+
+- Finally node0 is restarted without crashes, and its UTXO set hash must match
+  node1's."""
+
+import errno
+import http.client
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+# Matches DATABASE_FLUSH_INTERVAL in validation.cpp, plus some margin.
+FLUSH_INTERVAL = 24 * 60 * 60 + 60
+
+
+class BackgroundFlushCrashTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.rpc_timeout = 480
+        self.supports_cli = False
+        # Write each coin in its own partial batch, so that every coin has a
+        # chance to trigger a simulated crash.
+        self.crash_args = ["-backgroundflush", "-dbbatchsize=1", "-dbcrashratio=24"]
+        self.extra_args = [self.crash_args, []]
+
+    def setup_network(self):
+        self.add_nodes(self.num_nodes, extra_args=self.extra_args)
+        self.start_nodes()
+        # Leave them unconnected, we'll use submitblock directly in this test
+
+    def restart_node0(self, extra_args=None):
+        """Start node0 until it comes up and reports its tip.
+
+        Exceptions on startup indicate a crash (due to -dbcrashratio) while
+        replaying blocks, in which case we try again."""
+        time_start = time.time()
+        while time.time() - time_start < 120:
+            try:
+                self.start_node(0, extra_args=extra_args)
+                self.nodes[0].getbestblockhash()
+                self.mocktime = int(time.time())
+                return
+            except Exception:
+                self.wait_for_node_exit(0, timeout=10)
+            self.crashed_on_restart += 1
+            time.sleep(1)
+        raise AssertionError("Unable to successfully restart node0 in allotted time")
+
+    def submit_blocks_to_node0(self):
+        """Submit all blocks node0 is missing, with a flush due for each of them.
+
+        If node0 crashes, restart it and continue from its recovered tip."""
+        while True:
+            try:
+                height = self.nodes[0].getblockcount()
+                if self.nodes[0].getbestblockhash() == self.nodes[1].getbestblockhash():
+                    return
+                for h in range(height + 1, self.nodes[1].getblockcount() + 1):
+                    self.mocktime += FLUSH_INTERVAL
+                    self.nodes[0].setmocktime(self.mocktime)
+                    self.nodes[0].submitblock(self.nodes[1].getblock(self.nodes[1].getblockhash(h), 0))
+            except (http.client.CannotSendRequest, http.client.RemoteDisconnected) as e:
+                self.log.debug("node0 raised exception: %s", e)
+            except OSError as e:
+                self.log.debug("node0 raised OSError exception: errno=%s", e.errno)
+                if e.errno not in [errno.EPIPE, errno.ECONNREFUSED, errno.ECONNRESET]:
+                    raise
+            else:
+                continue
+            # The node has crashed, most likely in the background flush thread.
+            self.wait_for_node_exit(0, timeout=30)
+            self.crashes += 1
+            self.restart_node0()
+
+    def run_test(self):
+        self.crashes = 0
+        self.crashed_on_restart = 0
+        self.mocktime = int(time.time())
+
+        wallet = MiniWallet(self.nodes[1])
+        # the pre-mined test framework chain contains coinbase outputs to the
+        # MiniWallet's default address in blocks 76-100
+        wallet.scan_blocks(start=76, num=25)
+
+        self.log.info("Mine blocks creating and spending coins, with node0 flushing in the background")
+        for _ in range(40):
+            for _ in range(5):
+                wallet.send_self_transfer(from_node=self.nodes[1])
+            wallet.generate(1)
+            self.submit_blocks_to_node0()
+
+        self.log.info("Crashed %d times during background flushes, %d times on restart", self.crashes, self.crashed_on_restart)
+
+        self.log.info("Restart node0 without crashes and check its UTXO set")
+        try:
+            self.stop_node(0)
+        except Exception:
+            self.wait_for_node_exit(0, timeout=30)
+        self.restart_node0(extra_args=["-backgroundflush"])
+        with self.nodes[0].assert_debug_log(["write coins to disk in the background"]):
+            for _ in range(3):
+                wallet.send_self_transfer(from_node=self.nodes[1])
+                wallet.generate(1)
+                self.submit_blocks_to_node0()
+        assert_equal(self.nodes[0].getbestblockhash(), self.nodes[1].getbestblockhash())
+        assert_equal(self.nodes[0].gettxoutsetinfo()['hash_serialized_2'], self.nodes[1].gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == "__main__":
+    BackgroundFlushCrashTest().main()
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test scriptindex and the getscripthistory RPC and REST endpoint.
+
+Test that the history of a scriptPubKey follows the active chain through
+spends, reorgs and restarts, and that range queries page through it.
+"""
+
+import http.client
+import json
+import urllib.parse
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+from test_framework.wallet import MiniWallet
+
+
+class ScriptIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-scriptindex", "-rest"],
+            [],
+        ]
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.wallet = MiniWallet(node)
+        self.script = node.validateaddress(ADDRESS_BCRT1_P2WSH_OP_TRUE)['scriptPubKey']
+
+        self._test_history()
+        self._test_range_queries()
+        self._test_restart()
+        self._test_reorg()
+        self._test_rest()
+        self._test_errors()
+
+    def _test_history(self):
+        node = self.nodes[0]
+        self.log.info("Test that coinbase outputs are listed in height order")
+        blocks = self.wallet.generate(101)
+        history = node.getscripthistory(self.script)
+        assert_equal(len(history), 101)
+        for height, entry in enumerate(history, start=1):
+            coinbase = node.getblock(blocks[height - 1])['tx'][0]
+            assert_equal(entry['height'], height)
+            assert_equal(entry['txid'], coinbase)
+            assert_equal(entry['vout'], 0)
+            assert_equal(entry['amount'], Decimal('50'))
+            assert 'spent' not in entry
+
+        self.log.info("Test that a spend is recorded on the spent output")
+        utxo = self.wallet.get_utxo(txid=history[0]['txid'])
+        self.spend = self.wallet.send_self_transfer(from_node=node, utxo_to_spend=utxo)
+        self.wallet.generate(1)
+        spent_input = self.spend['tx'].vin[0].prevout
+        history = node.getscripthistory(self.script)
+        assert_equal(len(history), 103)
+        spent = [entry for entry in history if 'spent' in entry]
+        assert_equal(len(spent), 1)
+        assert_equal(int(spent[0]['txid'], 16), spent_input.hash)
+        assert_equal(spent[0]['vout'], spent_input.n)
+        assert_equal(spent[0]['spent'], {'txid': self.spend['txid'], 'vin': 0, 'height': 102})
+        assert self.spend['txid'] in [entry['txid'] for entry in history if entry['height'] == 102]
+
+    def _test_range_queries(self):
+        node = self.nodes[0]
+        self.log.info("Test from_height, count, after and unspent_only")
+        history = node.getscripthistory(self.script)
+        assert_equal(node.getscripthistory(self.script, 0, 10, history[4]), history[5:15])
+        assert_equal(node.getscripthistory(self.script, 100), [entry for entry in history if entry['height'] >= 100])
+        assert_equal(node.getscripthistory(self.script, 100, 1000, history[4]), [entry for entry in history if entry['height'] >= 100])
+        assert_equal(node.getscripthistory(self.script, 0, 0), [])
+        assert_equal(node.getscripthistory(self.script, 0, 1000, history[-1]), [])
+
+        # Pages of two split the two outputs at height 102.
+        pages = [node.getscripthistory(self.script, 0, 2)]
+        while pages[-1]:
+            pages.append(node.getscripthistory(self.script, 0, 2, pages[-1][-1]))
+        assert_equal(sum(pages, []), history)
+        assert_equal(node.getscripthistory(scriptpubkey=self.script, unspent_only=True), [entry for entry in history if 'spent' not in entry])
+        assert_equal(node.getscripthistory("51"), [])
+
+    def _test_reorg(self):
+        node = self.nodes[0]
+        self.log.info("Test that a reorg rewinds the history")
+        history_before = node.getscripthistory(self.script)
+        tip = node.getbestblockhash()
+        node.invalidateblock(tip)
+        assert self.spend['txid'] in node.getrawmempool()
+        node.generateblock(output=ADDRESS_BCRT1_P2WSH_OP_TRUE, transactions=[])
+        history = node.getscripthistory(self.script)
+        assert_equal(len(history), 102)
+        assert all('spent' not in entry for entry in history)
+        assert_equal(history[:101], [{k: v for k, v in entry.items() if k != 'spent'} for entry in history_before[:101]])
+
+        node.reconsiderblock(tip)
+        assert_equal(node.getbestblockhash(), tip)
+        assert_equal(node.getscripthistory(self.script), history_before)
+
+    def _test_restart(self):
+        node = self.nodes[0]
+        self.log.info("Test that the index survives a restart")
+        history = node.getscripthistory(self.script)
+        self.restart_node(0, extra_args=self.extra_args[0])
+        assert_equal(self.nodes[0].getscripthistory(self.script), history)
+
+    def _test_rest(self):
+        node = self.nodes[0]
+        self.log.info("Test the REST endpoint")
+        url = urllib.parse.urlparse(node.url)
+
+        def rest_request(uri, status=200):
+            conn = http.client.HTTPConnection(url.hostname, url.port)
+            conn.request('GET', '/rest/scripthistory/' + uri)
+            resp = conn.getresponse()
+            assert_equal(resp.status, status)
+            return resp.read().decode('utf-8')
+
+        history = json.loads(rest_request(f"5/{self.script}.json"), parse_float=Decimal)
+        assert_equal(history, node.getscripthistory(self.script, 0, 5))
+        last = history[-1]
+        history = json.loads(rest_request(f"5/{self.script}/{last['height']}/{last['txid']}-{last['vout']}.json"), parse_float=Decimal)
+        assert_equal(history, node.getscripthistory(self.script, 0, 5, last))
+        rest_request(f"0/{self.script}.json", status=400)
+        rest_request(f"1001/{self.script}.json", status=400)
+        rest_request(f"5/{self.script}/-1/{last['txid']}-0.json", status=400)
+        rest_request(f"5/{self.script}/5/{last['txid']}.json", status=400)
+        rest_request(f"5/{self.script}/5/zz-0.json", status=400)
+        rest_request(f"5/{self.script}/5.json", status=400)
+        rest_request("5/zz.json", status=400)
+        rest_request(f"5/{self.script}.bin", status=404)
+
+    def _test_errors(self):
+        self.log.info("Test RPC errors")
+        assert_raises_rpc_error(-8, "Negative from_height", self.nodes[0].getscripthistory, self.script, -1)
+        assert_raises_rpc_error(-8, "Negative count", self.nodes[0].getscripthistory, self.script, 0, -1)
+        assert_raises_rpc_error(-8, "count must be at most 1000", self.nodes[0].getscripthistory, self.script, 0, 1001)
+        assert_raises_rpc_error(-3, "Missing height", self.nodes[0].getscripthistory, self.script, 0, 10, {"txid": "00" * 32, "vout": 0})
+        assert_raises_rpc_error(-8, "vout cannot be negative", self.nodes[0].getscripthistory, self.script, 0, 10, {"height": 1, "txid": "00" * 32, "vout": -1})
+        assert_raises_rpc_error(-8, "scriptpubkey must be hexadecimal string", self.nodes[0].getscripthistory, "zz")
+        assert_raises_rpc_error(-1, "Script index is not enabled", self.nodes[1].getscripthistory, self.script)
+
+
+if __name__ == '__main__':
+    ScriptIndexTest().main()
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test spentindex, the getspentinfo RPC and fees in getrawtransaction.
+
+Test that the spender of an output follows the active chain through reorgs
+and restarts, and that the fee of a confirmed transaction is reported.
+"""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+from test_framework.wallet import MiniWallet
+
+
+class SpentIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-spentindex", "-txindex"],
+            ["-txindex"],
+        ]
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.wallet = MiniWallet(node)
+        self.wallet.generate(101)
+        self.sync_blocks()
+
+        self._test_spent_info()
+        self._test_fee()
+        self._test_restart()
+        self._test_reorg()
+        self._test_errors()
+
+    def _test_spent_info(self):
+        node = self.nodes[0]
+        self.log.info("Test that getspentinfo returns the spending input")
+        self.coinbase = node.getblock(node.getblockhash(1))['tx'][0]
+        utxo = self.wallet.get_utxo(txid=self.coinbase)
+        self.spend = self.wallet.send_self_transfer(from_node=node, utxo_to_spend=utxo)
+        self.wallet.generate(1)
+        self.sync_blocks()
+        assert_equal(node.getspentinfo(self.coinbase, 0), {
+            'txid': self.spend['txid'],
+            'vin': 0,
+            'height': 102,
+            'value': Decimal('50'),
+        })
+        assert_raises_rpc_error(-5, "Output is not spent in the active chain", node.getspentinfo, self.spend['txid'], 0)
+
+    def _test_fee(self):
+        self.log.info("Test that getrawtransaction reports the fee of confirmed transactions")
+        tx = self.nodes[0].getrawtransaction(self.spend['txid'], True)
+        assert_equal(tx['fee'], Decimal('50') - tx['vout'][0]['value'])
+        assert 'fee' not in self.nodes[0].getrawtransaction(self.coinbase, True)
+        assert 'fee' not in self.nodes[1].getrawtransaction(self.spend['txid'], True)
+
+        utxo = self.wallet.get_utxo(txid=self.nodes[0].getblock(self.nodes[0].getblockhash(2))['tx'][0])
+        mempool_tx = self.wallet.send_self_transfer(from_node=self.nodes[0], utxo_to_spend=utxo)
+        assert 'fee' not in self.nodes[0].getrawtransaction(mempool_tx['txid'], True)
+        self.wallet.generate(1)
+        self.sync_blocks()
+        assert 'fee' in self.nodes[0].getrawtransaction(mempool_tx['txid'], True)
+
+    def _test_restart(self):
+        self.log.info("Test that the index survives a restart")
+        spent_info = self.nodes[0].getspentinfo(self.coinbase, 0)
+        self.restart_node(0, extra_args=self.extra_args[0])
+        assert_equal(self.nodes[0].getspentinfo(self.coinbase, 0), spent_info)
+
+    def _test_reorg(self):
+        node = self.nodes[0]
+        self.log.info("Test that a reorg erases the spends of disconnected blocks")
+        block = node.getblock(node.getblockhash(102))
+        node.invalidateblock(block['hash'])
+        node.generateblock(output=ADDRESS_BCRT1_P2WSH_OP_TRUE, transactions=[])
+        assert_raises_rpc_error(-5, "Output is not spent in the active chain", node.getspentinfo, self.coinbase, 0)
+
+        self.log.info("Test that the spend is indexed again once it is mined on the new chain")
+        node.reconsiderblock(block['hash'])
+        node.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        assert_equal(node.getspentinfo(self.coinbase, 0)['txid'], self.spend['txid'])
+
+    def _test_errors(self):
+        self.log.info("Test RPC errors")
+        assert_raises_rpc_error(-8, "vout cannot be negative", self.nodes[0].getspentinfo, self.coinbase, -1)
+        assert_raises_rpc_error(-1, "Spent index is not enabled", self.nodes[1].getspentinfo, self.coinbase, 0)
+
+
+if __name__ == '__main__':
+    SpentIndexTest().main()
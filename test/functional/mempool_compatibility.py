@@ -21,12 +21,13 @@ class MempoolCompatibilityTest(BitcoinTestFramework):
     def set_test_params(self):
         self.num_nodes = 2
         self.wallet_names = [None]
+        self.extra_args = [[], ["-persistmempoolv1"]]
 
     def skip_test_if_missing_module(self):
         self.skip_if_no_previous_releases()
 
     def setup_network(self):
-        self.add_nodes(self.num_nodes, versions=[
+        self.add_nodes(self.num_nodes, extra_args=self.extra_args, versions=[
             190100,  # oldest version with getmempoolinfo.loaded (used to avoid intermittent issues)
             None,
         ])
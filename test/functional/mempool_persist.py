@@ -33,6 +33,9 @@ Test is as follows:
     mempool.
   - Verify that savemempool throws when the RPC is called if
     node1 can't write to disk.
+  - Verify that node1 checks the scripts of the transactions it loads
+    from a legacy mempool.dat, one written at a different tip or one
+    written by another node, and skips the policy checks otherwise.
 
 """
 from decimal import Decimal
@@ -125,9 +128,10 @@ class MempoolPersistTest(BitcoinTestFramework):
         assert self.nodes[0].getmempoolinfo()["loaded"]
         assert_equal(len(self.nodes[0].getrawmempool()), 0)
 
-        self.log.debug("Stop-start node0. Verify that it has the transactions in its mempool.")
+        self.log.debug("Stop-start node0. Verify that it has the transactions in its mempool, without running the policy script checks again.")
         self.stop_nodes()
-        self.start_node(0)
+        with self.nodes[0].assert_debug_log(["6 succeeded (6 without policy script checks)"]):
+            self.start_node(0)
         assert self.nodes[0].getmempoolinfo()["loaded"]
         assert_equal(len(self.nodes[0].getrawmempool()), 6)
 
@@ -138,10 +142,11 @@ class MempoolPersistTest(BitcoinTestFramework):
         self.nodes[0].savemempool()
         assert os.path.isfile(mempooldat0)
 
-        self.log.debug("Stop nodes, make node1 use mempool.dat from node0. Verify it has 6 transactions")
+        self.log.debug("Stop nodes, make node1 use mempool.dat from node0. Verify it has 6 transactions, and that it checks their scripts as the file doesn't authenticate with its key")
         os.rename(mempooldat0, mempooldat1)
         self.stop_nodes()
-        self.start_node(1, extra_args=[])
+        with self.nodes[1].assert_debug_log(["6 succeeded (0 without policy script checks)"]):
+            self.start_node(1, extra_args=[])
         assert self.nodes[1].getmempoolinfo()["loaded"]
         assert_equal(len(self.nodes[1].getrawmempool()), 6)
 
@@ -153,6 +158,22 @@ class MempoolPersistTest(BitcoinTestFramework):
         assert_raises_rpc_error(-1, "Unable to dump mempool to disk", self.nodes[1].savemempool)
         os.rmdir(mempooldotnew1)
 
+        self.log.debug("Write mempool.dat in the legacy format. Verify that node1 loads it and checks the scripts")
+        self.restart_node(1, extra_args=["-persistmempoolv1"])
+        with self.nodes[1].assert_debug_log(["6 succeeded (0 without policy script checks)"]):
+            self.restart_node(1, extra_args=[])
+        assert_equal(len(self.nodes[1].getrawmempool()), 6)
+
+        self.log.debug("Load a mempool.dat written at a previous tip. Verify that node1 checks the scripts")
+        self.nodes[1].savemempool()
+        os.rename(mempooldat1, mempooldat1 + '.old')
+        self.nodes[1].generateblock(output=self.nodes[1].getnewaddress(), transactions=[])
+        self.stop_node(1)
+        os.rename(mempooldat1 + '.old', mempooldat1)
+        with self.nodes[1].assert_debug_log(["6 succeeded (0 without policy script checks)"]):
+            self.start_node(1, extra_args=[])
+        assert_equal(len(self.nodes[1].getrawmempool()), 6)
+
         self.test_persist_unbroadcast()
 
     def test_persist_unbroadcast(self):
@@ -5,29 +5,65 @@
 """Test GETDATA processing behavior"""
 from collections import defaultdict
 
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
 from test_framework.messages import (
+    CBlock,
     CInv,
+    MSG_BLOCK,
+    MSG_WITNESS_FLAG,
+    from_hex,
     msg_getdata,
 )
 from test_framework.p2p import P2PInterface
 from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+SEGWIT_HEIGHT = 10
 
 
 class P2PStoreBlock(P2PInterface):
     def __init__(self):
         super().__init__()
         self.blocks = defaultdict(int)
+        self.last_block = None
 
     def on_block(self, message):
         message.block.calc_sha256()
         self.blocks[message.block.sha256] += 1
+        self.last_block = message.block
 
 
 class GetdataTest(BitcoinTestFramework):
     def set_test_params(self):
-        self.num_nodes = 1
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [
+            [f"-segwitheight={SEGWIT_HEIGHT}"],
+            [f"-segwitheight={SEGWIT_HEIGHT}", "-mmapblocks"],
+        ]
 
     def run_test(self):
+        self.nodes[0].generatetoaddress(2 * SEGWIT_HEIGHT, ADDRESS_BCRT1_UNSPENDABLE)
+        self.sync_all()
+        for node in self.nodes:
+            self.test_block_serving(node)
+        self.test_invalid_getdata()
+
+    def test_block_serving(self, node):
+        self.log.info("test that blocks served from disk match their requested serialization")
+        peer = node.add_p2p_connection(P2PStoreBlock())
+        # Skip the tip, which is served from memory.
+        for height in range(1, node.getblockcount()):
+            block_hash = node.getblockhash(height)
+            expected = from_hex(CBlock(), node.getblock(block_hash, 0))
+            assert_equal(len(expected.vtx[0].wit.vtxinwit) > 0, height >= SEGWIT_HEIGHT)
+            for inv_type, with_witness in [(MSG_BLOCK, False), (MSG_BLOCK | MSG_WITNESS_FLAG, True)]:
+                peer.last_block = None
+                peer.send_and_ping(msg_getdata([CInv(t=inv_type, h=int(block_hash, 16))]))
+                assert_equal(peer.last_block.serialize(), expected.serialize(with_witness=with_witness))
+        node.disconnect_p2ps()
+
+    def test_invalid_getdata(self):
         p2p_block_store = self.nodes[0].add_p2p_connection(P2PStoreBlock())
 
         self.log.info("test that an invalid GETDATA doesn't prevent processing of future messages")
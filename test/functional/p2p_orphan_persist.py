@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that orphan transactions survive a restart with -persistorphans.
+
+An orphan whose parent is in mempool.dat is accepted when the orphans are
+loaded, and one whose parent is still unknown waits for it to be relayed.
+Without -persistorphans, orphans are lost on restart.
+"""
+
+from decimal import Decimal
+import os
+
+from test_framework.messages import (
+    COIN,
+    msg_tx,
+)
+from test_framework.p2p import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+
+class OrphanPersistTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-persistorphans"]]
+
+    def create_parent_and_child(self):
+        parent = self.wallet.create_self_transfer(from_node=self.nodes[0])
+        utxo = {'txid': parent['txid'], 'vout': 0, 'value': Decimal(parent['tx'].vout[0].nValue) / COIN}
+        child = self.wallet.create_self_transfer(from_node=self.nodes[0], utxo_to_spend=utxo, mempool_valid=False)
+        return parent, child
+
+    def send_orphan(self, tx):
+        with self.nodes[0].assert_debug_log(["stored orphan tx {}".format(tx['txid'])]):
+            self.nodes[0].p2ps[0].send_and_ping(msg_tx(tx['tx']))
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.wallet = MiniWallet(node)
+        self.wallet.generate(5)
+        node.generate(100)
+
+        parent_relayed, child_relayed = self.create_parent_and_child()
+        parent_in_mempool, child_in_mempool = self.create_parent_and_child()
+        parent_lost, child_lost = self.create_parent_and_child()
+
+        self.log.info("Send orphans from a peer")
+        node.add_p2p_connection(P2PInterface())
+        self.send_orphan(child_relayed)
+        self.send_orphan(child_in_mempool)
+        # Submitted locally, so its child isn't reconsidered until the restart
+        node.sendrawtransaction(parent_in_mempool['hex'])
+        assert_equal(node.getrawmempool(), [parent_in_mempool['txid']])
+
+        self.log.info("Orphans are saved on shutdown, and those whose parents are known are accepted on restart")
+        with node.assert_debug_log(["Imported orphan transactions from disk: 2 loaded, 1 still orphans"], timeout=10):
+            self.restart_node(0)
+        assert os.path.isfile(os.path.join(node.datadir, self.chain, "orphans.dat"))
+        assert_equal(sorted(node.getrawmempool()), sorted([parent_in_mempool['txid'], child_in_mempool['txid']]))
+
+        self.log.info("The remaining orphan is accepted when its parent is relayed")
+        node.add_p2p_connection(P2PInterface())
+        node.p2ps[0].send_and_ping(msg_tx(parent_relayed['tx']))
+        assert child_relayed['txid'] in node.getrawmempool()
+
+        self.log.info("The orphan limits apply while orphans are loaded from disk")
+        _, child_a = self.create_parent_and_child()
+        _, child_b = self.create_parent_and_child()
+        self.send_orphan(child_a)
+        self.send_orphan(child_b)
+        with node.assert_debug_log(["Imported orphan transactions from disk: 2 loaded, 1 still orphans"], timeout=10):
+            self.restart_node(0, extra_args=["-persistorphans", "-maxorphantx=1"])
+        node.add_p2p_connection(P2PInterface())
+
+        self.log.info("Without -persistorphans, orphans are lost on restart")
+        self.send_orphan(child_lost)
+        self.restart_node(0, extra_args=["-persistorphans=0"])
+        node.add_p2p_connection(P2PInterface())
+        node.p2ps[0].send_and_ping(msg_tx(parent_lost['tx']))
+        assert parent_lost['txid'] in node.getrawmempool()
+        assert child_lost['txid'] not in node.getrawmempool()
+
+
+if __name__ == '__main__':
+    OrphanPersistTest().main()
@@ -42,6 +42,12 @@ class RpcMiscTest(BitcoinTestFramework):
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
 
+        sigcache = node.getmemoryinfo()['sigcache']
+        assert_equal(sigcache['shards'], 16)
+        for counter in ['hits', 'misses', 'erases', 'inserts']:
+            assert_greater_than_or_equal(sigcache[counter], 0)
+        assert_greater_than_or_equal(sigcache['hits'], sigcache['erases'])
+
         self.log.info("test mallocinfo")
         try:
             mallocinfo = node.getmemoryinfo(mode="mallocinfo")
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test submitting batches of transactions with sendrawtransactions and REST."""
+
+from decimal import Decimal
+import http.client
+import json
+import urllib.parse
+
+from test_framework.messages import COIN
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+from test_framework.wallet import (
+    MiniWallet,
+    MiniWalletMode,
+)
+
+
+class SendRawTransactionsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-rest"], []]
+        self.supports_cli = False
+
+    def create_child(self, parent):
+        """Create a transaction spending the output of parent, which isn't in the mempool yet"""
+        utxo = {'txid': parent['txid'], 'vout': 0, 'value': Decimal(parent['tx'].vout[0].nValue) / COIN}
+        return self.wallet.create_self_transfer(from_node=self.nodes[0], utxo_to_spend=utxo, mempool_valid=False)
+
+    def rest_sendrawtransactions(self, method, body):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request(method, '/rest/sendrawtransactions.json', body)
+        return conn.getresponse()
+
+    def run_test(self):
+        node = self.nodes[0]
+        # Signed transactions, so that there are signatures to check
+        self.wallet = MiniWallet(node, mode=MiniWalletMode.RAW_P2PK)
+        self.wallet.generate(20)
+        node.generate(100)
+        self.sync_all()
+
+        self.log.info("Submit independent transactions and a parent after its child")
+        txs = [self.wallet.create_self_transfer(from_node=node) for _ in range(5)]
+        parent = self.wallet.create_self_transfer(from_node=node)
+        child = self.create_child(parent)
+        batch = txs + [child, parent]
+        results = node.sendrawtransactions([tx['hex'] for tx in batch])
+        assert_equal(results, [{'txid': tx['txid'], 'wtxid': tx['wtxid']} for tx in batch])
+        self.sync_mempools()
+        assert_equal(sorted(self.nodes[1].getrawmempool()), sorted(tx['txid'] for tx in batch))
+
+        self.log.info("Rejected transactions don't affect the rest of the batch")
+        known = txs[0]
+        invalid = self.wallet.create_self_transfer(from_node=node)
+        invalid['tx'].vout[0].nValue -= 1000  # invalidates the signature
+        invalid_hex = invalid['tx'].serialize().hex()
+        high_fee = self.wallet.create_self_transfer(from_node=node, fee_rate=Decimal("1"), mempool_valid=False)
+        orphan = self.create_child(self.wallet.create_self_transfer(from_node=node))
+        valid = self.wallet.create_self_transfer(from_node=node)
+        results = node.sendrawtransactions([known['hex'], invalid_hex, high_fee['hex'], orphan['hex'], valid['hex']])
+        assert_equal(len(results), 5)
+        assert 'error' not in results[0]
+        assert 'mandatory-script-verify-flag-failed' in results[1]['error']
+        assert_equal(results[2]['error'], 'Fee exceeds maximum configured by user (e.g. -maxtxfee, maxfeerate)')
+        assert_equal(results[3]['error'], 'bad-txns-inputs-missingorspent')
+        assert_equal(results[4], {'txid': valid['txid'], 'wtxid': valid['wtxid']})
+        assert valid['txid'] in node.getrawmempool()
+        assert high_fee['txid'] not in node.getrawmempool()
+
+        self.log.info("maxfeerate can be raised")
+        results = node.sendrawtransactions([high_fee['hex']], 0)
+        assert_equal(results, [{'txid': high_fee['txid'], 'wtxid': high_fee['wtxid']}])
+
+        assert_raises_rpc_error(-22, "TX decode failed", node.sendrawtransactions, ["00"])
+        assert_raises_rpc_error(-3, "Transaction must be a hex string, got number: 1", node.sendrawtransactions, [1])
+        assert_raises_rpc_error(-8, "Array must contain at most 1000 transactions.", node.sendrawtransactions, ["00"] * 1001)
+
+        self.log.info("Submit transactions through REST")
+        txs = [self.wallet.create_self_transfer(from_node=node) for _ in range(3)]
+        resp = self.rest_sendrawtransactions('POST', json.dumps([tx['hex'] for tx in txs]))
+        assert_equal(resp.status, 200)
+        assert_equal(json.loads(resp.read()), [{'txid': tx['txid'], 'wtxid': tx['wtxid']} for tx in txs])
+        assert all(tx['txid'] in node.getrawmempool() for tx in txs)
+        assert_equal(self.rest_sendrawtransactions('GET', '').status, 405)
+        assert_equal(self.rest_sendrawtransactions('POST', '{}').status, 400)
+        assert_equal(self.rest_sendrawtransactions('POST', '["00"]').status, 400)
+        resp = self.rest_sendrawtransactions('POST', '[1]')
+        assert_equal(resp.status, 400)
+        assert_equal(resp.read().decode(), "Transaction must be a hex string, got number: 1\r\n")
+        assert_equal(self.rest_sendrawtransactions('POST', json.dumps(["00"] * 1001)).status, 400)
+
+
+if __name__ == '__main__':
+    SendRawTransactionsTest().main()
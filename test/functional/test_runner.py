@@ -201,6 +201,7 @@ BASE_SCRIPTS = [
     'p2p_invalid_block.py',
     'p2p_invalid_messages.py',
     'p2p_invalid_tx.py',
+    'p2p_orphan_persist.py',
     'feature_assumevalid.py',
     'example_test.py',
     'wallet_txn_doublespend.py --legacy-wallet',
@@ -211,6 +212,7 @@ BASE_SCRIPTS = [
     'feature_notifications.py',
     'rpc_getblockfilter.py',
     'rpc_invalidateblock.py',
+    'feature_backgroundflush.py',
     'feature_utxo_set_hash.py',
     'feature_rbf.py',
     'mempool_packages.py',
@@ -233,6 +235,7 @@ BASE_SCRIPTS = [
     'feature_nulldummy.py --legacy-wallet',
     'feature_nulldummy.py --descriptors',
     'mempool_accept.py',
+    'rpc_sendrawtransactions.py',
     'mempool_expiry.py',
     'wallet_import_rescan.py --legacy-wallet',
     'wallet_import_with_label.py --legacy-wallet',
@@ -292,6 +295,8 @@ BASE_SCRIPTS = [
     'feature_logging.py',
     'feature_anchors.py',
     'feature_coinstatsindex.py',
+    'feature_scriptindex.py',
+    'feature_spentindex.py',
     'wallet_orphanedreward.py',
     'p2p_node_network_limited.py',
     'p2p_permissions.py',